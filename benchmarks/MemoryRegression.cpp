@@ -0,0 +1,123 @@
+// MemoryRegression.cpp - Fails when the memory per scanned item grows
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "BlockingQueue.h"
+#include "Item.h"
+#include "MemoryUsage.h"
+#include "TokenBucket.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+//
+// Scans a generated fixture tree the way the headless scan does and
+// compares CMemoryUsage::GetTotalPerItem() against the limit given on the
+// command line (checked in with the test in CMakeLists.txt). The fixture is
+// the same on every run: 8 top level folders with 25 folders of 100 files
+// each, with names and extensions as found in source trees.
+//
+//   windirstat-memory-regression <max bytes per item> [fixture folder]
+//
+
+namespace
+{
+    constexpr std::array extensions = { L".cpp", L".h", L".txt", L".json", L".png", L".js", L".py", L"" };
+    constexpr std::array folders = { L"src", L"include", L"docs", L"node_modules", L"assets", L"tests", L"build", L".git" };
+
+    void CreateFixture(const std::filesystem::path& root)
+    {
+        for (const auto& top : folders)
+        {
+            for (int sub = 0; sub < 25; sub++)
+            {
+                const auto folder = root / top / (L"module_" + std::to_wstring(sub));
+                std::filesystem::create_directories(folder);
+                for (int file = 0; file < 100; file++)
+                {
+                    const auto& extension = extensions[(sub + file) % extensions.size()];
+                    std::ofstream(folder / (L"file_" + std::to_wstring(file) + extension)) << file;
+                }
+            }
+        }
+    }
+
+    CItem* Scan(const std::wstring& path)
+    {
+        const auto root = new (CItemArena::Create()) CItem(IT_DIRECTORY | ITF_ROOTITEM, path);
+        root->UpdateStatsFromDisk();
+        root->UpwardAddReadJobs(1);
+        root->UpwardSetUndone();
+
+        BlockingQueue<SCANJOB> queue;
+        BlockingQueue<CItem*> sizeQueue;
+        SCANTHROTTLE throttle;
+        queue.Push(root);
+        sizeQueue.StartThreads(1, [&sizeQueue] { CItem::ScanSizesPhysical(&sizeQueue); });
+        queue.StartThreads(4, [&] { CItem::ScanItems(&queue, &sizeQueue, &throttle); });
+        queue.WaitForCompletionOrCancellation();
+        if (sizeQueue.HasStarted()) sizeQueue.WaitForCompletionOrCancellation();
+        queue.CancelExecution();
+        sizeQueue.CancelExecution();
+
+        CItem::ScanItemsFinalize(root);
+        root->RecurseFreeze();
+        return root;
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <max bytes per item> [fixture folder]\n", argv[0]);
+        return 2;
+    }
+
+    const size_t limit = std::strtoull(argv[1], nullptr, 10);
+    const std::filesystem::path fixture = argc > 2 ? std::filesystem::path(argv[2]) :
+        std::filesystem::temp_directory_path() / "windirstat-memory-fixture";
+    std::filesystem::remove_all(fixture);
+    CreateFixture(fixture);
+
+    CItem* root = Scan(FileFindPosix::FromNativePath(fixture.string()));
+    const CMemoryUsage usage = CMemoryUsage::Collect(root);
+    CItem::DeleteTree(root);
+    std::filesystem::remove_all(fixture);
+
+    for (int part = 0; part < CMemoryUsage::PART_COUNT; part++)
+    {
+        const auto id = static_cast<CMemoryUsage::PART>(part);
+        std::printf("%-18ls %10zu bytes, %4zu bytes per item\n", CMemoryUsage::GetPartName(id),
+            usage.GetBytes(id), usage.GetBytesPerItem(id));
+    }
+    std::printf("%-18s %10zu bytes, %4zu bytes per item (limit %zu) for %zu items\n", "Total",
+        usage.GetTotal(), usage.GetTotalPerItem(), limit, usage.GetItemCount());
+
+    if (usage.GetTotalPerItem() > limit)
+    {
+        std::printf("Memory per item grew beyond the limit\n");
+        return 1;
+    }
+    return 0;
+}
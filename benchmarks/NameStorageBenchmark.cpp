@@ -0,0 +1,147 @@
+// NameStorageBenchmark.cpp - Memory of names stored in the item arena
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "ItemArena.h"
+
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+//
+// Stores a corpus of file and folder names through CItemArena::StoreName
+// in the order a scan finds them and compares the memory taken with one
+// std::wstring per name. Without arguments the corpus is generated: source
+// projects with .git, node_modules and __pycache__ folders, whose names
+// repeat across the tree, and a photo folder of unique names. Given a
+// folder, the names below it are used instead.
+//
+//   windirstat-name-benchmark [folder]
+//
+
+namespace
+{
+    constexpr std::array packages = { L"lodash", L"react", L"react-dom", L"debug", L"ms", L"chalk", L"semver",
+        L"commander", L"glob", L"minimatch", L"inherits", L"once", L"wrappy", L"safe-buffer", L"yallist",
+        L"lru-cache", L"uuid", L"axios", L"express", L"body-parser", L"mime", L"mime-types", L"qs", L"tslib",
+        L"rxjs", L"typescript", L"eslint", L"webpack", L"acorn", L"ansi-regex", L"ansi-styles", L"color-convert",
+        L"color-name", L"supports-color", L"has-flag", L"strip-ansi", L"string-width", L"emoji-regex" };
+    constexpr std::array packageFiles = { L"package.json", L"README.md", L"LICENSE", L"index.js", L"CHANGELOG.md", L"lib" };
+    constexpr std::array gitFiles = { L"HEAD", L"config", L"description", L"index", L"hooks", L"info", L"logs", L"objects", L"refs" };
+
+    std::vector<std::wstring> GenerateCorpus()
+    {
+        std::vector<std::wstring> names;
+        std::mt19937 random(42);
+        const auto hex = [&](const size_t length)
+        {
+            std::wstring text;
+            for (size_t i = 0; i < length; i++) text += L"0123456789abcdef"[random() % 16];
+            return text;
+        };
+
+        for (int project = 0; project < 40; project++)
+        {
+            names.push_back(L"project_" + std::to_wstring(project));
+
+            names.emplace_back(L".git");
+            names.insert(names.end(), gitFiles.begin(), gitFiles.end());
+            for (int object = 0; object < 64; object++)
+            {
+                names.push_back(hex(2));
+                for (int file = 0; file < 8; file++) names.push_back(hex(38));
+            }
+
+            names.emplace_back(L"node_modules");
+            for (const auto& package : packages)
+            {
+                names.emplace_back(package);
+                names.insert(names.end(), packageFiles.begin(), packageFiles.end());
+                names.emplace_back(L"index.js");
+                names.emplace_back(L"utils.js");
+            }
+
+            names.emplace_back(L"src");
+            for (int module = 0; module < 80; module++) names.push_back(L"module_" + std::to_wstring(module) + L".py");
+            names.emplace_back(L"__pycache__");
+            for (int module = 0; module < 80; module++) names.push_back(L"module_" + std::to_wstring(module) + L".cpython-311.pyc");
+        }
+
+        names.emplace_back(L"Photos");
+        for (int photo = 0; photo < 5000; photo++) names.push_back(L"IMG_" + std::to_wstring(20000 + photo) + L".JPG");
+        return names;
+    }
+
+    std::vector<std::wstring> CollectCorpus(const std::filesystem::path& root)
+    {
+        std::vector<std::wstring> names;
+        std::error_code error;
+        for (auto it = std::filesystem::recursive_directory_iterator(root,
+            std::filesystem::directory_options::skip_permission_denied, error);
+            it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+        {
+            if (error) break;
+            names.push_back(it->path().filename().wstring());
+        }
+        return names;
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const std::vector<std::wstring> names = argc > 1 ? CollectCorpus(argv[1]) : GenerateCorpus();
+    if (names.empty())
+    {
+        std::fprintf(stderr, "Usage: %s [folder]\n", argv[0]);
+        return 2;
+    }
+
+    // One std::wstring per name, with the heap block of names beyond the
+    // small string buffer; allocator overhead is not counted
+    const size_t smallCapacity = std::wstring().capacity();
+    size_t wstringBytes = 0;
+    size_t characters = 0;
+    for (const auto& name : names)
+    {
+        const std::wstring copy(name);
+        wstringBytes += sizeof(std::wstring);
+        if (copy.capacity() > smallCapacity) wstringBytes += (copy.capacity() + 1) * sizeof(wchar_t);
+        characters += name.size();
+    }
+
+    // One pointer per name into the names stored in the arena
+    CItemArena* arena = CItemArena::Create();
+    for (const auto& name : names) arena->StoreName(name);
+    const size_t arenaBytes = names.size() * sizeof(LPCWSTR) + arena->GetNameBytes();
+
+    std::printf("%zu names, %.1f characters on average\n", names.size(),
+        static_cast<double>(characters) / static_cast<double>(names.size()));
+    std::printf("%-14s %10zu bytes, %5.1f bytes per name\n", "std::wstring", wstringBytes,
+        static_cast<double>(wstringBytes) / static_cast<double>(names.size()));
+    std::printf("%-14s %10zu bytes, %5.1f bytes per name (%zu stored, %zu shared)\n", "Arena", arenaBytes,
+        static_cast<double>(arenaBytes) / static_cast<double>(names.size()), arena->GetNameBytes(), arena->GetNameBytesShared());
+    std::printf("%.1f%% of the std::wstring memory\n", 100.0 * static_cast<double>(arenaBytes) / static_cast<double>(wstringBytes));
+
+    CItemArena::Release(arena);
+    return 0;
+}
@@ -0,0 +1,171 @@
+// UpwardTotalsBenchmark.cpp - Ancestor updates of per-file and per-folder publishing
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "Item.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Publishes the files of a synthetic deep tree to their ancestors in two
+// ways, from several threads at once as the scan engine does:
+//
+// - per file: UpwardAddFiles, UpwardAddSizePhysical, UpwardAddSizeLogical
+//   and UpwardUpdateLastChange for every file, as before UpwardAddTotals
+// - per folder: the totals of a folder are gathered first and published
+//   with the same four fields once, as UpwardAddTotals does
+//
+// Each walk updates every ancestor, so the number of ancestor updates
+// (atomic read-modify-writes for the counters) is the number of walks times
+// the depth. Every folder below the spine holds files only, so all files
+// share the same depth. The totals of both trees are checked to match.
+//
+//   windirstat-upward-benchmark [depth] [files] [files per folder] [threads]
+//
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct TREE
+    {
+        CItem* m_Root = nullptr;
+        std::vector<CItem*> m_Folders; // folders holding the files
+    };
+
+    TREE BuildTree(const unsigned int depth, const size_t folders)
+    {
+        TREE tree;
+        tree.m_Root = new (CItemArena::Create()) CItem(IT_DIRECTORY | ITF_ROOTITEM, L"root");
+        CItem* spine = tree.m_Root;
+        for (unsigned int level = 1; level < depth; level++)
+        {
+            const auto child = new (CItemArena::Of(spine)) CItem(IT_DIRECTORY, L"level" + std::to_wstring(level));
+            spine->AddChild(child);
+            spine = child;
+        }
+
+        for (size_t i = 0; i < folders; i++)
+        {
+            const auto folder = new (CItemArena::Of(spine)) CItem(IT_DIRECTORY, L"folder" + std::to_wstring(i));
+            spine->AddChild(folder);
+            tree.m_Folders.push_back(folder);
+        }
+        return tree;
+    }
+
+    // Same file sizes and times for both ways of publishing
+    ULONGLONG FileSize(const size_t file) { return 512 + file % 65536; }
+    FILETIME FileTime(const size_t file) { return { static_cast<DWORD>(file), 0x01D90000 }; }
+
+    template <typename Publish>
+    double Run(const TREE& tree, const unsigned int threads, const size_t filesPerFolder, Publish publish)
+    {
+        const auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]
+            {
+                for (size_t i = t; i < tree.m_Folders.size(); i += threads)
+                {
+                    publish(tree.m_Folders[i], i * filesPerFolder, filesPerFolder);
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const unsigned int depth = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    const size_t files = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+    const size_t filesPerFolder = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 64;
+    const unsigned int threads = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    if (depth < 1 || filesPerFolder < 1 || threads < 1)
+    {
+        std::fprintf(stderr, "Usage: %s [depth] [files] [files per folder] [threads]\n", argv[0]);
+        return 2;
+    }
+
+    // The folders holding the files sit below the spine, the files below them
+    const size_t folders = (files + filesPerFolder - 1) / filesPerFolder;
+    const ULONGLONG ancestors = depth + 1;
+    constexpr ULONGLONG walksPerPublish = 4;
+
+    const TREE perFile = BuildTree(depth, folders);
+    const double perFileTime = Run(perFile, threads, filesPerFolder, [](CItem* folder, const size_t first, const size_t count)
+    {
+        for (size_t file = first; file < first + count; file++)
+        {
+            folder->UpwardAddFiles(1);
+            folder->UpwardAddSizePhysical(FileSize(file));
+            folder->UpwardAddSizeLogical(FileSize(file));
+            folder->UpwardUpdateLastChange(FileTime(file));
+        }
+    });
+
+    const TREE perFolder = BuildTree(depth, folders);
+    const double perFolderTime = Run(perFolder, threads, filesPerFolder, [](CItem* folder, const size_t first, const size_t count)
+    {
+        ULONGLONG size = 0;
+        FILETIME lastChange = {};
+        for (size_t file = first; file < first + count; file++)
+        {
+            size += FileSize(file);
+            const FILETIME t = FileTime(file);
+            if (CompareFileTime(&t, &lastChange) == 1) lastChange = t;
+        }
+        folder->UpwardAddFiles(static_cast<ULONG>(count));
+        folder->UpwardAddSizePhysical(size);
+        folder->UpwardAddSizeLogical(size);
+        folder->UpwardUpdateLastChange(lastChange);
+    });
+
+    const size_t published = folders * filesPerFolder;
+    const bool match = perFile.m_Root->GetFilesCount() == published &&
+        perFolder.m_Root->GetFilesCount() == published &&
+        perFile.m_Root->GetSizePhysical() == perFolder.m_Root->GetSizePhysical() &&
+        perFile.m_Root->GetLastChange().dwLowDateTime == perFolder.m_Root->GetLastChange().dwLowDateTime;
+
+    const ULONGLONG perFileUpdates = published * walksPerPublish * ancestors;
+    const ULONGLONG perFolderUpdates = folders * walksPerPublish * ancestors;
+    std::printf("%zu files in %zu folders at depth %u, %u threads\n", published, folders, depth + 1, threads);
+    std::printf("Per file:   %14llu ancestor updates, %10.1f ms\n", static_cast<unsigned long long>(perFileUpdates), perFileTime);
+    std::printf("Per folder: %14llu ancestor updates, %10.1f ms\n", static_cast<unsigned long long>(perFolderUpdates), perFolderTime);
+    std::printf("%.0fx fewer ancestor updates, %.1fx faster\n",
+        static_cast<double>(perFileUpdates) / static_cast<double>(perFolderUpdates), perFileTime / perFolderTime);
+
+    CItem::DeleteTree(perFile.m_Root);
+    CItem::DeleteTree(perFolder.m_Root);
+    if (!match)
+    {
+        std::printf("The totals of both trees differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -31,6 +31,11 @@ namespace wds
     inline constexpr auto chrDot          = L'.';
     inline constexpr auto chrColon        = L':';
     inline constexpr auto chrBackslash    = L'\\';
+#ifdef _WIN32
+    inline constexpr auto chrPathSeparator = L'\\';
+#else
+    inline constexpr auto chrPathSeparator = L'/';
+#endif
     inline constexpr auto chrPipe         = L'|';
     inline constexpr auto chrNull         = L'\0';
     inline constexpr auto strEmpty        = L"";
@@ -100,6 +100,8 @@ public:
     }
 };
 
-#else
+#elif defined(_WIN32)
 #define VTRACE __noop
+#else
+#define VTRACE(...) ((void)0)
 #endif // _DEBUG
@@ -0,0 +1,106 @@
+// AdaptiveConcurrency.h - Declaration of CAdaptiveConcurrency
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include <algorithm>
+
+//
+// CAdaptiveConcurrency. Additive-increase / multiplicative-decrease controller
+// for the number of workers on a single volume queue. It is fed periodic
+// samples of the number of directories processed and the time active workers
+// spent starved for work:
+//
+// - If workers were mostly starved, the tree shape is the limit; hold.
+// - If throughput dropped noticeably, the volume is congested; shrink.
+// - Otherwise probe for more throughput by adding a worker.
+//
+class CAdaptiveConcurrency final
+{
+    static constexpr double CONGESTION_RATIO = 0.85; // throughput drop treated as congestion
+    static constexpr double DECREASE_FACTOR = 0.75;  // multiplicative decrease on congestion
+    static constexpr double STARVED_RATIO = 0.5;     // share of time waiting that means starved
+
+    unsigned int m_Limit;
+    unsigned int m_Maximum;
+    double m_LastRate = 0.0;
+    ULONGLONG m_LastCompleted = 0;
+    ULONGLONG m_LastWaitTime = 0;
+
+public:
+
+    static constexpr unsigned int MINIMUM_WORKERS = 1;
+    static constexpr unsigned int MAXIMUM_WORKERS = 32;
+
+    CAdaptiveConcurrency(const unsigned int initial, const unsigned int maximum = MAXIMUM_WORKERS) :
+        m_Limit(std::clamp(initial, MINIMUM_WORKERS, maximum)), m_Maximum(maximum) {}
+
+    unsigned int GetLimit() const
+    {
+        return m_Limit;
+    }
+
+    double GetLastRate() const
+    {
+        return m_LastRate;
+    }
+
+    // Caps the limit, e.g. to the share of a global worker budget
+    void SetMaximum(const unsigned int maximum)
+    {
+        m_Maximum = std::max(MINIMUM_WORKERS, maximum);
+        m_Limit = std::min(m_Limit, m_Maximum);
+    }
+
+    // Discard the running totals, e.g. after the queue was suspended
+    void Rebase(const ULONGLONG completed, const ULONGLONG waitTime)
+    {
+        m_LastCompleted = completed;
+        m_LastWaitTime = waitTime;
+    }
+
+    // Takes cumulative counters and the seconds elapsed since the last sample
+    // and returns the number of workers that should be active from now on
+    unsigned int Update(const ULONGLONG completed, const ULONGLONG waitTime, const double elapsed)
+    {
+        const double rate = static_cast<double>(completed - m_LastCompleted) / elapsed;
+        const double starved = static_cast<double>(waitTime - m_LastWaitTime) / (elapsed * 1000000.0 * m_Limit);
+        Rebase(completed, waitTime);
+
+        // Nothing finished (e.g. one very large directory); nothing to learn
+        if (rate == 0.0) return m_Limit;
+
+        if (starved >= STARVED_RATIO)
+        {
+            // Not enough outstanding directories to keep more workers busy
+        }
+        else if (m_LastRate > 0.0 && rate < m_LastRate * CONGESTION_RATIO)
+        {
+            m_Limit = std::max(MINIMUM_WORKERS, static_cast<unsigned int>(m_Limit * DECREASE_FACTOR));
+        }
+        else
+        {
+            m_Limit = std::min(m_Maximum, m_Limit + 1);
+        }
+
+        m_LastRate = rate;
+        return m_Limit;
+    }
+};
@@ -1,29 +1,149 @@
 #pragma once
 
+#ifdef _WIN32
+#include "stdafx.h"
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
+//
+// BlockingQueue. Work-stealing executor used by the scanning engine.
+//
+// Every worker owns a deque that it pushes to and pops from at the front,
+// which keeps each worker walking its own subtree depth-first. A worker that
+// runs dry steals from the back of a randomly selected victim, which tends to
+// hand it a shallow (and therefore large) subtree. Items pushed from threads
+// outside of the pool are placed in a shared injection deque.
+//
+// The central mutex is only taken when a worker has to go to sleep, when the
+// queue is suspended or cancelled, or when a push needs to wake a sleeper.
+//
+// The number of workers allowed to take items can be lowered below the number
+// of threads at runtime; workers above that limit park at their next Pop().
+//
+// Workers sleeping in Throttle() are not idle since they still hold an item,
+// but they are considered paused so that suspending does not have to wait
+// for a rate limit to expire.
+//
+// More workers can be added while running, up to the capacity given when the
+// threads were started. A queue that will not receive any further items can
+// be retired, in which case its workers return an empty item once nothing is
+// left and end so that their threads can be spent elsewhere.
+//
 template <typename T>
 class BlockingQueue
 {
+    struct WorkerDeque
+    {
+        std::mutex m_Mutex;
+        std::deque<T> m_Queue;
+    };
+
     std::vector<std::thread> m_Threads;
-    std::deque<T> m_Queue;
+    std::vector<std::unique_ptr<WorkerDeque>> m_Deques;
+    std::function<void()> m_Callback;
+    WorkerDeque m_Shared;
+    std::atomic<size_t> m_Pending = 0;
     std::mutex m_Mutex;
     std::condition_variable m_Pushed;
     std::condition_variable m_Waiting;
     unsigned int m_TotalWorkerThreads = 1;
-    unsigned int m_WorkersWaiting = 0;
-    bool m_Started = false;
-    bool m_Suspended = false;
-    bool m_Cancelled = false;
+    std::atomic<unsigned int> m_ActiveWorkers = 1;
+    std::atomic<unsigned int> m_WorkersWaiting = 0;
+    std::atomic<unsigned int> m_WorkersThrottled = 0;
+    std::atomic<ULONGLONG> m_Completed = 0;
+    std::atomic<ULONGLONG> m_WaitTime = 0;
+    std::atomic<bool> m_Started = false;
+    std::atomic<bool> m_Suspended = false;
+    std::atomic<bool> m_Cancelled = false;
+    std::atomic<bool> m_Retired = false;
+
+    // Identifies which queue and deque the current worker thread belongs to
+    static inline thread_local BlockingQueue* s_Owner = nullptr;
+    static inline thread_local size_t s_WorkerIndex = 0;
 
     bool AllThreadsIdling() const
     {
         return m_TotalWorkerThreads == m_WorkersWaiting;
     }
 
+    bool AllThreadsPaused() const
+    {
+        return m_TotalWorkerThreads == m_WorkersWaiting + m_WorkersThrottled;
+    }
+
+    bool IsWorkerThread() const
+    {
+        return s_Owner == this;
+    }
+
+    bool IsParked() const
+    {
+        return IsWorkerThread() && s_WorkerIndex >= m_ActiveWorkers;
+    }
+
+    static bool TryPopFront(WorkerDeque& deque, T& value)
+    {
+        std::lock_guard lock(deque.m_Mutex);
+        if (deque.m_Queue.empty()) return false;
+        value = std::move(deque.m_Queue.front());
+        deque.m_Queue.pop_front();
+        return true;
+    }
+
+    static bool TryPopBack(WorkerDeque& deque, T& value)
+    {
+        std::lock_guard lock(deque.m_Mutex);
+        if (deque.m_Queue.empty()) return false;
+        value = std::move(deque.m_Queue.back());
+        deque.m_Queue.pop_back();
+        return true;
+    }
+
+    bool TryAcquire(T& value)
+    {
+        if (m_Pending == 0) return false;
+
+        // Prefer our own work, then anything injected from outside the pool
+        if (IsWorkerThread() && TryPopFront(*m_Deques[s_WorkerIndex], value) ||
+            TryPopFront(m_Shared, value))
+        {
+            m_Pending--;
+            return true;
+        }
+
+        // Steal from the opposite end of a random victim
+        thread_local std::minstd_rand random(static_cast<unsigned int>(
+            std::hash<std::thread::id>{}(std::this_thread::get_id())));
+        const size_t count = m_Deques.size();
+        const size_t start = count > 0 ? random() % count : 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const size_t victim = (start + i) % count;
+            if (IsWorkerThread() && victim == s_WorkerIndex) continue;
+            if (TryPopBack(*m_Deques[victim], value))
+            {
+                m_Pending--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
 public:
     BlockingQueue(const BlockingQueue&) = delete;
     BlockingQueue(BlockingQueue&&) = delete;
@@ -32,8 +152,11 @@ public:
     ~BlockingQueue() = default;
     BlockingQueue() = default;
 
-    void ThreadWrapper(const std::function<void()> & callback)
+    void ThreadWrapper(const size_t workerIndex, const std::function<void()> & callback)
     {
+        s_Owner = this;
+        s_WorkerIndex = workerIndex;
+
         try
         {
             callback();
@@ -45,50 +168,119 @@ public:
             m_WorkersWaiting++;
             m_Waiting.notify_all();
         }
+
+        s_Owner = nullptr;
     }
 
-    void StartThreads(const unsigned int workerThreads, const std::function<void()> & callback)
+    void StartThreads(const unsigned int workerThreads, const std::function<void()> & callback, const unsigned int capacity = 0)
     {
-        ResetQueue(workerThreads, false);
+        ResetQueue(workerThreads, false, capacity);
 
+        m_Callback = callback;
         for (auto worker = 0u; worker < m_TotalWorkerThreads; worker++)
         {
-            m_Threads.emplace_back(&BlockingQueue::ThreadWrapper, this, callback);
+            m_Threads.emplace_back(&BlockingQueue::ThreadWrapper, this, worker, m_Callback);
         }
     }
 
-    void Push(T const& value)
+    // Starts further workers up to the capacity; returns how many were added
+    unsigned int AddThreads(const unsigned int workerThreads)
     {
-        // Push another entry onto the queue
         std::lock_guard lock(m_Mutex);
-        m_Queue.push_front(value);
-        m_Pushed.notify_one();
+        if (m_Cancelled || m_Retired) return 0;
+
+        const auto added = std::min<unsigned int>(workerThreads, static_cast<unsigned int>(m_Deques.size() - m_Threads.size()));
+        for (auto worker = 0u; worker < added; worker++)
+        {
+            m_Threads.emplace_back(&BlockingQueue::ThreadWrapper, this, m_Threads.size(), m_Callback);
+        }
+        m_TotalWorkerThreads += added;
+        return added;
     }
 
-    T Pop()
+    // Lets the workers end once everything has been taken; only to be used
+    // when nothing can be pushed any longer
+    void Retire()
     {
-        // Record the worker is m_Waiting for an item until
-        // the queue has something in it and we are not suspended
-        std::unique_lock lock(m_Mutex);
-        m_WorkersWaiting++;
-        m_Waiting.notify_all();
-        m_Pushed.wait(lock, [&]
+        std::lock_guard lock(m_Mutex);
+        m_Retired = true;
+        m_Pushed.notify_all();
+    }
+
+    void Push(T value)
+    {
+        // Account for the item before it becomes visible so the
+        // pending count never underflows when it is popped right away
+        m_Pending++;
         {
-            return !m_Suspended && !m_Queue.empty() || m_Cancelled;
-        });
-        m_WorkersWaiting--;
+            WorkerDeque& deque = IsWorkerThread() ? *m_Deques[s_WorkerIndex] : m_Shared;
+            std::lock_guard lock(deque.m_Mutex);
+            deque.m_Queue.push_front(std::move(value));
+        }
 
-        if (m_Cancelled)
+        // Only touch the central lock if someone may be sleeping; wake
+        // everyone if parked workers could otherwise swallow the notification
+        if (m_WorkersWaiting > 0)
         {
-            // Mark we are in waiting mode again and abort
-            throw std::exception(__FUNCTION__);
+            std::lock_guard lock(m_Mutex);
+            if (m_ActiveWorkers < m_TotalWorkerThreads) m_Pushed.notify_all();
+            else m_Pushed.notify_one();
         }
+    }
+
+    T Pop()
+    {
+        T value{};
+        while (m_Cancelled || m_Suspended || IsParked() || !TryAcquire(value))
+        {
+            // Record the worker is m_Waiting for an item until the queue
+            // has something in it and we are not suspended or parked
+            std::unique_lock lock(m_Mutex);
+            m_WorkersWaiting++;
+            m_Waiting.notify_all();
+            const bool starved = !m_Suspended && !IsParked();
+            const auto waitStart = std::chrono::steady_clock::now();
+            m_Pushed.wait(lock, [&]
+            {
+                return !m_Suspended && !IsParked() && m_Pending > 0 || m_Cancelled || m_Retired && m_Pending == 0;
+            });
+            m_WorkersWaiting--;
+
+            // Only time spent waiting for work counts towards starvation
+            if (starved) m_WaitTime += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - waitStart).count();
+
+            if (m_Cancelled)
+            {
+                // Mark we are in waiting mode again and abort
+                throw std::runtime_error(__FUNCTION__);
+            }
+
+            if (m_Retired && m_Pending == 0)
+            {
+                // The worker ends; it no longer counts towards completion
+                m_TotalWorkerThreads--;
+                m_ActiveWorkers = std::min(m_ActiveWorkers.load(), std::max(1u, m_TotalWorkerThreads));
+                m_Waiting.notify_all();
+                return T{};
+            }
+        }
+
+        // Worker now has something to work on
+        m_Started = true;
+        m_Completed++;
+        return value;
+    }
+
+    // Non-blocking variant of Pop() for workers that have other work in
+    // flight; fails if nothing is available or the worker may not take items
+    bool TryPop(T& value)
+    {
+        if (m_Cancelled || m_Suspended || IsParked() || !TryAcquire(value)) return false;
 
-        // Worker now has something to work on so pop it off the queue
         m_Started = true;
-        T& i = m_Queue.front();
-        m_Queue.pop_front();
-        return i;
+        m_Completed++;
+        return true;
     }
 
     void WaitIfSuspended()
@@ -108,17 +300,42 @@ public:
         // if cancelled then throw to terminate current task
         if (m_Cancelled)
         {
-            throw std::exception(__FUNCTION__);
+            throw std::runtime_error(__FUNCTION__);
         }
     }
 
+    // Sleeps for the given time on behalf of a rate limited worker; returns
+    // early and throws if cancelled, and honors a suspension afterwards
+    void Throttle(const std::chrono::steady_clock::duration duration)
+    {
+        if (duration <= std::chrono::steady_clock::duration::zero()) return;
+
+        {
+            std::unique_lock lock(m_Mutex);
+            m_WorkersThrottled++;
+            m_Waiting.notify_all();
+            m_Waiting.wait_for(lock, duration, [&]
+            {
+                return m_Cancelled.load();
+            });
+            m_WorkersThrottled--;
+
+            if (m_Cancelled)
+            {
+                throw std::runtime_error(__FUNCTION__);
+            }
+        }
+
+        WaitIfSuspended();
+    }
+
     bool WaitForCompletionOrCancellation()
     {
         // Wait for all workers threads to be idled or cancelled
         std::unique_lock lock(m_Mutex);
         m_Waiting.wait(lock, [&]
         {
-            return m_Started && !m_Suspended && AllThreadsIdling() && m_Queue.empty() || m_Cancelled;
+            return m_Started && !m_Suspended && AllThreadsIdling() && m_Pending == 0 || m_Cancelled;
         });
 
         return !m_Cancelled;
@@ -127,7 +344,10 @@ public:
     void CancelExecution()
     {
         // Start cancellation process
-        m_Cancelled = true;
+        {
+            std::lock_guard lock(m_Mutex);
+            m_Cancelled = true;
+        }
         m_Waiting.notify_all();
         m_Pushed.notify_all();
 
@@ -141,6 +361,50 @@ public:
         ResetQueue(m_TotalWorkerThreads);
     }
 
+    void SetActiveWorkers(const unsigned int activeWorkers)
+    {
+        std::lock_guard lock(m_Mutex);
+        m_ActiveWorkers = std::clamp(activeWorkers, 1u, m_TotalWorkerThreads);
+        m_Pushed.notify_all();
+    }
+
+    unsigned int GetActiveWorkers() const
+    {
+        return m_ActiveWorkers;
+    }
+
+    // Number of workers that are running and have not ended
+    unsigned int GetThreadCount()
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_TotalWorkerThreads;
+    }
+
+    // Number of items handed out to workers since the queue was started
+    ULONGLONG GetCompletedCount() const
+    {
+        return m_Completed;
+    }
+
+    // Number of items pushed but not yet handed out to a worker
+    size_t GetPendingCount() const
+    {
+        return m_Pending;
+    }
+
+    // Accumulated time in microseconds that active workers spent waiting for work
+    ULONGLONG GetWaitTime() const
+    {
+        return m_WaitTime;
+    }
+
+    // True once anything was pushed since the threads were started; waiting
+    // for completion before that would never return
+    bool HasStarted() const
+    {
+        return m_Started || m_Pending > 0;
+    }
+
     bool IsSuspended() const
     {
         return m_Started && m_Suspended;
@@ -153,7 +417,7 @@ public:
         m_Waiting.notify_all();
         m_Waiting.wait(lock, [&]
         {
-            return AllThreadsIdling();
+            return AllThreadsPaused();
         });
     }
 
@@ -165,17 +429,36 @@ public:
         m_Pushed.notify_all();
     }
 
-    void ResetQueue(const int totalWorkerThreads, bool clearQueue = true)
+    void ResetQueue(const int totalWorkerThreads, bool clearQueue = true, const unsigned int capacity = 0)
     {
         std::lock_guard lock(m_Mutex);
         m_WorkersWaiting = 0;
+        m_WorkersThrottled = 0;
         m_Suspended = false;
         m_Started = false;
         m_Cancelled = false;
+        m_Retired = false;
         m_TotalWorkerThreads = totalWorkerThreads;
+        m_ActiveWorkers = m_TotalWorkerThreads;
+        m_Completed = 0;
+        m_WaitTime = 0;
         m_Threads.clear();
-        m_Threads.reserve(m_TotalWorkerThreads);
-        if (clearQueue) m_Queue.clear();
+        m_Threads.reserve(std::max(m_TotalWorkerThreads, capacity));
+
+        // Fold anything left in the per-worker deques back into the shared
+        // deque since the number of workers (and thus deques) may change
+        for (const auto& deque : m_Deques)
+        {
+            if (!clearQueue) m_Shared.m_Queue.insert(m_Shared.m_Queue.end(),
+                deque->m_Queue.begin(), deque->m_Queue.end());
+        }
+        m_Deques.clear();
+        for (auto worker = 0u; worker < std::max(m_TotalWorkerThreads, capacity); worker++)
+        {
+            m_Deques.emplace_back(std::make_unique<WorkerDeque>());
+        }
+
+        if (clearQueue) m_Shared.m_Queue.clear();
+        m_Pending = m_Shared.m_Queue.size();
     }
 };
-
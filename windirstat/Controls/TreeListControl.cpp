@@ -265,6 +265,13 @@ void CTreeListItem::SetExpanded(const bool expanded)
     m_VisualInfo->isExpanded = expanded;
 }
 
+size_t CTreeListItem::GetVisibleInfoBytes() const
+{
+    if (!IsVisible()) return 0;
+    return sizeof(VISIBLEINFO) + m_VisualInfo->sortedChildren.capacity() * sizeof(CTreeListItem*) +
+        (m_VisualInfo->owner.capacity() > std::wstring().capacity() ? (m_VisualInfo->owner.capacity() + 1) * sizeof(WCHAR) : 0);
+}
+
 void CTreeListItem::SetVisible(CTreeListControl* control, const bool visible)
 {
     if (visible)
@@ -481,6 +488,19 @@ int CTreeListControl::FindTreeItem(const CTreeListItem* item) const
     return FindListItem(item);
 }
 
+// Every row of the list is an item with visible information
+size_t CTreeListControl::GetVisibleInfoBytes() const
+{
+    if (GetSafeHwnd() == nullptr) return 0;
+
+    size_t bytes = 0;
+    for (int i = 0; i < GetItemCount(); i++)
+    {
+        bytes += GetItem(i)->GetVisibleInfoBytes();
+    }
+    return bytes;
+}
+
 #pragma warning(push)
 #pragma warning(disable:26454)
 BEGIN_MESSAGE_MAP(CTreeListControl, COwnerDrawnListControl)
@@ -871,6 +891,23 @@ void CTreeListControl::OnChildAdded(const CTreeListItem* parent, CTreeListItem*
     // NOTE: Redrawing is deffered to UI thread timer for performance
 }
 
+void CTreeListControl::OnChildrenAdded(const CTreeListItem* parent, const std::vector<CTreeListItem*>& children)
+{
+    if (!parent->IsVisible() || !parent->IsExpanded())
+    {
+        return;
+    }
+
+    // Insert everything first so the list is only sorted once
+    const int p = FindTreeItem(parent);
+    ASSERT(p != -1);
+    for (const auto& child : children)
+    {
+        InsertItem(p + 1, child);
+    }
+    Sort();
+}
+
 void CTreeListControl::OnChildRemoved(CTreeListItem* parent, CTreeListItem* child)
 {
     if (!parent->IsVisible())
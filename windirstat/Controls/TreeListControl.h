@@ -85,6 +85,7 @@ public:
     bool IsExpanded() const;
     void SetExpanded(bool expanded = true);
     bool IsVisible() const { return m_VisualInfo != nullptr; }
+    size_t GetVisibleInfoBytes() const;
     void SetVisible(CTreeListControl * control, bool visible = true);
     unsigned char GetIndent() const;
     void SetIndent(unsigned char indent);
@@ -119,6 +120,7 @@ class CTreeListControl : public COwnerDrawnListControl
     void SysColorChanged() override;
     virtual void SetRootItem(CTreeListItem* root);
     void OnChildAdded(const CTreeListItem* parent, CTreeListItem* child);
+    void OnChildrenAdded(const CTreeListItem* parent, const std::vector<CTreeListItem*>& children);
     void OnChildRemoved(CTreeListItem* parent, CTreeListItem* child);
     void OnRemovingAllChildren(const CTreeListItem* parent);
     CTreeListItem* GetItem(int i) const;
@@ -131,6 +133,7 @@ class CTreeListControl : public COwnerDrawnListControl
     void EnsureItemVisible(const CTreeListItem* item);
     void ExpandItem(const CTreeListItem* item);
     int FindTreeItem(const CTreeListItem* item) const;
+    size_t GetVisibleInfoBytes() const;
     int GetItemScrollPosition(const CTreeListItem* item) const;
     void SetItemScrollPosition(const CTreeListItem* item, int top);
     bool SelectedItemCanToggle();
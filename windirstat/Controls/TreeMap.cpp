@@ -265,6 +265,7 @@ void CTreeMap::DrawTreeMap(CDC* pdc, CRect rc, Item* root, const Options* option
     }
 
     m_RenderArea = rc;
+    ClearRectangles();
 
     if (root->TmiGetSize() > 0)
     {
@@ -346,7 +347,7 @@ void CTreeMap::DrawTreeMapDoubleBuffered(CDC* pdc, const CRect& rc, Item* root,
 CTreeMap::Item* CTreeMap::FindItemByPoint(Item* item, const CPoint point)
 {
     ASSERT(item != nullptr);
-    const CRect& rc = item->TmiGetRectangle();
+    const CRect& rc = GetRectangle(item);
 
     if (!rc.PtInRect(point))
     {
@@ -386,7 +387,7 @@ CTreeMap::Item* CTreeMap::FindItemByPoint(Item* item, const CPoint point)
             ASSERT(child->TmiGetSize() > 0);
 
 #ifdef _DEBUG
-            CRect rcChild(child->TmiGetRectangle());
+            CRect rcChild(GetRectangle(child));
             ASSERT(rcChild.right >= rcChild.left);
             ASSERT(rcChild.bottom >= rcChild.top);
             ASSERT(rcChild.left >= rc.left);
@@ -394,7 +395,7 @@ CTreeMap::Item* CTreeMap::FindItemByPoint(Item* item, const CPoint point)
             ASSERT(rcChild.top >= rc.top);
             ASSERT(rcChild.bottom <= rc.bottom);
 #endif
-            if (child->TmiGetRectangle().PtInRect(point))
+            if (GetRectangle(child).PtInRect(point))
             {
                 ret = FindItemByPoint(child, point);
                 ASSERT(ret != nullptr);
@@ -409,7 +410,7 @@ CTreeMap::Item* CTreeMap::FindItemByPoint(Item* item, const CPoint point)
                         break;
                     }
 
-                    rcChild = child->TmiGetRectangle();
+                    rcChild = GetRectangle(child);
                     if(rcChild.left == -1)
                     {
                         ASSERT(rcChild.top == -1);
@@ -443,6 +444,22 @@ CTreeMap::Item* CTreeMap::FindItemByPoint(Item* item, const CPoint point)
     return ret;
 }
 
+CRect CTreeMap::GetRectangle(const Item* item) const
+{
+    const auto rectangle = m_Rectangles.find(item);
+    return rectangle != m_Rectangles.end() ? rectangle->second : CRect();
+}
+
+void CTreeMap::ClearRectangles()
+{
+    m_Rectangles.clear();
+}
+
+void CTreeMap::SetRectangle(const Item* item, const CRect& rc)
+{
+    m_Rectangles.insert_or_assign(item, rc);
+}
+
 void CTreeMap::DrawColorPreview(CDC* pdc, const CRect& rc, const COLORREF color, const Options* options)
 {
     if (options != nullptr)
@@ -500,7 +517,7 @@ void CTreeMap::RecurseDrawGraph(std::vector<COLORREF>& bitmap, Item* item, const
 
     ASSERT(item->TmiGetSize() > 0);
 
-    item->TmiSetRectangle(rc);
+    SetRectangle(item, rc);
 
     const int gridWidth = m_Options.grid ? 1 : 0;
 
@@ -567,7 +584,7 @@ void CTreeMap::KDirStat_DrawChildren(std::vector<COLORREF>& bitmap, const Item*
 {
     ASSERT(parent->TmiGetChildCount() > 0);
 
-    const CRect& rc = parent->TmiGetRectangle();
+    const CRect& rc = GetRectangle(parent);
 
     std::vector<double> rows;     // Our rectangle is divided into rows, each of which gets this height (fraction of total height).
     std::vector<int> childrenPerRow; // childrenPerRow[i] = # of children in rows[i]
@@ -627,7 +644,7 @@ void CTreeMap::KDirStat_DrawChildren(std::vector<COLORREF>& bitmap, const Item*
             if(rcChild.Width() > 0 && rcChild.Height() > 0)
             {
                 CRect test;
-                test.IntersectRect(parent->TmiGetRectangle(), rcChild);
+                test.IntersectRect(GetRectangle(parent), rcChild);
                 ASSERT(test == rcChild);
             }
 #endif
@@ -641,7 +658,7 @@ void CTreeMap::KDirStat_DrawChildren(std::vector<COLORREF>& bitmap, const Item*
 
                 if (i < childrenPerRow[row])
                 {
-                    parent->TmiGetChild(c)->TmiSetRectangle(CRect(-1, -1, -1, -1));
+                    SetRectangle(parent->TmiGetChild(c), CRect(-1, -1, -1, -1));
                 }
 
                 c += childrenPerRow[row] - i;
@@ -679,7 +696,7 @@ bool CTreeMap::KDirStat_ArrangeChildren(
         return true;
     }
 
-    auto const& parentRect = parent->TmiGetRectangle();
+    auto const& parentRect = GetRectangle(parent);
     const bool horizontalRows = parentRect.Width() >= parentRect.Height();
 
 
@@ -791,7 +808,7 @@ double CTreeMap::KDirStat_CalculateNextRow(const Item* parent, const int nextChi
 void CTreeMap::SequoiaView_DrawChildren(std::vector<COLORREF>& bitmap, const Item* parent, const double* surface, const double h, DWORD /*flags*/)
 {
     // Rest rectangle to fill
-    CRect remaining(parent->TmiGetRectangle());
+    CRect remaining(GetRectangle(parent));
 
     ASSERT(remaining.Width() > 0);
     ASSERT(remaining.Height() > 0);
@@ -974,7 +991,7 @@ void CTreeMap::SequoiaView_DrawChildren(std::vector<COLORREF>& bitmap, const Ite
         {
             if (head < parent->TmiGetChildCount())
             {
-                parent->TmiGetChild(head)->TmiSetRectangle(CRect(-1, -1, -1, -1));
+                SetRectangle(parent->TmiGetChild(head), CRect(-1, -1, -1, -1));
             }
 
             break;
@@ -993,7 +1010,7 @@ bool CTreeMap::IsCushionShading() const
 
 void CTreeMap::RenderLeaf(std::vector<COLORREF>& bitmap, const Item* item, const double* surface)
 {
-    CRect rc = item->TmiGetRectangle();
+    CRect rc = GetRectangle(item);
 
     if (m_Options.grid)
     {
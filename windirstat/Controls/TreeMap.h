@@ -22,6 +22,7 @@
 #pragma once
 
 #include <algorithm>
+#include <unordered_map>
 #include <vector>
 
 //
@@ -72,8 +73,6 @@ public:
     public:
         virtual ~Item() = default;
         virtual bool TmiIsLeaf() const = 0;
-        virtual CRect TmiGetRectangle() const = 0;
-        virtual void TmiSetRectangle(const CRect& rc) = 0;
         virtual COLORREF TmiGetGraphColor() const = 0;
         virtual int TmiGetChildCount() const = 0;
         virtual Item* TmiGetChild(int c) const = 0;
@@ -212,10 +211,19 @@ public:
     // Return value can be NULL, iff point is outside root rect.
     Item* FindItemByPoint(Item* item, CPoint point);
 
+    // Rectangle of an item in the last treemap drawn; empty if it has none
+    CRect GetRectangle(const Item* item) const;
+
+    // Forgets the last treemap drawn, e.g. before its items are freed since
+    // new items may take their memory and would find their rectangles
+    void ClearRectangles();
+
     // Draws a sample rectangle in the given style (for color legend)
     void DrawColorPreview(CDC* pdc, const CRect& rc, COLORREF color, const Options* options = nullptr);
 
 protected:
+    void SetRectangle(const Item* item, const CRect& rc);
+
     // The recursive drawing function
     void RecurseDrawGraph(
         std::vector<COLORREF>& bitmap,
@@ -269,6 +277,10 @@ protected:
 
     CRect m_RenderArea;
 
+    // Layout of the last treemap drawn. Only items that were visited while
+    // drawing have an entry, which keeps the tree itself free of render state.
+    std::unordered_map<const Item*, CRect> m_Rectangles;
+
     Options m_Options; // Current options
     double m_Lx = 0.0; // Derived parameters
     double m_Ly = 0.0;
@@ -321,16 +333,6 @@ class CTreeMapPreview final : public CStatic
             return m_Children.empty();
         }
 
-        CRect TmiGetRectangle() const override
-        {
-            return m_Rect;
-        }
-
-        void TmiSetRectangle(const CRect& rc) override
-        {
-            m_Rect = rc;
-        }
-
         COLORREF TmiGetGraphColor() const override
         {
             return m_Color;
@@ -355,7 +357,6 @@ class CTreeMapPreview final : public CStatic
         std::vector<CItem*> m_Children; // Our children
         int m_Size = 0;                    // Our size (in fantasy units)
         COLORREF m_Color = CLR_INVALID;    // Our color
-        CRect m_Rect;                      // Our Rectangle in the treemap
     };
 
 public:
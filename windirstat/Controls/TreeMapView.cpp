@@ -207,7 +207,7 @@ void CTreeMapView::DrawHighlightExtension(CDC* pdc)
 
 void CTreeMapView::RecurseHighlightExtension(CDC* pdc, const CItem* item)
 {
-    CRect rc(item->TmiGetRectangle());
+    CRect rc(m_TreeMap.GetRectangle(item));
     if (rc.Width() <= 0 || rc.Height() <= 0)
     {
         return;
@@ -215,7 +215,7 @@ void CTreeMapView::RecurseHighlightExtension(CDC* pdc, const CItem* item)
 
     if (item->TmiIsLeaf())
     {
-        if (item->IsType(IT_FILE) && _wcsicmp(item->GetExtension().c_str(), GetDocument()->GetHighlightExtension().c_str()) == 0)
+        if (item->IsType(IT_FILE) && item->GetExtensionId() == GetDocument()->GetHighlightExtensionId())
         {
             RenderHighlightRectangle(pdc, rc);
         }
@@ -226,7 +226,7 @@ void CTreeMapView::RecurseHighlightExtension(CDC* pdc, const CItem* item)
         {
             break;
         }
-        if (child->TmiGetRectangle().left == -1)
+        if (m_TreeMap.GetRectangle(child).left == -1)
         {
             break;
         }
@@ -254,7 +254,7 @@ void CTreeMapView::DrawSelection(CDC* pdc)
 //
 void CTreeMapView::HighlightSelectedItem(CDC* pdc, const CItem* item, const bool single)
 {
-    CRect rc(item->TmiGetRectangle());
+    CRect rc(m_TreeMap.GetRectangle(item));
 
     if (single)
     {
@@ -344,6 +344,9 @@ bool CTreeMapView::IsDrawn() const
 
 void CTreeMapView::Inactivate()
 {
+    // Only the bitmap is kept; items may be freed until the next drawing
+    m_TreeMap.ClearRectangles();
+
     if (m_Bitmap.m_hObject != nullptr)
     {
         // Move the old bitmap to m_Dimmed
@@ -366,6 +369,8 @@ void CTreeMapView::Inactivate()
 
 void CTreeMapView::EmptyView()
 {
+    m_TreeMap.ClearRectangles();
+
     if (m_Bitmap.m_hObject != nullptr)
     {
         m_Bitmap.DeleteObject();
@@ -377,6 +382,12 @@ void CTreeMapView::EmptyView()
     }
 }
 
+void CTreeMapView::OnItemRemoved()
+{
+    Inactivate();
+    Invalidate();
+}
+
 void CTreeMapView::OnSetFocus(CWnd* /*pOldWnd*/)
 {
     CMainFrame::Get()->GetFileTreeView()->SetFocus();
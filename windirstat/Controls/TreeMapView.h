@@ -48,6 +48,9 @@ protected:
     void ShowTreeMap(bool show);
     void DrawEmptyView();
 
+    // Called before removed items are deleted; the treemap is drawn again
+    void OnItemRemoved();
+
 protected:
     BOOL PreCreateWindow(CREATESTRUCT& cs) override;
     void OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint) override;
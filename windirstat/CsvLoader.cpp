@@ -18,19 +18,25 @@
 // Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
+#ifdef _WIN32
 #include "stdafx.h"
+#include "Localization.h"
+#include <format>
+#else
+#include <fmt/chrono.h>
+#endif
+
 #include "langs.h"
 #include "Item.h"
-#include "Localization.h"
 #include "CsvLoader.h"
 #include "Constants.h"
+#include "Options.h"
 
 #include <fstream>
 #include <string>
 #include <stack>
 #include <sstream>
 #include <unordered_map>
-#include <format>
 #include <chrono>
 #include <array>
 #include <ranges>
@@ -49,6 +55,29 @@ enum
     FIELD_COUNT
 };
 
+// Column titles; the POSIX build has no translations and uses the English ones
+static std::wstring LookupColumnTitle(const UINT id)
+{
+#ifdef _WIN32
+    return Localization::Lookup(id);
+#else
+    static const std::unordered_map<UINT, std::wstring> titles =
+    {
+        { IDS_APP_TITLE, L"WinDirStat" },
+        { IDS_COL_NAME, L"Name" },
+        { IDS_COL_FILES, L"Files" },
+        { IDS_COL_FOLDERS, L"Folders" },
+        { IDS_COL_SIZE_LOGICAL, L"Logical Size" },
+        { IDS_COL_SIZE_PHYSICAL, L"Physical Size" },
+        { IDS_COL_ATTRIBUTES, L"Attributes" },
+        { IDS_COL_LASTCHANGE, L"Last Change" },
+        { IDS_COL_OWNER, L"Owner" }
+    };
+    return titles.at(id);
+#endif
+}
+
+#ifdef _WIN32
 std::array<CHAR, FIELD_COUNT> orderMap{};
 static void ParseHeaderLine(const std::vector<std::wstring>& header)
 {
@@ -71,13 +100,25 @@ static void ParseHeaderLine(const std::vector<std::wstring>& header)
         if (resMap.contains(header.at(c))) orderMap[resMap[header.at(c)]] = static_cast<BYTE>(c);
     }
 }
+#endif
 
+#ifdef _WIN32
 static std::chrono::file_clock::time_point ToTimePoint(const FILETIME& ft)
 {
     const std::chrono::file_clock::duration d{ (static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime };
     return std::chrono::file_clock::time_point { d };
 }
+#else
+// The file clock of the C++ library does not start in 1601 like FILETIME
+static std::chrono::sys_seconds ToTimePoint(const FILETIME& ft)
+{
+    constexpr int64_t epochDifference = 11644473600; // seconds from 1601 to 1970
+    const int64_t ticks = (static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return std::chrono::sys_seconds{ std::chrono::seconds{ ticks / 10000000 - epochDifference } };
+}
+#endif
 
+#ifdef _WIN32
 static FILETIME FromTimeString(const std::wstring & s)
 {
     // Parse date string
@@ -95,17 +136,24 @@ static FILETIME FromTimeString(const std::wstring & s)
         .dwHighDateTime = static_cast<DWORD>(tmp >> 32)
     };
 }
+#endif
 
 static std::string QuoteAndConvert(const std::wstring& inc)
 {
+#ifdef _WIN32
     const int sz = WideCharToMultiByte(CP_UTF8, WC_NO_BEST_FIT_CHARS, inc.c_str(), -1, nullptr, 0, nullptr, nullptr);
     std::string out = "\"";
     out.resize(static_cast<size_t>(sz) + 1);
     WideCharToMultiByte(CP_UTF8, 0, inc.data(), -1, &out[1], sz, nullptr, nullptr);
     out[sz] = '"';
     return out;
+#else
+    // Names that are not valid UTF-8 are written as their original bytes
+    return "\"" + FileFindPosix::ToNativePath(inc) + "\"";
+#endif
 }
 
+#ifdef _WIN32
 CItem* LoadResults(const std::wstring & path)
 {
     std::ifstream reader(path);
@@ -178,8 +226,8 @@ CItem* LoadResults(const std::wstring & path)
             displayName = &displayName[1];
         }
 
-        // Create the tree item
-        CItem* newitem = new CItem(
+        // Create the tree item; the root comes first and brings the arena of the tree
+        CItem* newitem = new (newroot != nullptr ? CItemArena::Of(newroot) : CItemArena::Create()) CItem(
             type,
             displayName,
             FromTimeString(fields[orderMap[FIELD_LASTCHANGE]]),
@@ -219,31 +267,40 @@ CItem* LoadResults(const std::wstring & path)
         val->SortItemsBySizePhysical();
     }
 
+    if (newroot != nullptr) newroot->RecurseFreeze();
     return newroot;
 }
+#endif
 
 bool SaveResults(const std::wstring& path, CItem * item)
 {
     // Output header line to file
     std::ofstream outf;
+#ifdef _WIN32
     outf.open(path, std::ios::binary);
+#else
+    outf.open(FileFindPosix::ToNativePath(path), std::ios::binary);
+#endif
+    if (!outf.is_open()) return false;
 
     // Determine columns
     std::vector<std::wstring> cols =
     {
-        Localization::Lookup(IDS_COL_NAME),
-        Localization::Lookup(IDS_COL_FILES),
-        Localization::Lookup(IDS_COL_FOLDERS),
-        Localization::Lookup(IDS_COL_SIZE_LOGICAL),
-        Localization::Lookup(IDS_COL_SIZE_PHYSICAL),
-        Localization::Lookup(IDS_COL_ATTRIBUTES),
-        Localization::Lookup(IDS_COL_LASTCHANGE),
-        Localization::Lookup(IDS_APP_TITLE) + L" " + Localization::Lookup(IDS_COL_ATTRIBUTES)
+        LookupColumnTitle(IDS_COL_NAME),
+        LookupColumnTitle(IDS_COL_FILES),
+        LookupColumnTitle(IDS_COL_FOLDERS),
+        LookupColumnTitle(IDS_COL_SIZE_LOGICAL),
+        LookupColumnTitle(IDS_COL_SIZE_PHYSICAL),
+        LookupColumnTitle(IDS_COL_ATTRIBUTES),
+        LookupColumnTitle(IDS_COL_LASTCHANGE),
+        LookupColumnTitle(IDS_APP_TITLE) + L" " + LookupColumnTitle(IDS_COL_ATTRIBUTES)
     };
+#ifdef _WIN32
     if (COptions::ShowColumnOwner)
     {
-        cols.push_back(Localization::Lookup(IDS_COL_OWNER));
+        cols.push_back(LookupColumnTitle(IDS_COL_OWNER));
     }
+#endif
 
     // Output columns to file
     for (unsigned int i = 0; i < cols.size(); i++)
@@ -262,7 +319,11 @@ bool SaveResults(const std::wstring& path, CItem * item)
 
         // Output primary columns
         const bool nonPathItem = qitem->IsType(IT_MYCOMPUTER | IT_UNKNOWN | IT_FREESPACE);
+#ifdef _WIN32
         outf << std::format("{},{},{},{},{},0x{:08X},{:%FT%TZ},0x{:04X}",
+#else
+        outf << fmt::format("{},{},{},{},{},0x{:08X},{:%FT%TZ},0x{:04X}",
+#endif
             QuoteAndConvert(nonPathItem ? qitem->GetName() : qitem->GetPath()),
             qitem->GetFilesCount(),
             qitem->GetFoldersCount(),
@@ -272,11 +333,13 @@ bool SaveResults(const std::wstring& path, CItem * item)
             ToTimePoint(qitem->GetLastChange()),
             static_cast<unsigned short>(qitem->GetRawType()));
 
+#ifdef _WIN32
         // Output additional columns
         if (COptions::ShowColumnOwner)
         {
             outf << "," << QuoteAndConvert(qitem->GetOwner(true));
         }
+#endif
 
         // Finalize lines
         outf << "\r\n";
@@ -290,5 +353,5 @@ bool SaveResults(const std::wstring& path, CItem * item)
     }
 
     outf.close();
-    return true;
+    return !outf.fail();
 }
@@ -20,16 +20,20 @@
 //
 
 #include "stdafx.h"
+#include "AdaptiveConcurrency.h"
 #include "CsvLoader.h"
 #include "deletewarningdlg.h"
 #include "DirStatDoc.h"
+#include "FileDupeControl.h"
 #include "FileTreeView.h"
 #include "GlobalHelpers.h"
 #include "TreeMapView.h"
 #include "Item.h"
 #include "Localization.h"
 #include "MainFrame.h"
+#include "MftReader.h"
 #include "ModalShellApi.h"
+#include "ScanScheduler.h"
 #include "WinDirStat.h"
 #include <common/CommonHelpers.h>
 #include <common/MdExceptions.h>
@@ -45,6 +49,8 @@
 #include <ranges>
 #include <stack>
 #include <array>
+#include <condition_variable>
+#include <stop_token>
 
 IMPLEMENT_DYNCREATE(CDirStatDoc, CDocument)
 
@@ -63,7 +69,7 @@ CDirStatDoc::CDirStatDoc() :
 
 CDirStatDoc::~CDirStatDoc()
 {
-    delete m_RootItem;
+    CItem::DeleteTreeAsync(m_RootItem);
     _theDocument = nullptr;
 }
 
@@ -175,10 +181,26 @@ void CDirStatDoc::DeleteContents()
 
     // Wait for system to fully shutdown
     StopScanningEngine();
+    m_Watcher.Stop();
+    m_WatchedSinceScan = false;
 
-    // Cleanup structures
-    delete m_RootItemDupe;
-    delete m_RootItem;
+    // Apply queued tree changes while their items still exist
+    if (CMainFrame::Get() != nullptr) CMainFrame::Get()->ProcessUiEvents();
+
+    // Items must be hidden before their arena goes away; the duplicate list
+    // also drops its trackers since they point into both trees
+    if (CFileTreeControl::Get() != nullptr && IsWindow(CFileTreeControl::Get()->m_hWnd))
+    {
+        CFileTreeControl::Get()->SetRootItem(nullptr);
+    }
+    if (CFileDupeControl::Get() != nullptr && IsWindow(CFileDupeControl::Get()->m_hWnd))
+    {
+        CFileDupeControl::Get()->SetRootItem(nullptr);
+    }
+
+    // Cleanup structures; large trees take a while to free so this is
+    // left to the background once nothing refers to them any longer
+    CItem::DeleteTreeAsync(m_RootItem, m_RootItemDupe);
     m_RootItemDupe = nullptr;
     m_RootItem = nullptr;
     m_ZoomItem = nullptr;
@@ -233,12 +255,14 @@ BOOL CDirStatDoc::OnOpenDocument(LPCWSTR lpszPathName)
 
     std::vector<CItem*> driveItems;
 
+    // Every tree gets an arena of its own so it can be released at once
+    CItemArena* arena = CItemArena::Create();
     if (m_ShowMyComputer)
     {
-        m_RootItem = new CItem(IT_MYCOMPUTER | ITF_ROOTITEM, Localization::Lookup(IDS_MYCOMPUTER));
+        m_RootItem = new (arena) CItem(IT_MYCOMPUTER | ITF_ROOTITEM, Localization::Lookup(IDS_MYCOMPUTER));
         for (const auto & rootFolder : rootFolders)
         {
-            const auto drive = new CItem(IT_DRIVE, rootFolder);
+            const auto drive = new (arena) CItem(IT_DRIVE, rootFolder);
             driveItems.emplace_back(drive);
             m_RootItem->AddChild(drive);
         }
@@ -246,7 +270,7 @@ BOOL CDirStatDoc::OnOpenDocument(LPCWSTR lpszPathName)
     else
     {
         const ITEMTYPE type = IsDrive(rootFolders[0]) ? IT_DRIVE : IT_DIRECTORY;
-        m_RootItem = new CItem(type | ITF_ROOTITEM, rootFolders[0]);
+        m_RootItem = new (arena) CItem(type | ITF_ROOTITEM, rootFolders[0]);
         if (m_RootItem->IsType(IT_DRIVE))
         {
             driveItems.emplace_back(m_RootItem);
@@ -304,11 +328,11 @@ void CDirStatDoc::SetTitlePrefix(const std::wstring& prefix) const
     CMainFrame::Get()->UpdateFrameTitleForDocument(docName.empty() ? nullptr : docName.c_str());
 }
 
-COLORREF CDirStatDoc::GetCushionColor(const std::wstring & ext)
+COLORREF CDirStatDoc::GetCushionColor(const EXTENSIONID ext)
 {
-    const auto& record = GetExtensionData()->find(ext);
-    VERIFY(record != GetExtensionData()->end());
-    return record->second.color;
+    const CExtensionData* data = GetExtensionData();
+    ASSERT(ext < data->size());
+    return ext < data->size() ? (*data)[ext].color : RGB(0, 0, 0);
 }
 
 COLORREF CDirStatDoc::GetZoomColor()
@@ -332,6 +356,17 @@ ULONGLONG CDirStatDoc::GetRootSize() const
     return m_RootItem->GetSizePhysical();
 }
 
+// Called from the message thread which owns the views and the duplicate nodes
+CMemoryUsage CDirStatDoc::GetMemoryUsage() const
+{
+    CMemoryUsage usage = CMemoryUsage::Collect(m_RootItem);
+    usage.Add(CMemoryUsage::PART_EXTENSIONS, m_ExtensionData.capacity() * sizeof(SExtensionRecord));
+    if (CFileTreeControl::Get() != nullptr) usage.Add(CMemoryUsage::PART_VISIBLE, CFileTreeControl::Get()->GetVisibleInfoBytes());
+    if (CFileDupeControl::Get() != nullptr) usage.Add(CMemoryUsage::PART_VISIBLE, CFileDupeControl::Get()->GetVisibleInfoBytes());
+    if (m_RootItemDupe != nullptr) usage.Add(CMemoryUsage::PART_DUPES, m_RootItemDupe->GetBytesUsed());
+    return usage;
+}
+
 bool CDirStatDoc::IsDrive(const std::wstring& spec)
 {
     return 3 == spec.size() && wds::chrColon == spec[1] && wds::chrBackslash == spec[2];
@@ -383,6 +418,7 @@ bool CDirStatDoc::IsZoomed() const
 void CDirStatDoc::SetHighlightExtension(const std::wstring & ext)
 {
     m_HighlightExtension = ext;
+    m_HighlightExtensionId = CExtensionRegistry::Find(ext);
     CMainFrame::Get()->SetSelectionMessageText();
 }
 
@@ -391,6 +427,11 @@ std::wstring CDirStatDoc::GetHighlightExtension()
     return m_HighlightExtension;
 }
 
+EXTENSIONID CDirStatDoc::GetHighlightExtensionId() const
+{
+    return m_HighlightExtensionId;
+}
+
 // The very root has been deleted.
 //
 void CDirStatDoc::UnlinkRoot()
@@ -524,43 +565,34 @@ void CDirStatDoc::RebuildExtensionData()
 {
     CWaitCursor wc;
 
-    m_ExtensionData.clear();
+    m_ExtensionData.assign(CExtensionRegistry::GetCount(), {});
     if (IsRootDone())
     {
         m_RootItem->CollectExtensionData(&m_ExtensionData);
     }
     
-    std::vector<std::wstring> sortedExtensions;
+    std::vector<EXTENSIONID> sortedExtensions;
     SortExtensionData(sortedExtensions);
     SetExtensionColors(sortedExtensions);
 
     m_ExtensionDataValid = true;
 }
 
-void CDirStatDoc::SortExtensionData(std::vector<std::wstring>& sortedExtensions)
+void CDirStatDoc::SortExtensionData(std::vector<EXTENSIONID>& sortedExtensions) const
 {
-    sortedExtensions.resize(m_ExtensionData.size());
-
-    for (int i = 0; const auto& ext : m_ExtensionData | std::views::keys)
+    sortedExtensions.clear();
+    for (EXTENSIONID ext = 0; ext < m_ExtensionData.size(); ext++)
     {
-        sortedExtensions[i++] = ext;
+        if (m_ExtensionData[ext].files > 0) sortedExtensions.push_back(ext);
     }
 
-    _pqsortExtensionData = &m_ExtensionData;
-    qsort(sortedExtensions.data(), sortedExtensions.size(), sizeof(std::wstring), [](const LPCVOID item1, const LPCVOID item2)
+    std::ranges::sort(sortedExtensions, [this](const EXTENSIONID ext1, const EXTENSIONID ext2)
     {
-        const std::wstring &ext1 = *static_cast<const std::wstring*>(item1);
-        const std::wstring &ext2 = *static_cast<const std::wstring*>(item2);
-        const auto& r1 = _pqsortExtensionData->find(ext1);
-        const auto& r2 = _pqsortExtensionData->find(ext2);
-        ASSERT(r1 != _pqsortExtensionData->end());
-        ASSERT(r2 != _pqsortExtensionData->end());
-        return usignum(r2->second.bytes, r1->second.bytes);
+        return m_ExtensionData[ext1].bytes > m_ExtensionData[ext2].bytes;
     });
-    _pqsortExtensionData = nullptr;
 }
 
-void CDirStatDoc::SetExtensionColors(const std::vector<std::wstring>& sortedExtensions)
+void CDirStatDoc::SetExtensionColors(const std::vector<EXTENSIONID>& sortedExtensions)
 {
     static std::vector<COLORREF> colors;
 
@@ -580,8 +612,6 @@ void CDirStatDoc::SetExtensionColors(const std::vector<std::wstring>& sortedExte
     }
 }
 
-CExtensionData* CDirStatDoc::_pqsortExtensionData;
-
 // Deletes a file or directory via SHFileOperation.
 // Return: false, if canceled
 //
@@ -725,7 +755,7 @@ void CDirStatDoc::RecursiveUserDefinedCleanup(USERDEFINEDCLEANUP* udc, const std
         {
             continue;
         }
-        if (!CDirStatApp::Get()->IsFollowingAllowed(finder.GetFilePathLong(), finder.GetAttributes()))
+        if (!CDirStatApp::Get()->IsFollowingAllowed(finder))
         {
             continue;
         }
@@ -957,12 +987,12 @@ END_MESSAGE_MAP()
 
 void CDirStatDoc::OnRefreshSelected()
 {
-    RefreshItem(GetAllSelected());
+    RefreshChanged(GetAllSelected());
 }
 
 void CDirStatDoc::OnRefreshAll()
 {
-    RefreshItem(GetRootItem());
+    RefreshChanged({ GetRootItem() });
 }
 
 void CDirStatDoc::OnSaveResults()
@@ -980,13 +1010,16 @@ void CDirStatDoc::OnSaveResults()
 void CDirStatDoc::OnLoadResults()
 {
     // Request the file path from the user
-    std::wstring fileSelectString = std::format(L"{} (*.csv)|*.csv|{} (*.*)|*.*||",
-        Localization::Lookup(IDS_CSV_FILES), Localization::Lookup(IDS_ALL_FILES));
+    std::wstring fileSelectString = std::format(L"{} (*.csv)|*.csv|{} (*.img;*.vhd)|*.img;*.vhd|{} (*.*)|*.*||",
+        Localization::Lookup(IDS_CSV_FILES), Localization::Lookup(IDS_DISK_IMAGE_FILES), Localization::Lookup(IDS_ALL_FILES));
     CFileDialog dlg(TRUE, L"csv", nullptr, OFN_EXPLORER | OFN_DONTADDTORECENT | OFN_PATHMUSTEXIST, fileSelectString.c_str());
     if (dlg.DoModal() != IDOK) return;
 
+    // Disk images are read directly from their master file table
     CWaitCursor wc;
-    CItem* newroot = LoadResults(dlg.GetPathName().GetString());
+    const std::wstring path = dlg.GetPathName().GetString();
+    const std::wstring ext = dlg.GetFileExt().MakeLower().GetString();
+    CItem* newroot = ext == L"img" || ext == L"vhd" ? LoadMftImage(path) : LoadResults(path);
     GetDocument()->OnOpenDocument(newroot);
 }
 
@@ -1294,6 +1327,7 @@ void CDirStatDoc::OnScanSuspend()
     // Wait for system to fully shutdown
     for (auto& queue : m_queues | std::views::values)
         ProcessMessagesUntilSignaled([&queue] { queue.SuspendExecution(); });
+    ProcessMessagesUntilSignaled([this] { m_sizeQueue.SuspendExecution(); });
 
     // Mark as suspended
     if (CMainFrame::Get() != nullptr)
@@ -1304,6 +1338,7 @@ void CDirStatDoc::OnScanResume()
 {
     for (auto& queue : m_queues | std::views::values)
         queue.ResumeExecution();
+    m_sizeQueue.ResumeExecution();
 
     if (CMainFrame::Get() != nullptr)
         CMainFrame::Get()->SuspendState(false);
@@ -1314,6 +1349,7 @@ void CDirStatDoc::OnScanStop()
     // Stop m_queues from executing
     for (auto& queue : m_queues | std::views::values)
         ProcessMessagesUntilSignaled([&queue] { queue.CancelExecution(); });
+    ProcessMessagesUntilSignaled([this] { m_sizeQueue.CancelExecution(); });
 
     // Wait for wrapper thread to complete
     if (m_thread != nullptr)
@@ -1323,6 +1359,7 @@ void CDirStatDoc::OnScanStop()
         delete m_thread;
         m_thread = nullptr;
         m_queues.clear();
+        m_throttles.clear();
     }
 
     OnScanResume();
@@ -1333,6 +1370,274 @@ void CDirStatDoc::StopScanningEngine()
     OnScanStop();
 }
 
+void CDirStatDoc::AdaptScanConcurrency(const std::stop_token& stop, const std::unordered_map<std::wstring, std::vector<CItem*>>& volumeItems)
+{
+    constexpr auto interval = std::chrono::milliseconds(250);
+    constexpr auto sampleInterval = std::chrono::seconds(1);
+
+    // All volumes draw their workers from one budget; finished volumes end
+    // their threads and hand their share to the ones that still have folders
+    // outstanding, which start further threads while the budget allows
+    const bool adaptive = COptions::AdaptiveScanningThreads;
+    const unsigned int perVolume = adaptive ? CAdaptiveConcurrency::MAXIMUM_WORKERS :
+        static_cast<unsigned int>(COptions::ScanningThreads);
+    const CScanScheduler scheduler(CScanScheduler::DefaultBudget(COptions::ScanningThreads));
+
+    std::vector<std::pair<const std::wstring*, BlockingQueue<SCANJOB>*>> volumes;
+    std::vector<CAdaptiveConcurrency> controllers;
+    std::vector<bool> retired;
+    for (auto& [volume, queue] : m_queues)
+    {
+        volumes.emplace_back(&volume, &queue);
+        controllers.emplace_back(queue.GetActiveWorkers());
+        retired.push_back(false);
+    }
+
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+    auto last = std::chrono::steady_clock::now();
+    while (!stop.stop_requested())
+    {
+        // Sleep until the next round is due or the scan completes
+        {
+            std::unique_lock lock(mutex);
+            if (wakeup.wait_for(lock, stop, interval, [] { return false; }) || stop.stop_requested()) return;
+        }
+
+        // Weigh each volume by its outstanding read jobs, which covers the
+        // folders still waiting as well as the ones being read right now
+        std::vector<CScanScheduler::DEMAND> demands;
+        for (const auto& volume : volumes | std::views::keys)
+        {
+            ULONGLONG jobs = 0;
+            if (const auto items = volumeItems.find(*volume); items != volumeItems.end())
+            {
+                for (const auto& item : items->second) jobs += item->GetReadJobs();
+            }
+            demands.push_back({ jobs, perVolume });
+        }
+        const auto shares = scheduler.Distribute(demands);
+
+        unsigned int threads = 0;
+        for (const auto& queue : volumes | std::views::values) threads += queue->GetThreadCount();
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool sample = adaptive && now - last >= sampleInterval;
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        if (sample) last = now;
+
+        bool changed = false;
+        for (size_t i = 0; i < volumes.size(); i++)
+        {
+            // Nothing is queued on a finished volume any longer so its threads can end
+            const auto& [volume, queue] = volumes[i];
+            if (demands[i].m_Weight == 0)
+            {
+                if (!retired[i] && queue->GetPendingCount() == 0)
+                {
+                    queue->Retire();
+                    retired[i] = true;
+                }
+                continue;
+            }
+
+            // Suspended intervals say nothing about the volume
+            auto& controller = controllers[i];
+            if (queue->IsSuspended())
+            {
+                controller.Rebase(queue->GetCompletedCount(), queue->GetWaitTime());
+                continue;
+            }
+
+            // Within its share a volume is tuned by its own throughput
+            unsigned int limit = std::min(perVolume, shares[i]);
+            if (adaptive)
+            {
+                controller.SetMaximum(shares[i]);
+                limit = sample ? controller.Update(queue->GetCompletedCount(), queue->GetWaitTime(), elapsed) :
+                    controller.GetLimit();
+            }
+
+            // Threads are only started as needed so that all volumes together
+            // never run more than the budget
+            if (const unsigned int count = queue->GetThreadCount(); limit > count && threads < scheduler.GetBudget())
+            {
+                threads += queue->AddThreads(std::min(limit - count, scheduler.GetBudget() - threads));
+            }
+
+            const unsigned int previous = queue->GetActiveWorkers();
+            limit = std::clamp(limit, 1u, std::max(1u, queue->GetThreadCount()));
+            if (limit == previous) continue;
+
+            queue->SetActiveWorkers(limit);
+            VTRACE(L"Scan concurrency for {} changed from {} to {} (share {} of {})",
+                *volume, previous, limit, shares[i], scheduler.GetBudget());
+            changed = true;
+        }
+
+        if (changed) ReportScanConcurrency();
+    }
+}
+
+void CDirStatDoc::ReportScanConcurrency()
+{
+    // Show a plain count for a single volume and a per-volume list otherwise
+    std::wstring text;
+    for (const auto& [volume, queue] : m_queues)
+    {
+        if (!text.empty()) text += L", ";
+        text += m_queues.size() == 1 ? std::to_wstring(queue.GetActiveWorkers()) :
+            volume + L" " + std::to_wstring(queue.GetActiveWorkers());
+    }
+
+    if (text.empty()) return;
+    CMainFrame::Get()->InvokeInMessageThread([text]
+    {
+        CMainFrame::Get()->SetScanThreadsText(text);
+    });
+}
+
+void CDirStatDoc::StartWatching()
+{
+    if (!COptions::WatchForChanges || !HasRootItem())
+    {
+        m_Watcher.Stop();
+        m_WatchedSinceScan = false;
+        return;
+    }
+    if (m_Watcher.IsWatching()) return;
+
+    // Changes made before now were not seen; only a full scan catches up
+    m_WatchedSinceScan = false;
+
+    std::vector<std::wstring> roots;
+    for (const auto& item : m_RootItem->IsType(IT_MYCOMPUTER) ? m_RootItem->GetChildren() : std::span<CItem* const>(&m_RootItem, 1))
+    {
+        roots.push_back(item->GetPath());
+    }
+    m_Watcher.Start(roots);
+}
+
+// Applies coalesced change notifications to the finished tree. Each changed
+// folder only has its direct children reconciled while folders that lost
+// events are rescanned; both are left to the scanning engine so that the
+// message thread never waits on the disk.
+void CDirStatDoc::ApplyWatchedChanges()
+{
+    if (!m_Watcher.IsWatching()) return;
+    if (!COptions::WatchForChanges)
+    {
+        m_Watcher.Stop();
+        m_WatchedSinceScan = false;
+        return;
+    }
+
+    const auto changes = m_Watcher.TakeChanges();
+    if (changes.empty()) return;
+
+    // Hold changes back while a scan may still be modifying the same items
+    if (!IsRootDone())
+    {
+        m_Watcher.RestoreChanges(changes);
+        return;
+    }
+
+    std::vector<CItem*> rescan;
+    std::vector<CItem*> reconcile;
+    SplitChanges(changes, rescan, reconcile);
+    if (rescan.empty() && reconcile.empty()) return;
+
+    StartScanningEngine(rescan, reconcile);
+}
+
+// Sorts changed folders into those to rescan as a whole and those that only
+// need their direct children reconciled, leaving out what a rescan covers
+void CDirStatDoc::SplitChanges(const DirectoryWatcherBase::CHANGES& changes,
+    std::vector<CItem*>& rescan, std::vector<CItem*>& reconcile) const
+{
+    for (const auto& [folder, recursive] : changes)
+    {
+        // Folders that are not part of the tree are picked up through their parent
+        CItem* item = FindItemByPath(folder);
+        if (item == nullptr || !item->IsType(IT_DIRECTORY | IT_DRIVE)) continue;
+        (recursive ? rescan : reconcile).push_back(item);
+    }
+
+    // Only scan the outermost folders since a scan covers the whole subtree
+    // and also replaces whatever reconciling would have done inside it
+    const auto isCovered = [rescan](const CItem* item)
+    {
+        return std::ranges::any_of(rescan, [item](const CItem* other) { return other->IsAncestorOf(item); });
+    };
+    std::erase_if(reconcile, isCovered);
+    std::erase_if(rescan, [rescan](const CItem* item)
+    {
+        return std::ranges::any_of(rescan, [item](const CItem* other)
+            { return other != item && other->IsAncestorOf(item); });
+    });
+}
+
+// Refreshes what the user asked for. If items are reused and the watcher has
+// seen every change since the whole tree was read, the folders it reported
+// are all that can differ from the disk; only those are read again instead
+// of enumerating every folder below the items. Pending changes outside the
+// items are applied along with them since they are due anyway.
+void CDirStatDoc::RefreshChanged(const std::vector<CItem*>& items)
+{
+    if (!COptions::ReuseItemsOnRescan || !m_WatchedSinceScan || !m_Watcher.IsComplete() || !IsRootDone())
+    {
+        RefreshItem(items);
+        return;
+    }
+
+    // Modifying a file in place only reports its folder, so files asked
+    // for are still looked at on their own
+    std::vector<CItem*> rescan;
+    std::ranges::copy_if(items, std::back_inserter(rescan), [](const CItem* item) { return item->IsType(IT_FILE); });
+    std::vector<CItem*> reconcile;
+    SplitChanges(m_Watcher.TakeAllChanges(), rescan, reconcile);
+    VTRACE(L"Refreshing {} changed folders and {} items", reconcile.size(), rescan.size());
+    if (rescan.empty() && reconcile.empty()) return;
+
+    StartScanningEngine(rescan, reconcile);
+}
+
+CItem* CDirStatDoc::FindItemByPath(const std::wstring& path) const
+{
+    if (!HasRootItem()) return nullptr;
+
+    for (const auto& root : m_RootItem->IsType(IT_MYCOMPUTER) ? m_RootItem->GetChildren() : std::span<CItem* const>(&m_RootItem, 1))
+    {
+        const auto relative = DirectoryWatcherBase::GetRelativePath(root->GetPath(), path, L'\\');
+        if (!relative.has_value()) continue;
+
+        // Descend one name at a time instead of building the path of every child
+        CItem* item = root;
+        for (const auto segment : *relative | std::views::split(L'\\'))
+        {
+            const std::wstring_view name(segment.begin(), segment.end());
+            if (name.empty()) continue;
+
+            CItem* next = nullptr;
+            for (const auto& child : item->GetChildren())
+            {
+                if (child->IsType(IT_FREESPACE | IT_UNKNOWN)) continue;
+                const std::wstring_view childName = child->GetNameView();
+                if (childName.size() == name.size() &&
+                    _wcsnicmp(childName.data(), name.data(), name.size()) == 0)
+                {
+                    next = child;
+                    break;
+                }
+            }
+            if (next == nullptr) return nullptr;
+            item = next;
+        }
+        return item;
+    }
+    return nullptr;
+}
+
 void CDirStatDoc::OnContextMenuExplore(UINT nID)
 {
     // get list of paths from items
@@ -1361,11 +1666,21 @@ void CDirStatDoc::OnContextMenuExplore(UINT nID)
     contextMenu->InvokeCommand(reinterpret_cast<LPCMINVOKECOMMANDINFO>(&info));
 }
 
-void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
+void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items, std::vector<CItem*> reconcile)
 {
     // Stop any previous executions
     StopScanningEngine();
 
+    // Folders to reconcile count as being scanned until the engine is done
+    // with them so that further changes are held back meanwhile
+    for (const auto& item : reconcile) item->UpwardSetUndone();
+
+    // Changes made while the tree is read are held back and applied once the
+    // scan is done, so watching starts before the first folder is read and a
+    // full scan under a complete watcher accounts for every change from here
+    StartWatching();
+    if (std::ranges::find(items, m_RootItem) != items.end()) m_WatchedSinceScan = m_Watcher.IsComplete();
+
     // Address currently zoomed / selected item conflicts
     const auto zoomItem = GetZoomItem();
     for (const auto& item : std::vector(items))
@@ -1391,7 +1706,7 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
 
     // Start a thread so we do not hang the message loop
     // Lambda captures assume document exists for duration of thread
-    m_thread = new std::thread([this,items] () mutable
+    m_thread = new std::thread([this,items,reconcile] () mutable
     {
         // Wait for other threads to finish if this was scheduled in parallel
         static std::shared_mutex mutex;
@@ -1401,16 +1716,25 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
         if (items.size() == 1 && items.at(0)->IsType(IT_MYCOMPUTER))
         {
             items.at(0)->ResetScanStartTime();
-            items = items.at(0)->GetChildren();
+            const auto drives = items.at(0)->GetChildren();
+            items.assign(drives.begin(), drives.end());
         }
 
+        // Rescans may keep the existing items so unchanged entries (and any
+        // duplicate hashes computed for them) can be reused; every folder
+        // passed here is still read again since its timestamp does not
+        // reflect changes to files inside it or anything further down.
+        // Refreshes skip the folders that the watcher vouches for before
+        // getting here (see RefreshChanged).
+        const bool reuse = COptions::ReuseItemsOnRescan;
+
         const auto selectedItems = GetAllSelected();
         using VisualInfo = struct { bool wasExpanded; bool isSelected; int oldScrollPosition; };
         std::unordered_map<CItem *,VisualInfo> visualInfo;
         for (auto item : std::vector(items))
         {
             // Clear items from duplicate list;
-            CFileDupeControl::Get()->RemoveItem(item);
+            if (!reuse || item->IsType(IT_FILE)) CFileDupeControl::Get()->RemoveItem(item);
 
             // Record current visual arrangement to reapply afterward
             if (item->IsVisible())
@@ -1426,7 +1750,8 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
             item->UpwardSubtractSizeLogical(item->GetSizeLogical());
             item->UpwardSubtractFiles(item->GetFilesCount());
             item->UpwardSubtractFolders(item->GetFoldersCount());
-            item->RemoveAllChildren();
+            if (reuse && !item->IsType(IT_FILE)) item->RecurseResetTotals();
+            else item->RemoveAllChildren();
             item->UpwardSetUndone();
 
             // children removal will collapse item so re-expand it
@@ -1456,11 +1781,33 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
                 // Handle non-root item by removing from parent
                 item->UpwardSubtractFiles(item->IsType(IT_FILE) ? 1 : 0);
                 item->UpwardSubtractFolders(item->IsType(IT_FILE) ? 0 : 1);
+                if (reuse) CFileDupeControl::Get()->RemoveItem(item);
                 item->GetParent()->RemoveChild(item);
             }
         }
 
+        // Reconcile the direct children of changed folders; deeper folders go
+        // first since reconciling a parent may remove them from the tree
+        const auto depth = [](const CItem* item)
+        {
+            int levels = 0;
+            for (auto p = item->GetParent(); p != nullptr; p = p->GetParent()) levels++;
+            return levels;
+        };
+        std::ranges::sort(reconcile, std::greater(), depth);
+        for (const auto& item : reconcile)
+        {
+            // New folders found here still have to be scanned as a whole
+            std::ranges::copy(item->UpdateChildrenFromDisk(), std::back_inserter(items));
+        }
+        std::erase_if(reconcile, [all = reconcile](const CItem* item)
+        {
+            return std::ranges::any_of(all, [item](const CItem* other)
+                { return other != item && other->IsAncestorOf(item); });
+        });
+
         // Add items to processing queue
+        std::unordered_map<std::wstring, std::vector<CItem*>> volumeItems;
         for (const auto & item : items)
         {
             // Skip any items we should not follow
@@ -1472,6 +1819,14 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
             item->UpwardAddReadJobs(1);
             item->UpwardSetUndone();
 
+            // Whole NTFS volumes can be read from the MFT in a single pass
+            if (COptions::UseMftScanning && item->IsType(IT_DRIVE) &&
+                LoadFromMft(item, GetVolumeDevicePath(item->GetPath())))
+            {
+                item->UpwardSubtractReadJobs(1);
+                continue;
+            }
+
             // Create status progress bar
             CMainFrame::Get()->InvokeInMessageThread([]
             {
@@ -1484,23 +1839,59 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
                 pathName.data(), static_cast<DWORD>(pathName.size())) != 0)
             {
                 m_queues[pathName.data()].Push(item);
+                volumeItems[pathName.data()].push_back(item);
             }
             else ASSERT(FALSE);
         }
 
-        // Create subordinate threads if there is work to do
-        for (auto& queue : m_queues | std::views::values)
+        // Physical sizes that enumeration cannot provide are looked up by a
+        // separate pool so the extra round trips stay out of the scan loop
+        m_sizeQueue.StartThreads(COptions::ScanningThreads, [this]()
         {
-            queue.StartThreads(COptions::ScanningThreads, [&queue]()
+            CItem::ScanSizesPhysical(&m_sizeQueue);
+        });
+
+        // Create subordinate threads if there is work to do; each queue starts
+        // with its share of the global budget and may grow up to what a single
+        // volume is allowed to use once other volumes have ended their threads.
+        // Every volume needs at least one thread even if there are more
+        // volumes than the budget.
+        const bool adaptive = COptions::AdaptiveScanningThreads;
+        const unsigned int budget = CScanScheduler::DefaultBudget(COptions::ScanningThreads);
+        const unsigned int share = std::max(1u, budget / static_cast<unsigned int>(std::max<size_t>(1, m_queues.size())));
+        const unsigned int capacity = std::min(budget, adaptive ? CAdaptiveConcurrency::MAXIMUM_WORKERS :
+            static_cast<unsigned int>(COptions::ScanningThreads));
+        for (auto& [volume, queue] : m_queues)
+        {
+            auto& throttle = m_throttles[volume];
+            queue.StartThreads(std::min(share, capacity), [this, &queue, &throttle]()
             {
-                CItem::ScanItems(&queue);
-            });
+                CItem::ScanItems(&queue, &m_sizeQueue, &throttle);
+            }, capacity);
         }
+        ReportScanConcurrency();
+
+        // Balance and tune the number of active workers per volume while scanning
+        std::jthread controller([this, &volumeItems](const std::stop_token& stop)
+        {
+            AdaptScanConcurrency(stop, volumeItems);
+        });
 
         // Wait for all threads to run out of work
         bool do_completion = true;
         for (auto& queue : m_queues | std::views::values)
             do_completion &= queue.WaitForCompletionOrCancellation();
+        if (do_completion && m_sizeQueue.HasStarted())
+        {
+            // Enumeration has stopped feeding the size lookups at this point
+            do_completion &= m_sizeQueue.WaitForCompletionOrCancellation();
+            VTRACE(L"Physical sizes looked up separately: {}", m_sizeQueue.GetCompletedCount());
+        }
+        if (controller.joinable())
+        {
+            controller.request_stop();
+            controller.join();
+        }
         if (!do_completion)
         {
             // Sorting and other finalization tasks
@@ -1534,11 +1925,19 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
         // Sorting and other finalization tasks
         CItem::ScanItemsFinalize(GetRootItem());
 
+        const CItemArena* arena = CItemArena::Of(GetRootItem());
+        VTRACE(L"Name memory: {} bytes stored, {} bytes shared", arena->GetNameBytes(), arena->GetNameBytesShared());
+
         // Invoke a UI thread to do updates
-        CMainFrame::Get()->InvokeInMessageThread([&items,&visualInfo]
+        CMainFrame::Get()->InvokeInMessageThread([&items,&reconcile,&visualInfo]
         {
+            for (const auto& item : reconcile) item->RecurseFreeze();
             for (const auto& item : items)
             {
+                // Compact what has been scanned; only done here since
+                // the views read the children without taking a lock
+                item->RecurseFreeze();
+
                 // restore scroll position if previously set
                 if (visualInfo.contains(item) && item->IsVisible())
                     item->SetScrollPosition(visualInfo[item].oldScrollPosition);
@@ -1547,11 +1946,23 @@ void CDirStatDoc::StartScanningEngine(std::vector<CItem*> items)
             CMainFrame::Get()->LockWindowUpdate();
             GetDocument()->RebuildExtensionData();
             GetDocument()->UpdateAllViews(nullptr);
+
+            const CMemoryUsage usage = GetDocument()->GetMemoryUsage();
+            VTRACE(L"Scan memory: {} bytes for {} items ({} bytes per item)",
+                usage.GetTotal(), usage.GetItemCount(), usage.GetTotalPerItem());
+            for (int part = 0; part < CMemoryUsage::PART_COUNT; part++)
+            {
+                const auto id = static_cast<CMemoryUsage::PART>(part);
+                VTRACE(L"  {}: {} bytes ({} bytes per item)", CMemoryUsage::GetPartName(id),
+                    usage.GetBytes(id), usage.GetBytesPerItem(id));
+            }
+
             CMainFrame::Get()->SetProgressComplete();
             CMainFrame::Get()->RestoreExtensionView();
             CMainFrame::Get()->RestoreTreeMapView();
             CMainFrame::Get()->GetTreeMapView()->SuspendRecalculationDrawing(false);
             CMainFrame::Get()-> UnlockWindowUpdate();
+            GetDocument()->StartWatching();
         });
     });
 }
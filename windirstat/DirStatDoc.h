@@ -23,11 +23,17 @@
 
 #include "SelectDrivesDlg.h"
 #include "BlockingQueue.h"
+#include "ScanJob.h"
+#include "DirectoryWatcher.h"
+#include "TokenBucket.h"
 #include "Options.h"
 #include "CommonHelpers.h"
+#include "ExtensionRegistry.h"
+#include "MemoryUsage.h"
 
 #include <unordered_map>
 #include <vector>
+#include <stop_token>
 
 class CItem;
 class CItemDupe;
@@ -51,9 +57,10 @@ struct SExtensionRecord
 };
 
 //
-// Maps an extension (".bmp") to an SExtensionRecord.
+// SExtensionRecords indexed by the id of their extension (".bmp").
+// Extensions not present in the tree have no files.
 //
-using CExtensionData = std::unordered_map<std::wstring, SExtensionRecord>;
+using CExtensionData = std::vector<SExtensionRecord>;
 
 //
 // Hints for UpdateAllViews()
@@ -97,11 +104,12 @@ protected:
     void SetPathName(LPCWSTR lpszPathName, BOOL bAddToMRU) override;
     void SetTitlePrefix(const std::wstring& prefix) const;
 
-    COLORREF GetCushionColor(const std::wstring& ext);
+    COLORREF GetCushionColor(EXTENSIONID ext);
     COLORREF GetZoomColor();
 
     const CExtensionData* GetExtensionData();
     ULONGLONG GetRootSize() const;
+    CMemoryUsage GetMemoryUsage() const;
 
     static bool IsDrive(const std::wstring& spec);
     void RefreshReparsePointItems();
@@ -115,11 +123,19 @@ protected:
 
     void SetHighlightExtension(const std::wstring& ext);
     std::wstring GetHighlightExtension();
+    EXTENSIONID GetHighlightExtensionId() const;
 
     void UnlinkRoot();
     bool UserDefinedCleanupWorksForItem(USERDEFINEDCLEANUP* udc, const CItem* item);
-    void StartScanningEngine(std::vector<CItem*> items);
+    void StartScanningEngine(std::vector<CItem*> items, std::vector<CItem*> reconcile = {});
     void StopScanningEngine();
+    void AdaptScanConcurrency(const std::stop_token& stop, const std::unordered_map<std::wstring, std::vector<CItem*>>& volumeItems);
+    void ReportScanConcurrency();
+    void StartWatching();
+    void ApplyWatchedChanges();
+    void SplitChanges(const DirectoryWatcherBase::CHANGES& changes, std::vector<CItem*>& rescan, std::vector<CItem*>& reconcile) const;
+    void RefreshChanged(const std::vector<CItem*>& items);
+    CItem* FindItemByPath(const std::wstring& path) const;
     void RefreshItem(const std::vector<CItem*>& item);
     void RefreshItem(CItem* item) { RefreshItem(std::vector{ item }); }
 
@@ -129,9 +145,8 @@ protected:
     std::vector<CItem*> GetDriveItems() const;
     void RefreshRecyclers() const;
     void RebuildExtensionData();
-    void SortExtensionData(std::vector<std::wstring>& sortedExtensions);
-    void SetExtensionColors(const std::vector<std::wstring>& sortedExtensions);
-    static CExtensionData* _pqsortExtensionData;
+    void SortExtensionData(std::vector<EXTENSIONID>& sortedExtensions) const;
+    void SetExtensionColors(const std::vector<EXTENSIONID>& sortedExtensions);
     bool DeletePhysicalItems(const std::vector<CItem*>& items, bool toTrashBin);
     void SetZoomItem(CItem* item);
     static void AskForConfirmation(USERDEFINEDCLEANUP* udc, const CItem* item);
@@ -161,6 +176,7 @@ protected:
     CItemDupe* m_RootItemDupe = nullptr; // The very root dup item
 
     std::wstring m_HighlightExtension; // Currently highlighted extension
+    EXTENSIONID m_HighlightExtensionId = CExtensionRegistry::INVALID;
     CItem* m_ZoomItem = nullptr;   // Current "zoom root"
 
     bool m_ExtensionDataValid = false; // If this is false, m_ExtensionData must be rebuilt
@@ -168,8 +184,12 @@ protected:
 
     CList<CItem*, CItem*> m_ReselectChildStack; // Stack for the "Re-select Child"-Feature
 
-    std::unordered_map<std::wstring, BlockingQueue<CItem*>> m_queues; // The scanning and thread queue
+    std::unordered_map<std::wstring, BlockingQueue<SCANJOB>> m_queues; // The scanning and thread queue
+    std::unordered_map<std::wstring, SCANTHROTTLE> m_throttles;       // I/O rate limits per volume
+    BlockingQueue<CItem*> m_sizeQueue; // Files whose physical size could not be read while enumerating
     std::thread* m_thread = nullptr; // Wrapper thread so we do not occupy the UI thread
+    DirectoryWatcher m_Watcher;      // Change notifications used to keep finished results current
+    bool m_WatchedSinceScan = false; // Watcher was complete since before the whole tree was last read
 
     DECLARE_MESSAGE_MAP()
     afx_msg void OnRefreshSelected();
@@ -0,0 +1,171 @@
+// DirectoryWatcher.cpp - Implementation of DirectoryWatcher
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdafx.h>
+
+#include "DirectoryWatcher.h"
+#include "FileFind.h"
+#include <common/Tracer.h>
+
+// Drive roots end in a backslash while folder roots do not
+static_assert(DirectoryWatcherBase::JoinPath(L"C:\\", L"Users", L'\\') == L"C:\\Users");
+static_assert(DirectoryWatcherBase::JoinPath(L"C:\\Data", L"Users", L'\\') == L"C:\\Data\\Users");
+static_assert(DirectoryWatcherBase::GetRelativePath(L"C:\\", L"C:\\", L'\\') == L"");
+static_assert(DirectoryWatcherBase::GetRelativePath(L"C:\\", L"C:\\Users\\Public", L'\\') == L"Users\\Public");
+static_assert(DirectoryWatcherBase::GetRelativePath(L"C:\\Data", L"C:\\Data\\Users", L'\\') == L"Users");
+static_assert(!DirectoryWatcherBase::GetRelativePath(L"C:\\Data", L"C:\\Database", L'\\').has_value());
+static_assert(!DirectoryWatcherBase::GetRelativePath(L"D:\\", L"C:\\Users", L'\\').has_value());
+
+DirectoryWatcherNt::~DirectoryWatcherNt()
+{
+    Stop();
+}
+
+bool DirectoryWatcherNt::Start(const std::vector<std::wstring>& roots)
+{
+    Stop();
+
+    SetComplete(true);
+    for (const auto& root : roots)
+    {
+        // Drive roots must keep their trailing backslash to open the directory
+        const std::wstring path = root.ends_with(L':') ? root + L"\\" : root;
+        const HANDLE handle = CreateFile(FileFindEnhanced::MakeLongPathCompatible(path).c_str(),
+            FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            VTRACE(L"Cannot watch for changes: {} ({})", root, GetLastError());
+            SetComplete(false);
+            continue;
+        }
+
+        auto watch = std::make_unique<WATCH>();
+        watch->m_Root = root;
+        watch->m_Handle = handle;
+        watch->m_Overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        watch->m_Buffer.resize(64 * 1024);
+        if (!IssueRead(*watch))
+        {
+            SetComplete(false);
+            CloseHandle(watch->m_Overlapped.hEvent);
+            CloseHandle(handle);
+            continue;
+        }
+        m_Watches.emplace_back(std::move(watch));
+    }
+
+    if (m_Watches.empty()) return false;
+
+    m_StopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    m_Thread = std::thread([this] { WatchLoop(); });
+    return true;
+}
+
+void DirectoryWatcherNt::Stop()
+{
+    if (m_Thread.joinable())
+    {
+        SetEvent(m_StopEvent);
+        m_Thread.join();
+    }
+
+    for (const auto& watch : m_Watches)
+    {
+        // Outstanding requests must complete before the buffer is released
+        DWORD bytes;
+        CancelIoEx(watch->m_Handle, &watch->m_Overlapped);
+        GetOverlappedResult(watch->m_Handle, &watch->m_Overlapped, &bytes, TRUE);
+        CloseHandle(watch->m_Overlapped.hEvent);
+        CloseHandle(watch->m_Handle);
+    }
+    m_Watches.clear();
+
+    if (m_StopEvent != nullptr)
+    {
+        CloseHandle(m_StopEvent);
+        m_StopEvent = nullptr;
+    }
+}
+
+bool DirectoryWatcherNt::IssueRead(WATCH& watch)
+{
+    ResetEvent(watch.m_Overlapped.hEvent);
+    return ReadDirectoryChangesW(watch.m_Handle, watch.m_Buffer.data(),
+        static_cast<DWORD>(watch.m_Buffer.size()), TRUE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_ATTRIBUTES |
+        FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+        nullptr, &watch.m_Overlapped, nullptr) != FALSE;
+}
+
+void DirectoryWatcherNt::ProcessEvents(const WATCH& watch, const DWORD bytes)
+{
+    // A zero byte completion means the buffer overflowed and events were lost
+    if (bytes == 0)
+    {
+        NotifyChanged(watch.m_Root, true);
+        return;
+    }
+
+    for (DWORD offset = 0;;)
+    {
+        const auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(&watch.m_Buffer[offset]);
+        const std::wstring_view name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+
+        // Report the folder that holds the entry since that is what gets updated
+        const auto slash = name.find_last_of(L'\\');
+        NotifyChanged(slash == std::wstring_view::npos ? watch.m_Root :
+            JoinPath(watch.m_Root, name.substr(0, slash), L'\\'), false);
+
+        if (info->NextEntryOffset == 0) break;
+        offset += info->NextEntryOffset;
+    }
+}
+
+void DirectoryWatcherNt::WatchLoop()
+{
+    std::vector<HANDLE> events = { m_StopEvent };
+    for (const auto& watch : m_Watches) events.push_back(watch->m_Overlapped.hEvent);
+
+    for (;;)
+    {
+        const DWORD result = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+        if (result == WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + events.size()) break;
+
+        auto& watch = *m_Watches[result - WAIT_OBJECT_0 - 1];
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(watch.m_Handle, &watch.m_Overlapped, &bytes, FALSE))
+        {
+            // The watched folder is gone or unreachable; let it be rechecked
+            VTRACE(L"Stopped watching for changes: {} ({})", watch.m_Root, GetLastError());
+            NotifyChanged(watch.m_Root, true);
+            SetComplete(false);
+            ResetEvent(watch.m_Overlapped.hEvent);
+            continue;
+        }
+
+        ProcessEvents(watch, bytes);
+        if (!IssueRead(watch))
+        {
+            NotifyChanged(watch.m_Root, true);
+            SetComplete(false);
+        }
+    }
+}
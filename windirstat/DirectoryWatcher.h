@@ -0,0 +1,196 @@
+// DirectoryWatcher.h - Declaration of DirectoryWatcher
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include <stdafx.h>
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//
+// DirectoryWatcherBase. Abstract change notification interface used to keep
+// a finished scan current. Backends watch one or more root folders and report
+// the folder that contains each created, deleted, renamed or modified entry.
+//
+// Notifications are coalesced per folder: a burst of events is only handed
+// out once no new event arrived for a short quiet period, so every affected
+// folder is updated once no matter how many events it received. A folder is
+// flagged as recursive if events were lost and its whole subtree may be stale.
+//
+// The watcher is complete while every folder below the roots is watched, so
+// that any change since Start is either reported or pending. Once part of a
+// tree can no longer be watched it stays incomplete until started again.
+//
+class DirectoryWatcherBase
+{
+public:
+
+    using CHANGES = std::unordered_map<std::wstring, bool>; // folder -> recursive
+
+private:
+
+    static constexpr auto QUIET_PERIOD = std::chrono::milliseconds(500);
+    static constexpr auto MAXIMUM_DELAY = std::chrono::seconds(3);
+
+    std::mutex m_Mutex;
+    CHANGES m_Pending;
+    std::chrono::steady_clock::time_point m_FirstEvent;
+    std::chrono::steady_clock::time_point m_LastEvent;
+    std::atomic<bool> m_Complete = false;
+
+protected:
+
+    void SetComplete(const bool complete)
+    {
+        m_Complete = complete;
+    }
+
+    void NotifyChanged(const std::wstring& folder, const bool recursive)
+    {
+        std::lock_guard lock(m_Mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (m_Pending.empty()) m_FirstEvent = now;
+        m_LastEvent = now;
+        m_Pending[folder] |= recursive;
+    }
+
+public:
+
+    DirectoryWatcherBase() = default;
+    DirectoryWatcherBase(const DirectoryWatcherBase&) = delete;
+    DirectoryWatcherBase& operator=(const DirectoryWatcherBase&) = delete;
+    virtual ~DirectoryWatcherBase() = default;
+
+    // Folder below a watched root; roots such as C:\ already end in the
+    // separator and must not get a second one
+    static constexpr std::wstring JoinPath(const std::wstring_view root, const std::wstring_view relative, const WCHAR separator)
+    {
+        std::wstring path(root);
+        if (!path.ends_with(separator)) path += separator;
+        return path.append(relative);
+    }
+
+    // Part of a reported folder below the root it was reported for, which
+    // is empty for the root itself, or nothing if it is not below the root
+    static constexpr std::optional<std::wstring_view> GetRelativePath(const std::wstring_view root,
+        const std::wstring_view folder, const WCHAR separator)
+    {
+        if (!folder.starts_with(root)) return std::nullopt;
+        std::wstring_view relative = folder.substr(root.size());
+        if (relative.empty() || root.ends_with(separator)) return relative;
+        if (relative.front() != separator) return std::nullopt;
+        return relative.substr(1);
+    }
+
+    virtual bool Start(const std::vector<std::wstring>& roots) = 0;
+    virtual void Stop() = 0;
+    virtual bool IsWatching() const = 0;
+
+    bool IsComplete() const
+    {
+        return IsWatching() && m_Complete;
+    }
+
+    // Returns the coalesced changes once events have settled; a continuous
+    // stream of events is still flushed after the maximum delay
+    CHANGES TakeChanges()
+    {
+        std::lock_guard lock(m_Mutex);
+        if (m_Pending.empty()) return {};
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - m_LastEvent < QUIET_PERIOD && now - m_FirstEvent < MAXIMUM_DELAY) return {};
+        return std::exchange(m_Pending, {});
+    }
+
+    // Returns all changes right away, e.g. when a refresh was requested
+    CHANGES TakeAllChanges()
+    {
+        std::lock_guard lock(m_Mutex);
+        return std::exchange(m_Pending, {});
+    }
+
+    // Puts back changes that could not be applied yet
+    void RestoreChanges(const CHANGES& changes)
+    {
+        for (const auto& [folder, recursive] : changes) NotifyChanged(folder, recursive);
+    }
+};
+
+#ifdef _WIN32
+
+//
+// DirectoryWatcherNt. Watches each root with an overlapped
+// ReadDirectoryChangesW request covering the whole subtree.
+//
+class DirectoryWatcherNt final : public DirectoryWatcherBase
+{
+    using WATCH = struct WATCH
+    {
+        std::wstring m_Root;
+        HANDLE m_Handle = INVALID_HANDLE_VALUE;
+        OVERLAPPED m_Overlapped = {};
+        std::vector<BYTE> m_Buffer;
+    };
+
+    std::vector<std::unique_ptr<WATCH>> m_Watches;
+    HANDLE m_StopEvent = nullptr;
+    std::thread m_Thread;
+
+    static bool IssueRead(WATCH& watch);
+    void ProcessEvents(const WATCH& watch, DWORD bytes);
+    void WatchLoop();
+
+public:
+
+    DirectoryWatcherNt() = default;
+    ~DirectoryWatcherNt() override;
+
+    bool Start(const std::vector<std::wstring>& roots) override;
+    void Stop() override;
+
+    bool IsWatching() const override
+    {
+        return m_Thread.joinable();
+    }
+};
+
+using DirectoryWatcher = DirectoryWatcherNt;
+
+#else
+
+#include "DirectoryWatcherPosix.h"
+using DirectoryWatcher = DirectoryWatcherPosix;
+
+#endif
@@ -0,0 +1,160 @@
+// DirectoryWatcherPosix.cpp - Implementation of DirectoryWatcherPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef _WIN32
+
+#include "DirectoryWatcher.h"
+#include "FileFind.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <stack>
+
+namespace
+{
+    constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB |
+        IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+}
+
+DirectoryWatcherPosix::~DirectoryWatcherPosix()
+{
+    Stop();
+}
+
+bool DirectoryWatcherPosix::Start(const std::vector<std::wstring>& roots)
+{
+    Stop();
+
+    m_Descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_Descriptor == -1) return false;
+    m_StopDescriptor = eventfd(0, EFD_CLOEXEC);
+
+    SetComplete(true);
+    m_Roots = roots;
+    for (const auto& root : m_Roots) AddWatches(root);
+
+    m_Thread = std::thread([this] { WatchLoop(); });
+    return true;
+}
+
+void DirectoryWatcherPosix::Stop()
+{
+    if (m_Thread.joinable())
+    {
+        constexpr uint64_t signal = 1;
+        (void) write(m_StopDescriptor, &signal, sizeof(signal));
+        m_Thread.join();
+    }
+
+    // closing the inotify descriptor releases all of its watches
+    if (m_Descriptor != -1) close(m_Descriptor);
+    if (m_StopDescriptor != -1) close(m_StopDescriptor);
+    m_Descriptor = m_StopDescriptor = -1;
+    m_Folders.clear();
+    m_Roots.clear();
+}
+
+void DirectoryWatcherPosix::AddWatches(const std::wstring& folder)
+{
+    std::stack<std::wstring> queue({ folder });
+    while (!queue.empty())
+    {
+        const std::wstring current = std::move(queue.top());
+        queue.pop();
+
+        const int watch = inotify_add_watch(m_Descriptor, FileFindPosix::ToNativePath(current).c_str(), WATCH_MASK);
+        if (watch == -1)
+        {
+            // out of watches; changes below here can only be found by a rescan.
+            // folders removed meanwhile are reported through their parent
+            if (errno == ENOSPC) NotifyChanged(current, true);
+            if (errno != ENOENT) SetComplete(false);
+            continue;
+        }
+        m_Folders[watch] = current;
+
+        // symbolic links are not followed by the scan so they are not watched
+        FileFindEnhanced finder;
+        for (bool b = finder.FindFile(current); b; b = finder.FindNextFile())
+        {
+            if (finder.IsDots() || !finder.IsDirectory() ||
+                (finder.GetAttributes() & FILE_ATTRIBUTE_REPARSE_POINT) != 0) continue;
+            queue.push(finder.GetFilePath());
+        }
+    }
+}
+
+void DirectoryWatcherPosix::ProcessEvents(const char* buffer, const size_t length)
+{
+    for (size_t offset = 0; offset < length;)
+    {
+        const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+        offset += sizeof(inotify_event) + event->len;
+
+        // events were dropped by the kernel so nothing below the roots can be trusted
+        if ((event->mask & IN_Q_OVERFLOW) != 0)
+        {
+            for (const auto& root : m_Roots) NotifyChanged(root, true);
+            continue;
+        }
+
+        const auto folder = m_Folders.find(event->wd);
+        if (folder == m_Folders.end()) continue;
+        if ((event->mask & IN_IGNORED) != 0)
+        {
+            m_Folders.erase(folder);
+            continue;
+        }
+
+        NotifyChanged(folder->second, false);
+
+        // new folders need their own watches to see what happens inside them
+        if ((event->mask & IN_ISDIR) != 0 && (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0)
+        {
+            AddWatches(JoinPath(folder->second, FileFindPosix::FromNativePath(event->name), L'/'));
+        }
+    }
+}
+
+void DirectoryWatcherPosix::WatchLoop()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    std::array<pollfd, 2> descriptors = { {
+        { m_StopDescriptor, POLLIN, 0 },
+        { m_Descriptor, POLLIN, 0 } } };
+
+    while (poll(descriptors.data(), descriptors.size(), -1) >= 0 || errno == EINTR)
+    {
+        if ((descriptors[0].revents & POLLIN) != 0) break;
+        if ((descriptors[1].revents & POLLIN) == 0) continue;
+
+        for (ssize_t length; (length = read(m_Descriptor, buffer, sizeof(buffer))) > 0;)
+        {
+            ProcessEvents(buffer, static_cast<size_t>(length));
+        }
+    }
+}
+
+#endif
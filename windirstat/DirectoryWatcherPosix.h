@@ -0,0 +1,65 @@
+// DirectoryWatcherPosix.h - Declaration of DirectoryWatcherPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "DirectoryWatcher.h"
+
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//
+// DirectoryWatcherPosix. Change notification backend built on inotify.
+// inotify watches are not recursive so every folder below the roots gets its
+// own watch, and folders created later are added as their events arrive.
+// If the kernel queue overflows or the watch limit is reached the affected
+// root is reported as recursively changed.
+//
+class DirectoryWatcherPosix final : public DirectoryWatcherBase
+{
+    int m_Descriptor = -1;
+    int m_StopDescriptor = -1;
+    std::unordered_map<int, std::wstring> m_Folders; // watch descriptor -> folder
+    std::vector<std::wstring> m_Roots;
+    std::thread m_Thread;
+
+    void AddWatches(const std::wstring& folder);
+    void ProcessEvents(const char* buffer, size_t length);
+    void WatchLoop();
+
+public:
+
+    DirectoryWatcherPosix() = default;
+    ~DirectoryWatcherPosix() override;
+
+    bool Start(const std::vector<std::wstring>& roots) override;
+    void Stop() override;
+
+    bool IsWatching() const override
+    {
+        return m_Thread.joinable();
+    }
+};
+
+#endif
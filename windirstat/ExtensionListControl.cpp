@@ -214,9 +214,11 @@ void CExtensionListControl::SetExtensionData(const CExtensionData* ed)
 {
     DeleteAllItems();
 
-    for (int i = 0; const auto & ext : *ed)
+    int i = 0;
+    for (EXTENSIONID ext = 0; ext < ed->size(); ext++)
     {
-        const auto item = new CListItem(this, ext.first, ext.second);
+        if ((*ed)[ext].files == 0) continue;
+        const auto item = new CListItem(this, CExtensionRegistry::GetName(ext), (*ed)[ext]);
         InsertListItem(i++, item);
     }
 
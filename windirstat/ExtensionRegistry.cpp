@@ -0,0 +1,203 @@
+// ExtensionRegistry.cpp - Implementation of CExtensionRegistry
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifdef _WIN32
+#include "stdafx.h"
+#include "GlobalHelpers.h"
+#endif
+
+#include "ExtensionRegistry.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cwctype>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+#ifndef _WIN32
+    // Case folding of the C library; GlobalHelpers is not part of this build
+    std::wstring& MakeLower(std::wstring& s)
+    {
+        std::ranges::transform(s, s.begin(), [](const wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+        return s;
+    }
+#endif
+
+    using ENTRY = struct ENTRY
+    {
+        std::wstring m_Name;
+        size_t m_Hash;
+        EXTENSIONID m_Id;
+    };
+
+    // Open addressing table that is only ever added to; a full table is
+    // replaced by a larger copy and kept since readers may still probe it
+    using TABLE = struct TABLE
+    {
+        explicit TABLE(const size_t size) : m_Mask(size - 1), m_Slots(size) {}
+
+        const ENTRY* Find(const std::wstring_view name, const size_t hash) const
+        {
+            for (size_t i = hash & m_Mask;; i = (i + 1) & m_Mask)
+            {
+                const ENTRY* entry = m_Slots[i].load(std::memory_order_acquire);
+                if (entry == nullptr) return nullptr;
+                if (entry->m_Hash == hash && entry->m_Name == name) return entry;
+            }
+        }
+
+        void Insert(const ENTRY* entry)
+        {
+            size_t i = entry->m_Hash & m_Mask;
+            while (m_Slots[i].load(std::memory_order_relaxed) != nullptr) i = (i + 1) & m_Mask;
+            m_Slots[i].store(entry, std::memory_order_release);
+        }
+
+        size_t m_Mask;
+        std::vector<std::atomic<const ENTRY*>> m_Slots;
+    };
+
+    // Entries by id are kept in blocks that never move once allocated
+    constexpr size_t BLOCK_SIZE = 1024;
+    constexpr size_t MAX_BLOCKS = 16 * 1024;
+
+    using REGISTRY = struct REGISTRY
+    {
+        std::mutex m_Mutex;
+        std::atomic<TABLE*> m_Table = nullptr;
+        std::vector<std::unique_ptr<TABLE>> m_Tables;
+        std::array<std::atomic<const ENTRY**>, MAX_BLOCKS> m_Blocks = {};
+        std::atomic<EXTENSIONID> m_Count = 0;
+
+        REGISTRY()
+        {
+            m_Tables.emplace_back(std::make_unique<TABLE>(1024));
+            m_Table = m_Tables.back().get();
+            Add(std::wstring(), std::hash<std::wstring_view>{}(L""));
+        }
+
+        // Callers hold the lock
+        EXTENSIONID Add(std::wstring name, const size_t hash)
+        {
+            const EXTENSIONID id = m_Count.load(std::memory_order_relaxed);
+            if (id / BLOCK_SIZE >= MAX_BLOCKS) throw std::length_error("too many extensions");
+
+            auto& block = m_Blocks[id / BLOCK_SIZE];
+            if (block.load(std::memory_order_relaxed) == nullptr) block.store(new const ENTRY*[BLOCK_SIZE]);
+            const auto entry = new ENTRY{ std::move(name), hash, id };
+            block.load(std::memory_order_relaxed)[id % BLOCK_SIZE] = entry;
+
+            // Keep the table at most half full so probes stay short
+            TABLE* table = m_Table.load(std::memory_order_relaxed);
+            if ((static_cast<size_t>(id) + 1) * 2 > table->m_Slots.size())
+            {
+                m_Tables.emplace_back(std::make_unique<TABLE>(table->m_Slots.size() * 2));
+                table = m_Tables.back().get();
+                for (EXTENSIONID i = 0; i < id; i++)
+                {
+                    table->Insert(m_Blocks[i / BLOCK_SIZE].load(std::memory_order_relaxed)[i % BLOCK_SIZE]);
+                }
+            }
+            table->Insert(entry);
+
+            m_Table.store(table, std::memory_order_release);
+            m_Count.store(id + 1, std::memory_order_release);
+            return id;
+        }
+    };
+
+    REGISTRY& GetRegistry()
+    {
+        // Never destroyed since items may outlive static destruction
+        static const auto registry = new REGISTRY();
+        return *registry;
+    }
+}
+
+EXTENSIONID CExtensionRegistry::Register(const std::wstring_view extension)
+{
+    // Most extensions fit into the small string buffer and do not allocate
+    std::wstring lower(extension);
+    MakeLower(lower);
+
+    REGISTRY& registry = GetRegistry();
+    const size_t hash = std::hash<std::wstring_view>{}(lower);
+    if (const ENTRY* entry = registry.m_Table.load(std::memory_order_acquire)->Find(lower, hash); entry != nullptr)
+    {
+        return entry->m_Id;
+    }
+
+    // Another thread may have added it since the lookup above
+    std::lock_guard lock(registry.m_Mutex);
+    if (const ENTRY* entry = registry.m_Table.load(std::memory_order_relaxed)->Find(lower, hash); entry != nullptr)
+    {
+        return entry->m_Id;
+    }
+    return registry.Add(std::move(lower), hash);
+}
+
+EXTENSIONID CExtensionRegistry::Find(const std::wstring_view extension)
+{
+    std::wstring lower(extension);
+    MakeLower(lower);
+
+    const ENTRY* entry = GetRegistry().m_Table.load(std::memory_order_acquire)->Find(lower, std::hash<std::wstring_view>{}(lower));
+    return entry != nullptr ? entry->m_Id : INVALID;
+}
+
+const std::wstring& CExtensionRegistry::GetName(const EXTENSIONID id)
+{
+    ASSERT(id < GetCount());
+    return GetRegistry().m_Blocks[id / BLOCK_SIZE].load(std::memory_order_acquire)[id % BLOCK_SIZE]->m_Name;
+}
+
+EXTENSIONID CExtensionRegistry::GetCount()
+{
+    return GetRegistry().m_Count.load(std::memory_order_acquire);
+}
+
+size_t CExtensionRegistry::GetBytesUsed()
+{
+    REGISTRY& registry = GetRegistry();
+    std::lock_guard lock(registry.m_Mutex);
+
+    size_t bytes = sizeof(REGISTRY);
+    for (const auto& table : registry.m_Tables)
+    {
+        bytes += sizeof(TABLE) + table->m_Slots.capacity() * sizeof(std::atomic<const ENTRY*>);
+    }
+
+    // Short names are kept inside the string and need no memory of their own
+    const size_t inlined = std::wstring().capacity();
+    const EXTENSIONID count = registry.m_Count.load(std::memory_order_relaxed);
+    bytes += (count + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE * sizeof(const ENTRY*);
+    for (EXTENSIONID id = 0; id < count; id++)
+    {
+        const ENTRY* entry = registry.m_Blocks[id / BLOCK_SIZE].load(std::memory_order_relaxed)[id % BLOCK_SIZE];
+        bytes += sizeof(ENTRY);
+        if (entry->m_Name.capacity() > inlined) bytes += (entry->m_Name.capacity() + 1) * sizeof(WCHAR);
+    }
+    return bytes;
+}
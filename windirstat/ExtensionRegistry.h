@@ -0,0 +1,62 @@
+// ExtensionRegistry.h - Declaration of CExtensionRegistry
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include "stdafx.h"
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <string>
+#include <string_view>
+
+// Small integer standing for a lower case extension like ".bmp"
+using EXTENSIONID = ULONG;
+
+//
+// CExtensionRegistry. Process wide set of all extensions seen so far. Each
+// extension is handed out a dense id once and keeps it for the lifetime of
+// the process, so items store the id and per extension data is an array.
+//
+// Looking up a known extension takes no lock, which is by far the common
+// case while scanning. Only registering a new extension takes a lock.
+//
+class CExtensionRegistry final
+{
+public:
+
+    // Id of the empty extension of files without one and of folders
+    static constexpr EXTENSIONID NONE = 0;
+    static constexpr EXTENSIONID INVALID = static_cast<EXTENSIONID>(-1);
+
+    // Returns the id of the extension in any case, registering it if new
+    static EXTENSIONID Register(std::wstring_view extension);
+
+    // Returns the id of the extension or INVALID if it has never been seen
+    static EXTENSIONID Find(std::wstring_view extension);
+
+    static const std::wstring& GetName(EXTENSIONID id);
+    static EXTENSIONID GetCount();
+
+    // Memory held by the registry including its lookup tables
+    static size_t GetBytesUsed();
+};
@@ -33,6 +33,31 @@
 #include <ranges>
 #include <stack>
 
+namespace
+{
+    // Buckets hold two pointers and nodes are linked both ways
+    template <class T> size_t HashContainerBytes(const T& container)
+    {
+        return container.bucket_count() * 2 * sizeof(void*) +
+            container.size() * (2 * sizeof(void*) + sizeof(typename T::value_type));
+    }
+
+    size_t StringBytes(const std::wstring& text)
+    {
+        return text.capacity() > std::wstring().capacity() ? (text.capacity() + 1) * sizeof(WCHAR) : 0;
+    }
+
+    // Applies an update to a hash container and adds the change in its
+    // estimate to the counter; unsigned wraparound takes care of shrinking
+    template <class T, class F> auto Track(std::atomic<size_t>& bytes, T& container, F&& update)
+    {
+        const size_t before = HashContainerBytes(container);
+        auto result = update(container);
+        bytes += HashContainerBytes(container) - before;
+        return result;
+    }
+}
+
 CFileDupeControl::CFileDupeControl() : CTreeListControl(20, COptions::DupeViewColumnOrder.Ptr(), COptions::DupeViewColumnWidths.Ptr())
 {
     m_Singleton = this;
@@ -105,11 +130,10 @@ void CFileDupeControl::OnContextMenu(CWnd* /*pWnd*/, const CPoint pt)
     sub->TrackPopupMenuEx(TPM_LEFTALIGN | TPM_LEFTBUTTON, pt.x, pt.y, AfxGetMainWnd(), &tp);
 }
 
-void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* queue)
+void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle)
 {
+    // Cloud links are filtered by the caller using the tag from the enumeration
     if (!COptions::ScanForDuplicates) return;
-    if (COptions::SkipDupeDetectionCloudLinks.Obj() &&
-        CDirStatApp::Get()->GetReparseInfo()->IsCloudLink(item->GetPathLong(), item->GetAttributes())) return;
 
     std::unique_lock lock(m_Mutex);
     const auto sizeEntry = m_SizeTracker.find(item->GetSizeLogical());
@@ -117,12 +141,14 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
     {
         // Add first entry to list
         const auto set = { item };
-        m_SizeTracker.emplace(item->GetSizeLogical(), set);
+        const auto entry = Track(m_TrackerBytes, m_SizeTracker, [&](auto& tracker)
+            { return tracker.emplace(item->GetSizeLogical(), set); }).first;
+        m_TrackerBytes += HashContainerBytes(entry->second);
         return;
     }
 
     // Add to the list of items to track
-    sizeEntry->second.insert(item);
+    Track(m_TrackerBytes, sizeEntry->second, [item](auto& items) { return items.insert(item); });
 
     std::wstring hashForThisItem;
     auto itemsToHash = sizeEntry->second;
@@ -137,7 +163,7 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
 
             // Compute the hash for the file
             lock.unlock();
-            std::wstring hash = itemToHash->GetFileHash(hashType == ITF_PARTHASH ? partialBufferSize : 0, queue);
+            std::wstring hash = itemToHash->GetFileHash(hashType == ITF_PARTHASH ? partialBufferSize : 0, queue, throttle);
             lock.lock();
 
             itemToHash->SetType(itemToHash->GetRawType() | hashType);
@@ -151,9 +177,14 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
                 itemToHash->SetType(itemToHash->GetRawType() | ITF_FULLHASH);
 
             // See if hash is already in tracking
-            const auto hashEntry = m_HashTracker.find(hash);
-            if (hashEntry != m_HashTracker.end()) hashEntry->second.insert(itemToHash);
-            else m_HashTracker.emplace(hash, std::initializer_list<CItem*> { itemToHash });
+            if (const auto hashEntry = m_HashTracker.find(hash); hashEntry != m_HashTracker.end())
+            {
+                Track(m_TrackerBytes, hashEntry->second, [itemToHash](auto& items) { return items.insert(itemToHash); });
+                continue;
+            }
+            const auto entry = Track(m_TrackerBytes, m_HashTracker, [&](auto& tracker)
+                { return tracker.emplace(hash, std::initializer_list<CItem*> { itemToHash }); }).first;
+            m_TrackerBytes += StringBytes(entry->first) + HashContainerBytes(entry->second);
         }
 
         // Return if no hash conflicts
@@ -161,7 +192,15 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
         if (hashesResult == m_HashTracker.end() || hashesResult->second.size() <= 1) return;
         itemsToHash = hashesResult->second;
     }
-    
+
+    // Without a main window the confirmed set is only recorded for the caller
+    if (CMainFrame::Get() == nullptr)
+    {
+        if (Track(m_TrackerBytes, m_ConfirmedHashes, [&](auto& hashes)
+            { return hashes.insert(hashForThisItem); }).second) m_TrackerBytes += StringBytes(hashForThisItem);
+        return;
+    }
+
     for (const auto& itemToAdd : itemsToHash)
     {
         CMainFrame::Get()->InvokeInMessageThread([&]
@@ -175,7 +214,9 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
                 // Create new root item to hold these duplicates
                 dupeParent = new CItemDupe(hashForThisItem, itemToAdd->GetSizePhysical(), itemToAdd->GetSizeLogical());
                 root->AddChild(dupeParent);
-                m_NodeTracker.emplace(hashForThisItem, dupeParent);
+                const auto entry = Track(m_TrackerBytes, m_NodeTracker, [&](auto& tracker)
+                    { return tracker.emplace(hashForThisItem, dupeParent); }).first;
+                m_TrackerBytes += StringBytes(entry->first);
             }
 
             // See if child is already in list parent
@@ -192,8 +233,16 @@ void CFileDupeControl::ProcessDuplicate(CItem * item, BlockingQueue<CItem*>* que
     }
 }
 
+size_t CFileDupeControl::GetTrackerBytes() const
+{
+    return m_TrackerBytes;
+}
+
 void CFileDupeControl::RemoveItem(CItem* item)
 {
+    // Items may be removed by scan workers while others are still being processed
+    std::unique_lock lock(m_Mutex);
+
     // Exit immediately if not doing duplicate detector
     if (m_HashTracker.empty() && m_SizeTracker.empty()) return;
 
@@ -210,30 +259,62 @@ void CFileDupeControl::RemoveItem(CItem* item)
         }
     }
 
-    const auto root = reinterpret_cast<CItemDupe*>(GetItem(0));
-    for (const auto& itemToRemove : std::ranges::reverse_view(itemsToRemove))
+    // Items are dropped from the trackers right away while the visual nodes
+    // that show them are left to the message thread, which owns them
+    std::unordered_map<std::wstring, std::vector<CItem*>> nodesToUpdate;
+    for (const auto& itemToRemove : itemsToRemove)
     {
         // Remove from size tracker
-        const auto size = itemToRemove->GetSizeLogical();
-        m_SizeTracker.at(size).erase(itemToRemove);
+        if (const auto sizeSet = m_SizeTracker.find(itemToRemove->GetSizeLogical());
+            sizeSet != m_SizeTracker.end()) Track(m_TrackerBytes, sizeSet->second,
+                [itemToRemove](auto& items) { return items.erase(itemToRemove); });
 
         // Remove from hash tracker
         for (auto& [hashKey, hashSet] : m_HashTracker)
         {
-            // Skip if no matches of the item associated with this hash
-            if (!hashSet.contains(itemToRemove)) continue;
-        
-            // Remove from this set
-            hashSet.erase(itemToRemove);
+            if (Track(m_TrackerBytes, hashSet, [itemToRemove](auto& items)
+                { return items.erase(itemToRemove); }) != 0) nodesToUpdate[hashKey].push_back(itemToRemove);
+        }
+    }
+
+    // Cleanup empty structures
+    size_t released = 0;
+    Track(m_TrackerBytes, m_HashTracker, [&](auto& tracker)
+    {
+        return std::erase_if(tracker, [&](const auto& pair)
+        {
+            if (!pair.second.empty()) return false;
+            released += StringBytes(pair.first) + HashContainerBytes(pair.second);
+            return true;
+        });
+    });
+    Track(m_TrackerBytes, m_SizeTracker, [&](auto& tracker)
+    {
+        return std::erase_if(tracker, [&](const auto& pair)
+        {
+            if (!pair.second.empty()) return false;
+            released += HashContainerBytes(pair.second);
+            return true;
+        });
+    });
+    m_TrackerBytes -= released;
+    lock.unlock();
 
+    if (nodesToUpdate.empty() || CMainFrame::Get() == nullptr) return;
+    CMainFrame::Get()->InvokeInMessageThread([this, &nodesToUpdate]
+    {
+        const auto root = reinterpret_cast<CItemDupe*>(GetItem(0));
+        for (const auto& [hashKey, removed] : nodesToUpdate)
+        {
             // Continue if this is not present in the node list
-            if (!m_NodeTracker.contains(hashKey)) continue;
+            const auto nodeEntry = m_NodeTracker.find(hashKey);
+            if (nodeEntry == m_NodeTracker.end()) continue;
 
-            // Remove the entry from the visual node list
-            auto& hashNode = m_NodeTracker.at(hashKey);
+            // Remove the entries from the visual node list
+            const auto hashNode = nodeEntry->second;
             for (auto& dupeChild : std::vector(hashNode->GetChildren()))
             {
-                if (dupeChild->GetItem() == itemToRemove)
+                if (std::ranges::find(removed, dupeChild->GetItem()) != removed.end())
                 {
                     hashNode->RemoveChild(dupeChild);
                 }
@@ -243,19 +324,10 @@ void CFileDupeControl::RemoveItem(CItem* item)
             if (hashNode->GetChildren().size() <= 1)
             {
                 root->RemoveChild(hashNode);
-                m_NodeTracker.erase(hashKey);
+                m_TrackerBytes -= StringBytes(nodeEntry->first);
+                Track(m_TrackerBytes, m_NodeTracker, [&](auto& tracker) { return tracker.erase(nodeEntry); });
             }
         }
-    }
-
-    // Cleanup empty structures
-    std::erase_if(m_HashTracker, [&](const auto& pair)
-    {
-        return pair.second.empty();
-    });
-    std::erase_if(m_SizeTracker, [&](const auto& pair)
-    {
-        return pair.second.empty();
     });
 }
 
@@ -318,6 +390,11 @@ void CFileDupeControl::SetRootItem(CTreeListItem* root)
     m_HashTracker.clear();
     m_SizeTracker.clear();
 
+    // Cleared containers may keep their buckets
+    m_TrackerBytes = HashContainerBytes(m_SizeTracker) + HashContainerBytes(m_HashTracker) +
+        HashContainerBytes(m_NodeTracker) + HashContainerBytes(m_ConfirmedHashes);
+    for (const auto& hash : m_ConfirmedHashes) m_TrackerBytes += StringBytes(hash);
+
     CTreeListControl::SetRootItem(root);
 }
 
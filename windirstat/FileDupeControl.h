@@ -36,13 +36,19 @@ public:
     static CFileDupeControl* Get() { return m_Singleton; }
     void InsertItem(int i, CTreeListItem* item);
     void SetRootItem(CTreeListItem* root) override;
-    void ProcessDuplicate(CItem* item, BlockingQueue<CItem*>* queue);
+    void ProcessDuplicate(CItem* item, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle);
     void RemoveItem(CItem* items);
 
+    // Estimated memory of the trackers, kept current as they change so that
+    // it can be read at any time without walking them
+    size_t GetTrackerBytes() const;
+
     std::shared_mutex m_Mutex;
     std::unordered_map<ULONGLONG, std::unordered_set<CItem*>> m_SizeTracker;
     std::unordered_map<std::wstring, CItemDupe*> m_NodeTracker;
     std::unordered_map<std::wstring, std::unordered_set<CItem*>> m_HashTracker;
+    std::unordered_set<std::wstring> m_ConfirmedHashes; // only tracked when running headless
+    std::atomic<size_t> m_TrackerBytes = 0;
 
     template <class T = CTreeListItem> std::vector<T*> GetAllSelected()
     {
@@ -26,6 +26,9 @@
 #include "Options.h"
 #include <common/Tracer.h>
 
+#include <algorithm>
+#include <bit>
+
 #pragma comment(lib,"ntdll.lib")
 
 NTSTATUS(WINAPI* NtQueryDirectoryFile)(HANDLE FileHandle, HANDLE Event, PVOID ApcRoutine,
@@ -34,34 +37,37 @@ NTSTATUS(WINAPI* NtQueryDirectoryFile)(HANDLE FileHandle, HANDLE Event, PVOID Ap
     PUNICODE_STRING FileName, BOOLEAN RestartScan) = reinterpret_cast<decltype(NtQueryDirectoryFile)>(
         static_cast<LPVOID>(GetProcAddress(LoadLibrary(L"ntdll.dll"), "NtQueryDirectoryFile")));
 
-FileFindEnhanced::~FileFindEnhanced()
-{
-    if (m_Handle != nullptr) NtClose(m_Handle);
-}
+// Directory information classes and the errors returned by file systems
+// that do not support the extended one
+constexpr auto FileFullDirectoryInformation = 2;
+constexpr auto FileIdExtdDirectoryInformation = 60;
+constexpr NTSTATUS STATUS_INVALID_INFO_CLASS = static_cast<NTSTATUS>(0xC0000003);
+constexpr NTSTATUS STATUS_INVALID_PARAMETER = static_cast<NTSTATUS>(0xC000000D);
+constexpr NTSTATUS STATUS_NOT_SUPPORTED = static_cast<NTSTATUS>(0xC00000BB);
 
-bool FileFindEnhanced::FindNextFile()
+bool FileFindNt::FindNextFile()
 {
     bool success = false;
     if (m_Firstrun || m_CurrentInfo->NextEntryOffset == 0)
     {
-        constexpr auto BUFFER_SIZE = 64 * 1024;
-        thread_local std::vector<BYTE> m_DirectoryInfo(BUFFER_SIZE);
+        // Overlapped finders are refilled through QueryAsync()
+        if (m_Port != nullptr) return false;
 
-        // handle optional pattern mask
-        UNICODE_STRING uSearch;
-        uSearch.Length = static_cast<USHORT>(m_Search.size() * sizeof(WCHAR));
-        uSearch.MaximumLength = static_cast<USHORT>(m_Search.size() + 1) * sizeof(WCHAR);
-        uSearch.Buffer = m_Search.data();
+        thread_local std::vector<BYTE> m_DirectoryInfo;
+        if (m_DirectoryInfo.size() < m_BufferSize) m_DirectoryInfo.resize(m_BufferSize);
 
-        // enumerate files in the directory
-        constexpr auto FileDirectoryInformation = 1;
+        // enumerate files in the directory; file systems that reject the
+        // extended class are asked again using the older full class
         IO_STATUS_BLOCK IoStatusBlock;
-        const NTSTATUS Status = NtQueryDirectoryFile(m_Handle, nullptr, nullptr, nullptr, &IoStatusBlock,
-            m_DirectoryInfo.data(), BUFFER_SIZE, static_cast<FILE_INFORMATION_CLASS>(FileDirectoryInformation),
-            FALSE, (uSearch.Length > 0) ? &uSearch : nullptr, (m_Firstrun) ? TRUE : FALSE);
+        NTSTATUS Status;
+        do
+        {
+            Status = QueryDirectory(m_DirectoryInfo.data(), &IoStatusBlock, nullptr);
+        } while (FallBackToFullInformation(Status));
 
         // fetch point to current node 
         success = (Status == 0);
+        if (success) AdaptBufferSize(IoStatusBlock.Information);
         m_CurrentInfo = reinterpret_cast<FILE_DIRECTORY_INFORMATION*>(m_DirectoryInfo.data());
     }
     else
@@ -71,51 +77,91 @@ bool FileFindEnhanced::FindNextFile()
         success = true;
     }
 
-    if (success)
-    {
-        // copy name into local buffer
-        m_Name.resize(m_CurrentInfo->FileNameLength / sizeof(WCHAR));
-        memcpy(m_Name.data(), m_CurrentInfo->FileName, m_CurrentInfo->FileNameLength);
-
-        // special case for reparse on initial run points - update attributes
-        if (m_Firstrun)
-        {
-            std::wstring initialPath = GetFilePathLong();
-            if (IsDots()) initialPath.pop_back();
-            m_CurrentInfo->FileAttributes = GetFileAttributes(initialPath.c_str());
-        }
-    }
+    if (success) LoadCurrentEntry();
 
     m_Firstrun = false;
     return success;
 }
 
-bool FileFindEnhanced::FindFile(const std::wstring & strFolder, const std::wstring& strName)
+LONG FileFindNt::QueryDirectory(BYTE* buffer, const PVOID status, const PVOID context)
+{
+    // handle optional pattern mask
+    UNICODE_STRING uSearch;
+    uSearch.Length = static_cast<USHORT>(m_Search.size() * sizeof(WCHAR));
+    uSearch.MaximumLength = static_cast<USHORT>(m_Search.size() + 1) * sizeof(WCHAR);
+    uSearch.Buffer = m_Search.data();
+
+    return NtQueryDirectoryFile(m_Handle.get(), nullptr, nullptr, context, static_cast<PIO_STATUS_BLOCK>(status),
+        buffer, m_BufferSize, static_cast<FILE_INFORMATION_CLASS>(
+        m_Extended ? FileIdExtdDirectoryInformation : FileFullDirectoryInformation),
+        FALSE, (uSearch.Length > 0) ? &uSearch : nullptr, (m_Firstrun) ? TRUE : FALSE);
+}
+
+bool FileFindNt::FallBackToFullInformation(const LONG status)
+{
+    if (!m_Extended || !m_Firstrun || status != STATUS_INVALID_INFO_CLASS &&
+        status != STATUS_INVALID_PARAMETER && status != STATUS_NOT_SUPPORTED) return false;
+
+    m_Extended = false;
+    return true;
+}
+
+void FileFindNt::AdaptBufferSize(const ULONG_PTR bytes)
+{
+    // A query that came back more than half full most likely left entries
+    // behind, so ask for more at once to save round trips on the next one
+    if (m_Firstrun) s_TypicalSize = (3 * s_TypicalSize + static_cast<ULONG>(bytes)) / 4;
+    if (bytes > m_BufferSize / 2) m_BufferSize = std::min(m_BufferSize * 2, MAXIMUM_BUFFER_SIZE);
+}
+
+void FileFindNt::LoadCurrentEntry()
+{
+    // copy name into local buffer
+    m_Name.resize(m_CurrentInfo->FileNameLength / sizeof(WCHAR));
+    memcpy(m_Name.data(), m_Extended ?
+        static_cast<FILE_ID_EXTD_DIR_INFORMATION*>(m_CurrentInfo)->FileName :
+        static_cast<FILE_FULL_DIR_INFORMATION*>(m_CurrentInfo)->FileName, m_CurrentInfo->FileNameLength);
+
+    // special case for reparse on initial run points - update attributes;
+    // directories opened relative to a parent are never scan roots
+    if (m_Firstrun && !m_Resolver)
+    {
+        std::wstring initialPath = GetFilePathLong();
+        if (IsDots()) initialPath.pop_back();
+        m_CurrentInfo->FileAttributes = GetFileAttributes(initialPath.c_str());
+    }
+}
+
+bool FileFindNt::FindFile(const std::wstring & strFolder, const std::wstring& strName)
 {
     // stash the search pattern for later use
     m_Search = strName;
+    m_Resolver = nullptr;
+    m_Port = nullptr;
+    m_Firstrun = true;
 
     // convert the path to a long path that is compatible with the other call
-    m_Base = strFolder;
-    if (m_Base.find(L":\\", 1) == 1) m_Base = m_Dos + m_Base;
-    else if (m_Base.starts_with(L"\\\\")) m_Base = m_DosUNC + m_Base.substr(2);
-    UNICODE_STRING path;
-    path.Length = static_cast<USHORT>(m_Base.size() * sizeof(WCHAR));
-    path.MaximumLength = static_cast<USHORT>(m_Base.size() + 1) * sizeof(WCHAR);
-    path.Buffer = m_Base.data();
+    m_Base = MakeNtPath(strFolder);
+    if (std::wstring path = m_Base; !OpenDirectory(nullptr, path))
+    {
+        return FALSE;
+    }
 
-    // update object attributes object
-    OBJECT_ATTRIBUTES attributes;
-    InitializeObjectAttributes(&attributes, nullptr, OBJ_CASE_INSENSITIVE, nullptr, nullptr);
-    attributes.ObjectName = &path;
+    // do initial search
+    return FindNextFile();
+}
 
-    // get an open file handle
-    IO_STATUS_BLOCK statusBlock = {};
-    if (const NTSTATUS status = NtOpenFile(&m_Handle, FILE_LIST_DIRECTORY | SYNCHRONIZE,
-        &attributes, &statusBlock, FILE_SHARE_READ | FILE_SHARE_WRITE, 
-        FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT); status != 0)
+bool FileFindNt::FindFileRelative(const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver)
+{
+    // the full path is only resolved if something asks for it
+    m_Search.clear();
+    m_Base.clear();
+    m_Resolver = resolver;
+    m_Port = nullptr;
+    m_Firstrun = true;
+
+    if (std::wstring name = strFolder; !OpenDirectory(parent.get(), name))
     {
-        VTRACE(L"File Access Error {:#08X}: {}", static_cast<DWORD>(status), m_Base.data());
         return FALSE;
     }
 
@@ -123,71 +169,188 @@ bool FileFindEnhanced::FindFile(const std::wstring & strFolder, const std::wstri
     return FindNextFile();
 }
 
-bool FileFindEnhanced::IsDirectory() const
+bool FileFindNt::FindFileAsync(const HANDLE port, const ULONG_PTR key, const DirectoryHandle& parent,
+    const std::wstring& strFolder, const PathResolver& resolver)
+{
+    m_Search.clear();
+    m_Base.clear();
+    m_Resolver = resolver;
+    m_Port = port;
+    m_Firstrun = true;
+    m_Ended = false;
+
+    // fall back to the full path like the synchronous interface does
+    if (std::wstring name = strFolder; parent == nullptr || !OpenDirectory(parent.get(), name))
+    {
+        m_Resolver = nullptr;
+        m_Base = MakeNtPath(resolver());
+        if (std::wstring path = m_Base; !OpenDirectory(nullptr, path)) return false;
+    }
+
+    if (CreateIoCompletionPort(m_Handle.get(), port, key, 0) == nullptr)
+    {
+        VTRACE(L"Cannot bind folder to completion port: {}", GetLastError());
+        m_Handle.reset();
+        return false;
+    }
+
+    return QueryAsync();
+}
+
+bool FileFindNt::QueryAsync()
 {
-    return (m_CurrentInfo->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    while (!m_Ended)
+    {
+        if (m_Buffer.size() < m_BufferSize) m_Buffer.resize(m_BufferSize);
+        m_Overlapped = {};
+
+        // Anything but an error is reported through the completion port,
+        // including queries that finished right away
+        const NTSTATUS status = QueryDirectory(m_Buffer.data(), &m_Overlapped, &m_Overlapped);
+        if (static_cast<ULONG>(status) >> 30 != 3)
+        {
+            m_Pending = true;
+            return true;
+        }
+
+        if (!FallBackToFullInformation(status)) m_Ended = true;
+    }
+
+    return false;
 }
 
-bool FileFindEnhanced::IsDots() const
+bool FileFindNt::CompleteQuery()
 {
-    return m_Name == L"." || m_Name == L"..";
+    m_Pending = false;
+    if (const auto status = static_cast<NTSTATUS>(m_Overlapped.Internal); status != 0)
+    {
+        // Ask again with the older class if that is why the first query failed
+        if (!FallBackToFullInformation(status)) m_Ended = true;
+        return false;
+    }
+
+    AdaptBufferSize(m_Overlapped.InternalHigh);
+    m_CurrentInfo = reinterpret_cast<FILE_DIRECTORY_INFORMATION*>(m_Buffer.data());
+    LoadCurrentEntry();
+    m_Firstrun = false;
+    return true;
 }
 
-bool FileFindEnhanced::IsHidden() const
+bool FileFindNt::IsQueryPending() const
 {
-    return (m_CurrentInfo->FileAttributes & FILE_ATTRIBUTE_HIDDEN) != 0;
+    return m_Pending;
 }
 
-bool FileFindEnhanced::IsHiddenSystem() const
+void FileFindNt::CancelQuery()
 {
-    constexpr DWORD hiddenSystem = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM;
-    return (m_CurrentInfo->FileAttributes & hiddenSystem) == hiddenSystem;
+    // The completion still arrives at the port and must be waited for
+    m_Ended = true;
+    if (m_Pending) CancelIoEx(m_Handle.get(), &m_Overlapped);
 }
 
-bool FileFindEnhanced::IsProtectedReparsePoint() const
+bool FileFindNt::OpenDirectory(const HANDLE root, std::wstring& path)
 {
-    constexpr DWORD protect = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_REPARSE_POINT;
-    return (m_CurrentInfo->FileAttributes & protect) == protect;
+    UNICODE_STRING name;
+    name.Length = static_cast<USHORT>(path.size() * sizeof(WCHAR));
+    name.MaximumLength = static_cast<USHORT>(path.size() + 1) * sizeof(WCHAR);
+    name.Buffer = path.data();
+
+    // update object attributes object
+    OBJECT_ATTRIBUTES attributes;
+    InitializeObjectAttributes(&attributes, nullptr, OBJ_CASE_INSENSITIVE, root, nullptr);
+    attributes.ObjectName = &name;
+
+    // get an open file handle; overlapped finders need an asynchronous one
+    HANDLE handle = nullptr;
+    IO_STATUS_BLOCK statusBlock = {};
+    if (const NTSTATUS status = NtOpenFile(&handle, FILE_LIST_DIRECTORY | SYNCHRONIZE,
+        &attributes, &statusBlock, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_DIRECTORY_FILE |
+        (m_Port != nullptr ? 0 : FILE_SYNCHRONOUS_IO_NONALERT) | FILE_OPEN_FOR_BACKUP_INTENT); status != 0)
+    {
+        VTRACE(L"File Access Error {:#08X}: {}", static_cast<DWORD>(status), path.data());
+        m_OpenError = static_cast<DWORD>(status);
+        m_Handle.reset();
+        return false;
+    }
+
+    m_OpenError = 0;
+    m_Handle = DirectoryHandle(handle, NtClose);
+    m_BufferSize = std::clamp(std::bit_ceil(2 * s_TypicalSize), MINIMUM_BUFFER_SIZE, INITIAL_BUFFER_SIZE);
+    return true;
+}
+
+FileFindBase::DirectoryHandle FileFindNt::GetDirectoryHandle() const
+{
+    return m_Handle;
 }
 
-DWORD FileFindEnhanced::GetAttributes() const
+const std::wstring& FileFindNt::GetBase() const
+{
+    if (m_Base.empty() && m_Resolver) m_Base = MakeNtPath(m_Resolver());
+    return m_Base;
+}
+
+std::wstring FileFindNt::MakeNtPath(const std::wstring& path)
+{
+    if (path.find(L":\\", 1) == 1) return m_Dos + path;
+    if (path.starts_with(L"\\\\")) return m_DosUNC + path.substr(2);
+    return path;
+}
+
+DWORD FileFindNt::GetAttributes() const
 {
     return m_CurrentInfo->FileAttributes;
 }
 
-std::wstring FileFindEnhanced::GetFileName() const
+DWORD FileFindNt::GetReparseTag() const
 {
-    return m_Name;
+    if ((m_CurrentInfo->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) return 0;
+    return m_Extended ? static_cast<FILE_ID_EXTD_DIR_INFORMATION*>(m_CurrentInfo)->ReparsePointTag :
+        static_cast<FILE_FULL_DIR_INFORMATION*>(m_CurrentInfo)->EaSize;
 }
 
-ULONGLONG FileFindEnhanced::GetFileSizePhysical() const
+ULONGLONG FileFindNt::GetFileSizePhysical() const
 {
-    if (m_CurrentInfo->AllocationSize.QuadPart == 0 &&
-        m_CurrentInfo->EndOfFile.QuadPart != 0)
+    if (NeedsFileSizePhysicalLookup())
     {
-        m_CurrentInfo->AllocationSize.LowPart  = GetCompressedFileSize(GetFilePathLong().c_str(),
-            reinterpret_cast<LPDWORD>(&m_CurrentInfo->AllocationSize.HighPart));
+        m_CurrentInfo->AllocationSize.QuadPart = QueryFileSizePhysical(GetFilePathLong());
     }
 
     return m_CurrentInfo->AllocationSize.QuadPart;
 }
 
-ULONGLONG FileFindEnhanced::GetFileSizeLogical() const
+// Deduplicated, cloud and some network files report no allocation size
+// while enumerating so their physical size has to be queried separately
+bool FileFindNt::NeedsFileSizePhysicalLookup() const
+{
+    return m_CurrentInfo->AllocationSize.QuadPart == 0 &&
+        m_CurrentInfo->EndOfFile.QuadPart != 0;
+}
+
+ULONGLONG FileFindNt::QueryFileSizePhysical(const std::wstring& pathLong)
+{
+    ULARGE_INTEGER size;
+    size.LowPart = GetCompressedFileSize(pathLong.c_str(), &size.HighPart);
+    return size.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR ? 0 : size.QuadPart;
+}
+
+ULONGLONG FileFindNt::GetFileSizeLogical() const
 {
     return m_CurrentInfo->EndOfFile.QuadPart;
 }
 
-FILETIME FileFindEnhanced::GetLastWriteTime() const
+FILETIME FileFindNt::GetLastWriteTime() const
 {
     return { m_CurrentInfo->LastWriteTime.LowPart,
         static_cast<DWORD>(m_CurrentInfo->LastWriteTime.HighPart) };
 }
 
-std::wstring FileFindEnhanced::GetFilePath() const
+std::wstring FileFindNt::GetFilePath() const
 {
     // Get full path to folder or file
-    std::wstring path = (m_Base.at(m_Base.size() - 1) == L'\\') ?
-        (m_Base + m_Name) : (m_Base + L"\\" + m_Name);
+    const std::wstring& base = GetBase();
+    std::wstring path = (base.at(base.size() - 1) == L'\\') ?
+        (base + m_Name) : (base + L"\\" + m_Name);
 
     // Strip special dos chars
     if (wcsncmp(path.data(), m_DosUNC, wcslen(m_DosUNC) - 1) == 0)
@@ -197,19 +360,19 @@ std::wstring FileFindEnhanced::GetFilePath() const
     return path;
 }
 
-std::wstring FileFindEnhanced::GetFilePathLong() const
+std::wstring FileFindNt::GetFilePathLong() const
 {
     return MakeLongPathCompatible(GetFilePath());
 }
 
-std::wstring FileFindEnhanced::MakeLongPathCompatible(const std::wstring & path)
+std::wstring FileFindNt::MakeLongPathCompatible(const std::wstring & path)
 {
     if (path.find(L":\\", 1) == 1) return { m_Long + path };
     if (path.starts_with(L"\\\\")) return { m_LongUNC + path.substr(2) };
     return path;
 }
 
-bool FileFindEnhanced::DoesFileExist(const std::wstring& folder, const std::wstring& file)
+bool FileFindNt::DoesFileExist(const std::wstring& folder, const std::wstring& file)
 {
     return GetFileAttributes(MakeLongPathCompatible(folder + 
         (file.empty() ? L"" : (L"\\" + file))).c_str()) != INVALID_FILE_ATTRIBUTES;
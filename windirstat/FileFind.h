@@ -21,11 +21,146 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include <stdafx.h>
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
-class FileFindEnhanced final
+//
+// FileFindBase. Abstract directory enumeration interface used by the scan
+// engine. Backends report the current entry's name, attributes (mapped to
+// FILE_ATTRIBUTE_* values), logical and physical size and last write time.
+//
+// Directories can either be opened by full path or relative to the shared
+// handle of an already open parent directory. In the latter case the full
+// path is only built through the supplied resolver if it is asked for.
+//
+class FileFindBase
 {
+public:
+
+    using DirectoryHandle = std::shared_ptr<void>;
+    using PathResolver = std::function<std::wstring()>;
+
+private:
+
+    // Directories held open for children that are still queued; beyond
+    // this they are opened by path instead so descriptors do not run out
+#ifdef _WIN32
+    static constexpr size_t MAXIMUM_RETAINED_HANDLES = 8192;
+#else
+    static constexpr size_t MAXIMUM_RETAINED_HANDLES = 256;
+#endif
+    static inline std::atomic<size_t> s_RetainedHandles = 0;
+    mutable DirectoryHandle m_Retained;
+
+protected:
+
+    std::wstring m_Name;
+    DWORD m_OpenError = 0;
+
+public:
+
+    FileFindBase() = default;
+    FileFindBase(const FileFindBase&) = delete;
+    FileFindBase& operator=(const FileFindBase&) = delete;
+    virtual ~FileFindBase() = default;
+
+    virtual bool FindNextFile() = 0;
+    virtual bool FindFile(const std::wstring& strFolder, const std::wstring& strName = L"") = 0;
+    virtual bool FindFileRelative(const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver) = 0;
+    virtual DirectoryHandle GetDirectoryHandle() const = 0;
+    virtual DWORD GetAttributes() const = 0;
+    virtual DWORD GetReparseTag() const = 0;
+    virtual ULONGLONG GetFileSizePhysical() const = 0;
+    virtual bool NeedsFileSizePhysicalLookup() const = 0;
+    virtual ULONGLONG GetFileSizeLogical() const = 0;
+    virtual FILETIME GetLastWriteTime() const = 0;
+    virtual std::wstring GetFilePath() const = 0;
+    virtual std::wstring GetFilePathLong() const = 0;
+
+    // Shares the open directory with children that are queued for
+    // enumeration; nothing is returned once too many are held open
+    DirectoryHandle RetainDirectoryHandle() const
+    {
+        const DirectoryHandle handle = GetDirectoryHandle();
+        if (handle == nullptr) return nullptr;
+        if (m_Retained != nullptr && m_Retained.get() == handle.get()) return m_Retained;
+
+        if (s_RetainedHandles.fetch_add(1) >= MAXIMUM_RETAINED_HANDLES)
+        {
+            s_RetainedHandles.fetch_sub(1);
+            return nullptr;
+        }
+        m_Retained = DirectoryHandle(handle.get(), [handle](void*) { s_RetainedHandles.fetch_sub(1); });
+        return m_Retained;
+    }
+
+    // Status of the last failed attempt to open a directory (NTSTATUS or
+    // errno depending on the backend) or zero if it was opened
+    DWORD GetOpenError() const
+    {
+        return m_OpenError;
+    }
+
+    std::wstring GetFileName() const
+    {
+        return m_Name;
+    }
+
+    bool IsDots() const
+    {
+        return m_Name == L"." || m_Name == L"..";
+    }
+
+    bool IsDirectory() const
+    {
+        return (GetAttributes() & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    bool IsHidden() const
+    {
+        return (GetAttributes() & FILE_ATTRIBUTE_HIDDEN) != 0;
+    }
+
+    bool IsHiddenSystem() const
+    {
+        constexpr DWORD hiddenSystem = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM;
+        return (GetAttributes() & hiddenSystem) == hiddenSystem;
+    }
+
+    bool IsProtectedReparsePoint() const
+    {
+        constexpr DWORD protect = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_REPARSE_POINT;
+        return (GetAttributes() & protect) == protect;
+    }
+};
+
+#ifdef _WIN32
+
+//
+// FileFindNt. Enumeration backend built on NtOpenFile / NtQueryDirectoryFile.
+//
+// Entries are read as FileIdExtdDirectoryInformation, which carries the
+// reparse tag so that follow and skip decisions need no further I/O. File
+// systems that do not support it fall back to FileFullDirectoryInformation,
+// where the extended attribute size field holds the tag of reparse points.
+//
+// Besides the synchronous interface, a finder can be bound to a completion
+// port so a worker can keep queries for several directories in flight. The
+// query buffer starts at a size based on what recent directories returned
+// and doubles while queries keep filling it.
+//
+class FileFindNt final : public FileFindBase
+{
+    // Fields shared by all directory information classes used here
     using FILE_DIRECTORY_INFORMATION = struct {
         ULONG         NextEntryOffset;
         ULONG         FileIndex;
@@ -37,39 +172,92 @@ class FileFindEnhanced final
         LARGE_INTEGER AllocationSize;
         ULONG         FileAttributes;
         ULONG         FileNameLength;
+    };
+
+    using FILE_FULL_DIR_INFORMATION = struct : FILE_DIRECTORY_INFORMATION {
+        ULONG         EaSize;
+        WCHAR         FileName[1];
+    };
+
+    using FILE_ID_EXTD_DIR_INFORMATION = struct : FILE_DIRECTORY_INFORMATION {
+        ULONG         EaSize;
+        ULONG         ReparsePointTag;
+        BYTE          FileId[16];
         WCHAR         FileName[1];
     };
 
+    static constexpr ULONG MINIMUM_BUFFER_SIZE = 4 * 1024;
+    static constexpr ULONG INITIAL_BUFFER_SIZE = 64 * 1024;
+    static constexpr ULONG MAXIMUM_BUFFER_SIZE = 1024 * 1024;
+
+    // Running estimate of how much the first query of a directory returns
+    static inline thread_local ULONG s_TypicalSize = INITIAL_BUFFER_SIZE / 2;
+
     std::wstring m_Search;
-    std::wstring m_Base;
-    std::wstring m_Name;
-    HANDLE m_Handle = nullptr;
+    mutable std::wstring m_Base;
+    PathResolver m_Resolver;
+    DirectoryHandle m_Handle;
     bool m_Firstrun = true;
+    bool m_Extended = true;
+    bool m_Ended = false;
+    bool m_Pending = false;
+    ULONG m_BufferSize = INITIAL_BUFFER_SIZE;
     FILE_DIRECTORY_INFORMATION* m_CurrentInfo = nullptr;
+    HANDLE m_Port = nullptr;
+    OVERLAPPED m_Overlapped = {};
+    std::vector<BYTE> m_Buffer;
     static constexpr auto m_Dos = L"\\??\\";
     static constexpr auto m_DosUNC = L"\\??\\UNC\\";
     static constexpr auto m_Long = L"\\\\?\\";
     static constexpr auto m_LongUNC = L"\\\\?\\UNC\\";
 
+    bool OpenDirectory(HANDLE root, std::wstring& path);
+    LONG QueryDirectory(BYTE* buffer, PVOID status, PVOID context);
+    bool FallBackToFullInformation(LONG status);
+    void AdaptBufferSize(ULONG_PTR bytes);
+    void LoadCurrentEntry();
+    const std::wstring& GetBase() const;
+    static std::wstring MakeNtPath(const std::wstring& path);
+
 public:
 
-    FileFindEnhanced() = default;
-    ~FileFindEnhanced();
-
-    bool FindNextFile();
-    bool FindFile(const std::wstring& strFolder,const std::wstring& strName = L"");
-    bool IsDirectory() const;
-    bool IsDots() const;
-    bool IsHidden() const;
-    bool IsHiddenSystem() const;
-    bool IsProtectedReparsePoint() const;
-    DWORD GetAttributes() const;
-    std::wstring GetFileName() const;
-    ULONGLONG GetFileSizePhysical() const;
-    ULONGLONG GetFileSizeLogical() const;
-    FILETIME GetLastWriteTime() const;
-    std::wstring GetFilePath() const;
-    std::wstring GetFilePathLong() const;
+    FileFindNt() = default;
+
+    bool FindNextFile() override;
+    bool FindFile(const std::wstring& strFolder,const std::wstring& strName = L"") override;
+    bool FindFileRelative(const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver) override;
+
+    // Overlapped enumeration: opens the directory (relative to the parent if
+    // given), binds it to the port under the key and issues the first query.
+    // Once the key is dequeued, CompleteQuery() positions on the first entry
+    // of the buffer and FindNextFile() walks the rest of it; QueryAsync()
+    // then asks for more and returns false once the directory is exhausted.
+    bool FindFileAsync(HANDLE port, ULONG_PTR key, const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver);
+    bool QueryAsync();
+    bool CompleteQuery();
+    bool IsQueryPending() const;
+    void CancelQuery();
+
+    DirectoryHandle GetDirectoryHandle() const override;
+    DWORD GetAttributes() const override;
+    DWORD GetReparseTag() const override;
+    ULONGLONG GetFileSizePhysical() const override;
+    bool NeedsFileSizePhysicalLookup() const override;
+    ULONGLONG GetFileSizeLogical() const override;
+    FILETIME GetLastWriteTime() const override;
+    std::wstring GetFilePath() const override;
+    std::wstring GetFilePathLong() const override;
     static bool DoesFileExist(const std::wstring& folder, const std::wstring& file = {});
     static std::wstring MakeLongPathCompatible(const std::wstring& path);
+    static ULONGLONG QueryFileSizePhysical(const std::wstring& pathLong);
 };
+
+using FileFindEnhanced = FileFindNt;
+
+#else
+
+#include "FileFindPosix.h"
+
+using FileFindEnhanced = FileFindPosix;
+
+#endif
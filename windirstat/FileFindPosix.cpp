@@ -0,0 +1,348 @@
+// FileFindPosix.cpp - Implementation of FileFindPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef _WIN32
+
+#include "FileFind.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    // Layout returned by the getdents64 system call
+    struct linux_dirent64
+    {
+        ino64_t        d_ino;
+        off64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[1];
+    };
+
+    // Number of 100ns intervals between 1601-01-01 and 1970-01-01
+    constexpr ULONGLONG EPOCH_DIFFERENCE = 116444736000000000ull;
+
+    FILETIME ToFileTime(const timespec& ts)
+    {
+        const ULONGLONG ticks = EPOCH_DIFFERENCE +
+            static_cast<ULONGLONG>(ts.tv_sec) * 10000000ull + static_cast<ULONGLONG>(ts.tv_nsec) / 100ull;
+        return { static_cast<DWORD>(ticks), static_cast<DWORD>(ticks >> 32) };
+    }
+}
+
+bool FileFindPosix::FindNextFile()
+{
+    for (StatBatchPosix::STATINFO info;;)
+    {
+        // request the next buffer of entries once all results have been taken
+        if (!m_Batch.Next(info))
+        {
+            if (!FillBatch()) return false;
+            continue;
+        }
+
+        // skip entries that vanished between enumeration and stat
+        if (info.m_Error != 0) continue;
+
+        LoadEntry(info);
+        m_Name = FromNativePath(info.m_Name);
+        return true;
+    }
+}
+
+bool FileFindPosix::FillBatch()
+{
+    constexpr auto BUFFER_SIZE = 64 * 1024;
+    m_DirectoryInfo.resize(BUFFER_SIZE);
+
+    // a buffer without matching names simply moves on to the next one
+    std::vector<const char*> names;
+    while (names.empty())
+    {
+        const long read = syscall(SYS_getdents64, m_Descriptor, m_DirectoryInfo.data(), BUFFER_SIZE);
+        if (read <= 0) return false;
+
+        for (size_t pos = 0; pos < static_cast<size_t>(read);)
+        {
+            const auto entry = reinterpret_cast<const linux_dirent64*>(&m_DirectoryInfo[pos]);
+            pos += entry->d_reclen;
+
+            // handle optional pattern mask
+            if (!m_Search.empty() && fnmatch(m_Search.c_str(), entry->d_name, FNM_CASEFOLD) != 0)
+            {
+                continue;
+            }
+            names.push_back(entry->d_name);
+        }
+    }
+
+    m_Batch.Submit(m_Descriptor, std::move(names));
+    return true;
+}
+
+bool FileFindPosix::FindFile(const std::wstring& strFolder, const std::wstring& strName)
+{
+    // stash the search pattern for later use
+    m_Search = ToNativePath(strName);
+    m_Base = strFolder;
+    m_Resolver = nullptr;
+
+    if (!OpenDirectory(AT_FDCWD, m_Base))
+    {
+        return false;
+    }
+
+    // do initial search
+    return FindNextFile();
+}
+
+bool FileFindPosix::FindFileRelative(const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver)
+{
+    // the full path is only resolved if something asks for it
+    m_Search.clear();
+    m_Base.clear();
+    m_Resolver = resolver;
+
+    if (!OpenDirectory(*static_cast<int*>(parent.get()), strFolder))
+    {
+        return false;
+    }
+
+    // do initial search
+    return FindNextFile();
+}
+
+bool FileFindPosix::OpenDirectory(const int root, const std::wstring& path)
+{
+    m_Batch.Reset();
+    m_Handle.reset();
+
+    m_Descriptor = openat(root, ToNativePath(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_Descriptor == -1)
+    {
+        m_OpenError = errno;
+        return false;
+    }
+    m_OpenError = 0;
+
+    // the descriptor stays open for as long as any child still needs it
+    m_Handle = DirectoryHandle(new int(m_Descriptor), [](void* descriptor)
+    {
+        close(*static_cast<int*>(descriptor));
+        delete static_cast<int*>(descriptor);
+    });
+    return true;
+}
+
+FileFindBase::DirectoryHandle FileFindPosix::GetDirectoryHandle() const
+{
+    return m_Handle;
+}
+
+const std::wstring& FileFindPosix::GetBase() const
+{
+    if (m_Base.empty() && m_Resolver) m_Base = m_Resolver();
+    return m_Base;
+}
+
+void FileFindPosix::LoadEntry(const StatBatchPosix::STATINFO& info)
+{
+    const char* name = info.m_Name;
+
+    // Map the file type; symbolic links are treated like reparse points so
+    // that they are not followed unless the user asks for it
+    m_Attributes = 0;
+    if (S_ISLNK(info.m_Mode))
+    {
+        m_Attributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+        if (struct stat target; fstatat(m_Descriptor, name, &target, 0) == 0 && S_ISDIR(target.st_mode))
+        {
+            m_Attributes |= FILE_ATTRIBUTE_DIRECTORY;
+        }
+    }
+    else if (S_ISDIR(info.m_Mode)) m_Attributes |= FILE_ATTRIBUTE_DIRECTORY;
+    else if (!S_ISREG(info.m_Mode)) m_Attributes |= FILE_ATTRIBUTE_DEVICE;
+
+    // Map the conventional dot-file and permission semantics
+    if (name[0] == '.' && name[1] != '\0' && !(name[1] == '.' && name[2] == '\0'))
+    {
+        m_Attributes |= FILE_ATTRIBUTE_HIDDEN;
+    }
+    if ((info.m_Mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0)
+    {
+        m_Attributes |= FILE_ATTRIBUTE_READONLY;
+    }
+
+    // Only regular files carry a meaningful size
+    const bool regular = S_ISREG(info.m_Mode);
+    m_SizeLogical = regular ? info.m_Size : 0;
+    m_SizePhysical = regular ? info.m_Blocks * 512ull : 0;
+    if (regular && m_SizePhysical < m_SizeLogical)
+    {
+        m_Attributes |= FILE_ATTRIBUTE_SPARSE_FILE;
+    }
+
+    if (m_Attributes == 0) m_Attributes = FILE_ATTRIBUTE_NORMAL;
+    m_LastWriteTime = ToFileTime(info.m_LastWrite);
+}
+
+DWORD FileFindPosix::GetAttributes() const
+{
+    return m_Attributes;
+}
+
+// Symbolic links are the only kind of reparse point reported here
+DWORD FileFindPosix::GetReparseTag() const
+{
+    return (m_Attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 ? IO_REPARSE_TAG_SYMLINK : 0;
+}
+
+ULONGLONG FileFindPosix::GetFileSizePhysical() const
+{
+    return m_SizePhysical;
+}
+
+// The block count from stat() is always accurate
+bool FileFindPosix::NeedsFileSizePhysicalLookup() const
+{
+    return false;
+}
+
+ULONGLONG FileFindPosix::QueryFileSizePhysical(const std::wstring& pathLong)
+{
+    struct stat st;
+    return stat(ToNativePath(pathLong).c_str(), &st) == 0 ? st.st_blocks * 512ull : 0;
+}
+
+ULONGLONG FileFindPosix::GetFileSizeLogical() const
+{
+    return m_SizeLogical;
+}
+
+FILETIME FileFindPosix::GetLastWriteTime() const
+{
+    return m_LastWriteTime;
+}
+
+std::wstring FileFindPosix::GetFilePath() const
+{
+    const std::wstring& base = GetBase();
+    return (!base.empty() && base.back() == L'/') ?
+        (base + m_Name) : (base + L"/" + m_Name);
+}
+
+std::wstring FileFindPosix::GetFilePathLong() const
+{
+    return GetFilePath();
+}
+
+std::wstring FileFindPosix::MakeLongPathCompatible(const std::wstring& path)
+{
+    return path;
+}
+
+bool FileFindPosix::DoesFileExist(const std::wstring& folder, const std::wstring& file)
+{
+    struct stat st;
+    const std::wstring path = file.empty() ? folder : (folder + L"/" + file);
+    return lstat(ToNativePath(path).c_str(), &st) == 0;
+}
+
+std::string FileFindPosix::ToNativePath(const std::wstring& path)
+{
+    std::string out;
+    out.reserve(path.size());
+    for (const wchar_t wc : path)
+    {
+        const auto c = static_cast<char32_t>(wc);
+        if (c >= 0xDC80 && c <= 0xDCFF)
+        {
+            // restore a raw byte that was not valid UTF-8
+            out.push_back(static_cast<char>(c - 0xDC00));
+        }
+        else if (c < 0x80)
+        {
+            out.push_back(static_cast<char>(c));
+        }
+        else if (c < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+        else if (c < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+    }
+    return out;
+}
+
+std::wstring FileFindPosix::FromNativePath(const std::string_view path)
+{
+    std::wstring out;
+    out.reserve(path.size());
+    for (size_t i = 0; i < path.size();)
+    {
+        const auto lead = static_cast<unsigned char>(path[i]);
+        const size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+
+        // validate continuation bytes
+        bool valid = length > 0 && i + length <= path.size();
+        char32_t c = length == 1 ? lead : length == 2 ? (lead & 0x1F) : length == 3 ? (lead & 0x0F) : (lead & 0x07);
+        for (size_t j = 1; valid && j < length; j++)
+        {
+            const auto next = static_cast<unsigned char>(path[i + j]);
+            valid = (next & 0xC0) == 0x80;
+            c = (c << 6) | (next & 0x3F);
+        }
+
+        // reject overlong encodings, surrogates and out of range values
+        constexpr char32_t minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        valid = valid && c >= minimum[length] && c <= 0x10FFFF && (c < 0xD800 || c > 0xDFFF);
+
+        if (valid)
+        {
+            out.push_back(static_cast<wchar_t>(c));
+            i += length;
+        }
+        else
+        {
+            out.push_back(static_cast<wchar_t>(0xDC00 + lead));
+            i += 1;
+        }
+    }
+    return out;
+}
+
+#endif
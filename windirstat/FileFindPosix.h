@@ -0,0 +1,83 @@
+// FileFindPosix.h - Declaration of FileFindPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "FileFind.h"
+#include "StatBatchPosix.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+//
+// FileFindPosix. Enumeration backend built on openat / getdents64 / statx.
+// The metadata of all names in a getdents64 buffer is requested at once
+// through StatBatchPosix and entries are returned as their results arrive.
+// Sizes come from st_size (logical) and st_blocks (physical) and the POSIX
+// file type and mode bits are mapped onto the equivalent FILE_ATTRIBUTE_* flags.
+// Names are converted from UTF-8; undecodable bytes are carried as lone
+// surrogates (U+DC80 - U+DCFF) so the original name can be rebuilt exactly.
+//
+class FileFindPosix final : public FileFindBase
+{
+    std::string m_Search;
+    mutable std::wstring m_Base;
+    PathResolver m_Resolver;
+    DirectoryHandle m_Handle;
+    int m_Descriptor = -1;
+    std::vector<BYTE> m_DirectoryInfo;
+    StatBatchPosix m_Batch;
+    DWORD m_Attributes = 0;
+    ULONGLONG m_SizeLogical = 0;
+    ULONGLONG m_SizePhysical = 0;
+    FILETIME m_LastWriteTime = {};
+
+    bool OpenDirectory(int root, const std::wstring& path);
+    bool FillBatch();
+    void LoadEntry(const StatBatchPosix::STATINFO& info);
+    const std::wstring& GetBase() const;
+
+public:
+
+    FileFindPosix() = default;
+
+    bool FindNextFile() override;
+    bool FindFile(const std::wstring& strFolder, const std::wstring& strName = L"") override;
+    bool FindFileRelative(const DirectoryHandle& parent, const std::wstring& strFolder, const PathResolver& resolver) override;
+    DirectoryHandle GetDirectoryHandle() const override;
+    DWORD GetAttributes() const override;
+    DWORD GetReparseTag() const override;
+    ULONGLONG GetFileSizePhysical() const override;
+    bool NeedsFileSizePhysicalLookup() const override;
+    static ULONGLONG QueryFileSizePhysical(const std::wstring& pathLong);
+    ULONGLONG GetFileSizeLogical() const override;
+    FILETIME GetLastWriteTime() const override;
+    std::wstring GetFilePath() const override;
+    std::wstring GetFilePathLong() const override;
+    static bool DoesFileExist(const std::wstring& folder, const std::wstring& file = {});
+    static std::wstring MakeLongPathCompatible(const std::wstring& path);
+    static std::string ToNativePath(const std::wstring& path);
+    static std::wstring FromNativePath(std::string_view path);
+};
+
+#endif
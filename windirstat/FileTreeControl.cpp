@@ -27,6 +27,8 @@
 #include "FileTreeView.h"
 #include "Localization.h"
 
+#include <algorithm>
+
 CFileTreeControl::CFileTreeControl() : CTreeListControl(20, COptions::FileTreeColumnOrder.Ptr(), COptions::FileTreeColumnWidths.Ptr())
 {
     m_Singleton = this;
@@ -37,6 +39,25 @@ bool CFileTreeControl::GetAscendingDefault(const int column)
     return column == COL_NAME || column == COL_LASTCHANGE;
 }
 
+// Samples the read jobs of the rows on screen so that scanning threads
+// never have to touch any animation state themselves
+void CFileTreeControl::DrivePacmen()
+{
+    if (!COptions::PacmanAnimation)
+    {
+        return;
+    }
+
+    const int last = std::min(GetTopIndex() + GetCountPerPage() + 1, GetItemCount());
+    for (int i = std::max(GetTopIndex(), 0); i < last; i++)
+    {
+        const auto item = reinterpret_cast<const CItem*>(GetItem(i));
+        if (item->IsType(IT_FILE)) continue;
+        if (item->GetReadJobs() == 0) item->StopPacman();
+        else item->DrivePacman();
+    }
+}
+
 #pragma warning(push)
 #pragma warning(disable:26454)
 BEGIN_MESSAGE_MAP(CFileTreeControl, CTreeListControl)
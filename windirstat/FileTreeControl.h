@@ -29,6 +29,7 @@ class CFileTreeControl final : public CTreeListControl
 public:
     CFileTreeControl();
     bool GetAscendingDefault(int column) override;
+    void DrivePacmen();
     static CFileTreeControl* Get() { return m_Singleton; }
 
 protected:
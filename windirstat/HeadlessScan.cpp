@@ -0,0 +1,524 @@
+// HeadlessScan.cpp - Implementation of CHeadlessScan
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifdef _WIN32
+#include "stdafx.h"
+#include "DirStatDoc.h"
+#include "FileDupeControl.h"
+#include "GlobalHelpers.h"
+#include "Localization.h"
+#include "MftReader.h"
+#include <format>
+#else
+#include <fmt/xchar.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BlockingQueue.h"
+#include "CsvLoader.h"
+#include "HeadlessScan.h"
+#include "Item.h"
+#include "MemoryUsage.h"
+#include "Options.h"
+#include "TokenBucket.h"
+#include <common/Constants.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <ranges>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+static constexpr auto usage =
+    L"Usage: windirstat --scan <path>... --output <file> [options]\n"
+    L"\n"
+    L"  --scan <path>...          Drives or a single folder to scan\n"
+    L"  --output <file>           CSV file that receives the results\n"
+    L"  --threads <n>             Scanning threads per drive\n"
+    L"  --duplicates              Detect duplicate files while scanning\n"
+    L"  --query-rate-limit <n>    Maximum folders per second read per drive\n"
+    L"  --hash-rate-limit <n>     Maximum megabytes per second hashed per drive\n"
+    L"  --control <file>          File with rate limits to apply while scanning,\n"
+    L"                            one per line, e.g. query-rate-limit 500\n";
+#else
+static constexpr auto usage =
+    L"Usage: windirstat-headless --scan <path> --output <file> [options]\n"
+    L"\n"
+    L"  --scan <path>             Folder to scan\n"
+    L"  --output <file>           CSV file that receives the results\n"
+    L"  --threads <n>             Scanning threads per file system\n"
+    L"  --query-rate-limit <n>    Maximum folders per second read per file system\n"
+    L"  --control <file>          File with rate limits to apply while scanning,\n"
+    L"                            one per line, e.g. query-rate-limit 500\n";
+#endif
+
+namespace
+{
+    template <typename... Args>
+    std::wstring Format(const std::wstring_view format, const Args&... args)
+    {
+#ifdef _WIN32
+        return std::vformat(format, std::make_wformat_args(args...));
+#else
+        return fmt::vformat(fmt::wstring_view(format.data(), format.size()), fmt::make_wformat_args(args...));
+#endif
+    }
+
+    // Numeric options are clamped to the same range the settings dialog allows
+    bool ParseSetting(const std::wstring& value, Setting<int>& setting, const int minimum, const int maximum)
+    {
+        wchar_t* end = nullptr;
+        const long parsed = wcstol(value.c_str(), &end, 10);
+        if (value.empty() || *end != wds::chrNull) return false;
+        setting = std::clamp(static_cast<int>(parsed), minimum, maximum);
+        return true;
+    }
+
+    std::filesystem::path ToFileSystemPath(const std::wstring& path)
+    {
+#ifdef _WIN32
+        return path;
+#else
+        return FileFindPosix::ToNativePath(path);
+#endif
+    }
+
+#ifndef _WIN32
+    // GlobalHelpers is not part of this build; same output without localization
+    std::wstring FormatCount(const ULONGLONG n)
+    {
+        std::wstring text = std::to_wstring(n);
+        for (auto i = static_cast<std::ptrdiff_t>(text.size()) - 3; i > 0; i -= 3)
+        {
+            text.insert(static_cast<size_t>(i), 1, L',');
+        }
+        return text;
+    }
+
+    std::wstring FormatBytes(const ULONGLONG n)
+    {
+        constexpr std::array units = { L"Bytes", L"KiB", L"MiB", L"GiB", L"TiB", L"PiB" };
+        if (n < 1024) return Format(L"{} {}", n, units[0]);
+
+        double value = static_cast<double>(n);
+        size_t unit = 0;
+        for (; value >= 1024.0 && unit + 1 < units.size(); unit++) value /= 1024.0;
+        return Format(L"{:.1f} {}", value, units[unit]);
+    }
+
+    std::wstring FormatMilliseconds(const ULONGLONG ms)
+    {
+        const ULONGLONG sec = (ms + 500) / 1000;
+        const ULONGLONG s = sec % 60;
+        const ULONGLONG min = sec / 60;
+        const ULONGLONG m = min % 60;
+        const ULONGLONG h = min / 60;
+        return (h <= 0) ? Format(L"{}:{:02}", m, s) : Format(L"{}:{:02}:{:02}", h, m, s);
+    }
+
+    bool FolderExists(const std::wstring& path)
+    {
+        struct stat st;
+        return stat(FileFindPosix::ToNativePath(path).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+#endif
+}
+
+bool CHeadlessScan::IsRequested(const std::vector<std::wstring>& args)
+{
+    return std::ranges::find(args, L"--scan") != args.end();
+}
+
+bool CHeadlessScan::ParseArguments(const std::vector<std::wstring>& args)
+{
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::wstring& arg = args[i];
+        const bool hasValue = i + 1 < args.size() && !args[i + 1].starts_with(L"--");
+        if (arg == L"--scan")
+        {
+            for (; i + 1 < args.size() && !args[i + 1].starts_with(L"--"); i++)
+            {
+                m_Paths.emplace_back(args[i + 1]);
+            }
+        }
+        else if (arg == L"--output" && hasValue)
+        {
+            m_Output = args[++i];
+        }
+        else if (arg == L"--threads" && hasValue)
+        {
+            if (!ParseSetting(args[++i], COptions::ScanningThreads, 1, 16)) return false;
+            COptions::AdaptiveScanningThreads = false;
+        }
+        else if (arg == L"--control" && hasValue)
+        {
+            m_Control = args[++i];
+        }
+        else if (arg == L"--query-rate-limit" && hasValue)
+        {
+            if (!ParseSetting(args[++i], COptions::ScanQueryRateLimit, 0, 1000000)) return false;
+        }
+#ifdef _WIN32
+        else if (arg == L"--hash-rate-limit" && hasValue)
+        {
+            if (!ParseSetting(args[++i], COptions::HashRateLimit, 0, 100000)) return false;
+        }
+        else if (arg == L"--duplicates")
+        {
+            COptions::ScanForDuplicates = true;
+        }
+#endif
+        else return false;
+    }
+
+    return !m_Paths.empty() && !m_Output.empty();
+}
+
+void CHeadlessScan::ReadControlFile()
+{
+    // The scanning threads take the limits on every reservation, so changed
+    // settings apply right away; the file is only read once it was written
+    std::error_code error;
+    const auto lastWrite = std::filesystem::last_write_time(ToFileSystemPath(m_Control), error);
+    if (error || lastWrite == m_ControlWritten) return;
+    m_ControlWritten = lastWrite;
+
+    std::ifstream file(ToFileSystemPath(m_Control));
+    for (std::string line; std::getline(file, line);)
+    {
+        // Only plain ASCII is expected: "<name> <value>"
+        const std::wstring text(line.begin(), line.end());
+        const size_t separator = text.find(L' ');
+        if (separator == std::wstring::npos) continue;
+        const std::wstring name = text.substr(0, separator);
+        std::wstring value = text.substr(separator + 1);
+        while (!value.empty() && (value.back() == L'\r' || value.back() == L' ')) value.pop_back();
+
+        Setting<int>* setting = nullptr;
+        bool valid = false;
+        if (name == L"query-rate-limit")
+        {
+            setting = &COptions::ScanQueryRateLimit;
+            valid = ParseSetting(value, COptions::ScanQueryRateLimit, 0, 1000000);
+        }
+#ifdef _WIN32
+        else if (name == L"hash-rate-limit")
+        {
+            setting = &COptions::HashRateLimit;
+            valid = ParseSetting(value, COptions::HashRateLimit, 0, 100000);
+        }
+#endif
+        Print(setting == nullptr ? Format(L"Unknown setting in {}: {}\n", m_Control, name) :
+            valid ? Format(L"Set {} to {}\n", name, setting->Obj()) :
+            Format(L"Invalid value in {}: {}\n", m_Control, text));
+    }
+}
+
+CItem* CHeadlessScan::CreateRootItem() const
+{
+#ifndef _WIN32
+    // Without drives there is nothing that could be grouped below a root
+    if (m_Paths.size() > 1)
+    {
+        Print(L"Only a single folder can be scanned\n");
+        return nullptr;
+    }
+
+    std::wstring path = m_Paths[0];
+    while (path.size() > 1 && path.back() == wds::chrPathSeparator) path.pop_back();
+    if (!FolderExists(path))
+    {
+        Print(Format(L"Cannot open {}\n", path));
+        return nullptr;
+    }
+
+    const auto root = new (CItemArena::Create()) CItem(IT_DIRECTORY | ITF_ROOTITEM, path);
+    root->UpdateStatsFromDisk();
+    return root;
+#else
+    std::vector<std::wstring> folders;
+    for (std::wstring path : m_Paths)
+    {
+        // Same normalization as the drive selection dialog
+        if (path.size() == 2 && path[1] == wds::chrColon) path += wds::chrBackslash;
+        else if (path.size() > 3 && path.back() == wds::chrBackslash) path.pop_back();
+
+        if (!FolderExists(path))
+        {
+            Print(Format(L"Cannot open {}\n", path));
+            return nullptr;
+        }
+        folders.emplace_back(path);
+    }
+
+    // Multiple selections are placed below My Computer which only holds drives
+    if (folders.size() > 1)
+    {
+        if (!std::ranges::all_of(folders, CDirStatDoc::IsDrive))
+        {
+            Print(L"Only drives can be scanned together\n");
+            return nullptr;
+        }
+
+        const auto root = new (CItemArena::Create()) CItem(IT_MYCOMPUTER | ITF_ROOTITEM, Localization::Lookup(IDS_MYCOMPUTER));
+        for (const auto& folder : folders)
+        {
+            root->AddChild(new (CItemArena::Of(root)) CItem(IT_DRIVE, folder));
+        }
+        return root;
+    }
+
+    const ITEMTYPE type = CDirStatDoc::IsDrive(folders[0]) ? IT_DRIVE : IT_DIRECTORY;
+    const auto root = new (CItemArena::Create()) CItem(type | ITF_ROOTITEM, folders[0]);
+    root->UpdateStatsFromDisk();
+    return root;
+#endif
+}
+
+bool CHeadlessScan::ScanRootItem(CItem* root)
+{
+    // Same layout as the interactive scanning engine: one queue per volume
+    // and a shared pool for physical size lookups. Volumes are identified by
+    // their mount point on Windows and by their device number elsewhere.
+#ifdef _WIN32
+    using VolumeKey = std::wstring;
+#else
+    using VolumeKey = dev_t;
+#endif
+    std::unordered_map<VolumeKey, BlockingQueue<SCANJOB>> queues;
+    std::unordered_map<VolumeKey, SCANTHROTTLE> throttles;
+    BlockingQueue<CItem*> sizeQueue;
+
+    bool completed = true;
+    root->ResetScanStartTime();
+    for (const auto& item : root->IsType(IT_MYCOMPUTER) ? root->GetChildren() : std::span<CItem* const>(&root, 1))
+    {
+        item->UpwardAddReadJobs(1);
+        item->UpwardSetUndone();
+
+#ifdef _WIN32
+        if (COptions::UseMftScanning && item->IsType(IT_DRIVE) &&
+            LoadFromMft(item, GetVolumeDevicePath(item->GetPath())))
+        {
+            item->UpwardSubtractReadJobs(1);
+            continue;
+        }
+
+        std::array<WCHAR, MAX_PATH> pathName;
+        if (GetVolumePathName(item->GetPathLong().c_str(),
+            pathName.data(), static_cast<DWORD>(pathName.size())) != 0)
+        {
+            queues[pathName.data()].Push(item);
+        }
+        else
+        {
+            Print(Format(L"Cannot determine the volume of {} ({})\n", item->GetPath(), GetLastError()));
+            item->UpwardSubtractReadJobs(1);
+            completed = false;
+        }
+#else
+        if (struct stat st; stat(FileFindPosix::ToNativePath(item->GetPath()).c_str(), &st) == 0)
+        {
+            queues[st.st_dev].Push(item);
+        }
+        else
+        {
+            Print(Format(L"Cannot determine the volume of {} ({})\n", item->GetPath(), errno));
+            item->UpwardSubtractReadJobs(1);
+            completed = false;
+        }
+#endif
+    }
+
+    sizeQueue.StartThreads(COptions::ScanningThreads, [&sizeQueue]()
+    {
+        CItem::ScanSizesPhysical(&sizeQueue);
+    });
+    for (auto& [volume, queue] : queues)
+    {
+        auto& throttle = throttles[volume];
+        queue.StartThreads(COptions::ScanningThreads, [&queue, &sizeQueue, &throttle]()
+        {
+            CItem::ScanItems(&queue, &sizeQueue, &throttle);
+        });
+    }
+
+    // Report progress and pick up changed limits once per second until all
+    // queues have drained
+    std::jthread progress([this, root](const std::stop_token& stop)
+    {
+        std::mutex mutex;
+        std::condition_variable_any wakeup;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                if (wakeup.wait_for(lock, stop, std::chrono::seconds(1), [] { return false; }) || stop.stop_requested()) return;
+            }
+            if (!m_Control.empty()) ReadControlFile();
+            Print(Format(L"Scanned {} folders, {} files, {}, {} in memory\n", FormatCount(root->GetFoldersCount()),
+                FormatCount(root->GetFilesCount()), FormatBytes(root->GetSizePhysical()),
+                FormatBytes(CMemoryUsage::Collect(root).GetTotal())));
+        }
+    });
+
+    for (auto& queue : queues | std::views::values) completed &= queue.WaitForCompletionOrCancellation();
+    if (sizeQueue.HasStarted()) completed &= sizeQueue.WaitForCompletionOrCancellation();
+
+    // The idle workers only end once their queue is cancelled
+    for (auto& queue : queues | std::views::values) queue.CancelExecution();
+    sizeQueue.CancelExecution();
+    return completed;
+}
+
+#ifdef _WIN32
+void CHeadlessScan::ReportDuplicates() const
+{
+    const auto dupes = CFileDupeControl::Get();
+    ULONGLONG sets = 0;
+    ULONGLONG reclaimable = 0;
+    for (const auto& hash : dupes->m_ConfirmedHashes)
+    {
+        const auto& items = dupes->m_HashTracker.at(hash);
+        if (items.size() <= 1) continue;
+        sets++;
+        reclaimable += (items.size() - 1) * (*items.begin())->GetSizePhysical();
+    }
+
+    Print(Format(L"Found {} sets of duplicate files, {} reclaimable\n", FormatCount(sets), FormatBytes(reclaimable)));
+}
+#endif
+
+void CHeadlessScan::ReportMemoryUsage(const CItem* root) const
+{
+    const CMemoryUsage usage = CMemoryUsage::Collect(root);
+    Print(Format(L"Memory: {} for {} items, {} bytes per item\n", FormatBytes(usage.GetTotal()),
+        FormatCount(usage.GetItemCount()), usage.GetTotalPerItem()));
+
+    // Parts belonging to the views are never used without them
+    for (int part = 0; part < CMemoryUsage::PART_COUNT; part++)
+    {
+        const auto id = static_cast<CMemoryUsage::PART>(part);
+        if (usage.GetBytes(id) == 0) continue;
+        Print(Format(L"  {}: {}, {} bytes per item\n", CMemoryUsage::GetPartName(id),
+            FormatBytes(usage.GetBytes(id)), usage.GetBytesPerItem(id)));
+    }
+}
+
+void CHeadlessScan::Print(const std::wstring& text) const
+{
+#ifdef _WIN32
+    if (m_StdOut == nullptr || m_StdOut == INVALID_HANDLE_VALUE) return;
+
+    const int size = WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0, nullptr, nullptr);
+    std::string buffer(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), buffer.data(), size, nullptr, nullptr);
+
+    DWORD written;
+    WriteFile(m_StdOut, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+#else
+    const std::string buffer = FileFindPosix::ToNativePath(text);
+    for (size_t offset = 0; offset < buffer.size();)
+    {
+        const ssize_t written = write(STDOUT_FILENO, buffer.data() + offset, buffer.size() - offset);
+        if (written <= 0) return;
+        offset += static_cast<size_t>(written);
+    }
+#endif
+}
+
+int CHeadlessScan::Run(const std::vector<std::wstring>& args)
+{
+#ifdef _WIN32
+    // The application has no console of its own; use the one of the caller
+    // unless standard output was already redirected to a file or pipe
+    m_StdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if ((m_StdOut == nullptr || m_StdOut == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        SetConsoleOutputCP(CP_UTF8);
+        m_StdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+#endif
+
+    if (!ParseArguments(args))
+    {
+        Print(usage);
+        return 2;
+    }
+
+#ifdef _WIN32
+    if (COptions::UseBackupRestore && !EnableReadPrivileges())
+    {
+        VTRACE(L"Failed to enable additional privileges.");
+    }
+
+    // Duplicates are tracked by the control even though it is never shown
+    CFileDupeControl dupes;
+#endif
+    CItem* root = CreateRootItem();
+    if (root == nullptr) return 2;
+    if (!m_Control.empty()) ReadControlFile();
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool scanned = ScanRootItem(root);
+    CItem::ScanItemsFinalize(root);
+    root->RecurseFreeze();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    Print(Format(L"Finished in {}: {} folders, {} files, {}\n", FormatMilliseconds(elapsed.count()),
+        FormatCount(root->GetFoldersCount()), FormatCount(root->GetFilesCount()), FormatBytes(root->GetSizePhysical())));
+    if (!scanned) Print(L"The scan did not complete; the results are partial\n");
+
+    ReportMemoryUsage(root);
+    const CItemArena* arena = CItemArena::Of(root);
+    Print(Format(L"Name memory: {} stored, {} saved by sharing\n", FormatBytes(arena->GetNameBytes()),
+        FormatBytes(arena->GetNameBytesShared())));
+#ifdef _WIN32
+    if (COptions::ScanForDuplicates) ReportDuplicates();
+#endif
+
+    const bool saved = SaveResults(m_Output, root);
+    Print(saved ? Format(L"Results saved to {}\n", m_Output) : Format(L"Cannot write {}\n", m_Output));
+
+    // The process is about to exit anyway but the time is worth knowing
+    const auto release = std::chrono::steady_clock::now();
+    CItem::DeleteTree(root);
+    Print(Format(L"Released in {}\n", FormatMilliseconds(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - release).count())));
+    return scanned && saved ? 0 : 1;
+}
+
+#ifndef _WIN32
+int main(const int argc, char* argv[])
+{
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; i++) args.emplace_back(FileFindPosix::FromNativePath(argv[i]));
+    return CHeadlessScan().Run(args);
+}
+#endif
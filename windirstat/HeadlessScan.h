@@ -0,0 +1,85 @@
+// HeadlessScan.h - Declaration of CHeadlessScan
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include "stdafx.h"
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class CItem;
+
+//
+// CHeadlessScan. Runs a scan from the command line without creating any
+// windows, e.g. for scheduled scans on servers:
+//
+//   windirstat --scan <path>... --output <file> [--threads N] [--duplicates]
+//              [--query-rate-limit N] [--hash-rate-limit N] [--control <file>]
+//
+// Progress is written to standard output once per second, followed by the
+// memory held by each part of the results. The results are saved in the
+// same CSV format used by File > Save Results. Options given on the command
+// line only apply to this run and are not persisted.
+//
+// The rate limits can be changed during the scan through the control file,
+// which is read at the start and again whenever it is written, e.g.
+//
+//   echo query-rate-limit 200 > control.txt
+//
+// Its values take precedence over those given on the command line.
+//
+// On other systems the windirstat-headless executable runs the same scan
+// for a single folder, without duplicate detection or MFT reading.
+//
+class CHeadlessScan final
+{
+    std::vector<std::wstring> m_Paths;
+    std::wstring m_Output;
+    std::wstring m_Control;
+    std::filesystem::file_time_type m_ControlWritten;
+#ifdef _WIN32
+    HANDLE m_StdOut = nullptr;
+#endif
+
+    bool ParseArguments(const std::vector<std::wstring>& args);
+    void ReadControlFile();
+    CItem* CreateRootItem() const;
+    bool ScanRootItem(CItem* root);
+#ifdef _WIN32
+    void ReportDuplicates() const;
+#endif
+    void ReportMemoryUsage(const CItem* root) const;
+    void Print(const std::wstring& text) const;
+
+public:
+
+    // True if the command line asks for a headless scan
+    static bool IsRequested(const std::vector<std::wstring>& args);
+
+    // Returns the process exit code: 0 on success, 1 if the scan or saving
+    // the results failed and 2 if the command line was invalid
+    int Run(const std::vector<std::wstring>& args);
+};
@@ -19,6 +19,7 @@
 // Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
+#ifdef _WIN32
 #include "stdafx.h"
 #include "aclapi.h"
 #include "sddl.h"
@@ -26,53 +27,99 @@
 #include "WinDirStat.h"
 #include "DirStatDoc.h"
 #include "MainFrame.h"
+#include "TreeMapView.h"
 #include <common/CommonHelpers.h>
 #include "GlobalHelpers.h"
 #include "SelectObject.h"
-#include "Item.h"
-#include "BlockingQueue.h"
+#include "ItemDupe.h"
 #include "Localization.h"
 #include "SmartPointer.h"
+#else
+#include <sys/statvfs.h>
+#endif
+
+#include "Item.h"
+#include "BlockingQueue.h"
+#include "Options.h"
+#include <common/Constants.h>
+#include <common/Tracer.h>
 
 #include <string>
 #include <algorithm>
-#include <unordered_set>
+#include <unordered_map>
 #include <functional>
 #include <queue>
-#include <shared_mutex>
 #include <stack>
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ranges>
+#include <thread>
 
-CItem::CItem(const ITEMTYPE type, const std::wstring & name) : m_Name(name), m_Type(type)
+namespace
 {
-    if (IsType(IT_DRIVE))
+    // Application services used while scanning; drives only exist on
+    // Windows and are scanned as plain folders elsewhere
+#ifdef _WIN32
+    std::tuple<ULONGLONG, ULONGLONG> GetFreeDiskSpace(const std::wstring& path)
+    {
+        return CDirStatApp::GetFreeDiskSpace(path);
+    }
+
+    bool IsFollowingAllowed(const FileFindEnhanced& finder)
+    {
+        return CDirStatApp::Get()->IsFollowingAllowed(finder);
+    }
+#else
+    std::tuple<ULONGLONG, ULONGLONG> GetFreeDiskSpace(const std::wstring& path)
+    {
+        struct statvfs info;
+        if (statvfs(FileFindPosix::ToNativePath(path).c_str(), &info) != 0) return { 0, 0 };
+        return { static_cast<ULONGLONG>(info.f_blocks) * info.f_frsize, static_cast<ULONGLONG>(info.f_bavail) * info.f_frsize };
+    }
+
+    // Symbolic links are the only reparse points the POSIX backend reports
+    bool IsFollowingAllowed(const FileFindEnhanced& finder)
+    {
+        return (finder.GetAttributes() & FILE_ATTRIBUTE_REPARSE_POINT) == 0 || !COptions::ExcludeSymbolicLinks;
+    }
+
+    std::wstring FormatVolumeNameOfRootPath(const std::wstring& rootPath)
+    {
+        return rootPath;
+    }
+
+    std::wstring PathFromVolumeName(const std::wstring& name)
     {
-        m_Name = FormatVolumeNameOfRootPath(m_Name);
+        return name;
     }
+#endif
+
+    // Children only change while scanning or refreshing, so folders share a
+    // small set of locks picked by address instead of carrying one each
+    std::mutex& ChildrenLock(const void* info)
+    {
+        static std::array<std::mutex, 64> locks;
+        return locks[(reinterpret_cast<uintptr_t>(info) / alignof(std::max_align_t)) % locks.size()];
+    }
+}
+
+CItem::CItem(const ITEMTYPE type, const std::wstring & name) : m_Type(type)
+{
+    CItemArena* arena = CItemArena::Of(this);
+    m_Name = IsType(IT_DRIVE) ? arena->StoreName(FormatVolumeNameOfRootPath(name)) : arena->StoreName(name);
 
     if (IsType(IT_FILE))
     {
         if (const LPCWSTR ext = wcsrchr(name.c_str(), L'.'); ext != nullptr)
         {
-            std::wstring extToAdd(&ext[0]);
-            _wcslwr_s(extToAdd.data(), extToAdd.size() + 1);
-
-            static std::shared_mutex extLock;
-            static std::unordered_set<std::wstring> extcache;
-            std::lock_guard lock(extLock);
-            const auto cached = extcache.insert(std::move(extToAdd));
-            m_Extension = cached.first->c_str();
-        }
-        else
-        {
-            static LPCWSTR noext = L"";
-            m_Extension = noext;
+            m_Extension = CExtensionRegistry::Register(ext);
         }
     }
     else
     {
-        m_FolderInfo = new CHILDINFO;
-        m_Extension = m_Name.c_str();
+        m_FolderInfo = new (arena->Allocate(CItemArena::POOL_FOLDERS, sizeof(CHILDINFO))) CHILDINFO;
     }
 }
 
@@ -99,20 +146,113 @@ CItem::~CItem()
         {
             delete m_Child;
         }
-        delete m_FolderInfo;
+        m_FolderInfo->~CHILDINFO();
+        CItemArena::Free(m_FolderInfo);
     }
 }
 
-CRect CItem::TmiGetRectangle() const
+void* CItem::operator new(const size_t size)
 {
-    return m_Rect;
+    return CItemArena::Default()->Allocate(CItemArena::POOL_ITEMS, size);
 }
 
-void CItem::TmiSetRectangle(const CRect& rc)
+void* CItem::operator new(const size_t size, CItemArena* arena)
 {
-    m_Rect = rc;
+    return arena->Allocate(CItemArena::POOL_ITEMS, size);
 }
 
+void CItem::operator delete(void* item)
+{
+    CItemArena::Free(item);
+}
+
+void CItem::operator delete(void* item, CItemArena* /*arena*/)
+{
+    CItemArena::Free(item);
+}
+
+void CItem::DeleteTree(CItem* root)
+{
+    if (root == nullptr) return;
+
+    CItemArena* arena = CItemArena::Of(root);
+    if (arena == CItemArena::Default())
+    {
+        delete root;
+        return;
+    }
+
+    // Folder information is the only part that owns memory outside of the
+    // arena; items must no longer be visible at this point
+    arena->ForEachLive(CItemArena::POOL_FOLDERS, [](void* info)
+    {
+        static_cast<CHILDINFO*>(info)->~CHILDINFO();
+    });
+    CItemArena::Release(arena);
+}
+
+namespace
+{
+    // Single low priority thread deleting items that are no longer reachable
+    class CReleaseQueue final
+    {
+        std::mutex m_Mutex;
+        std::condition_variable m_Ready;
+        std::queue<std::function<void()>> m_Tasks;
+
+        void Run()
+        {
+#ifdef _WIN32
+            // Also lowers the priority of the memory and I/O it causes
+            SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+            for (;;)
+            {
+                std::unique_lock lock(m_Mutex);
+                m_Ready.wait(lock, [this] { return !m_Tasks.empty(); });
+                const auto task = std::move(m_Tasks.front());
+                m_Tasks.pop();
+                lock.unlock();
+
+                const auto start = std::chrono::steady_clock::now();
+                task();
+                VTRACE(L"Released items in {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+        }
+
+    public:
+
+        CReleaseQueue()
+        {
+            std::thread([this] { Run(); }).detach();
+        }
+
+        static void Push(std::function<void()> task)
+        {
+            // Never destroyed since its thread outlives static destruction
+            static const auto queue = new CReleaseQueue();
+            std::lock_guard lock(queue->m_Mutex);
+            queue->m_Tasks.push(std::move(task));
+            queue->m_Ready.notify_one();
+        }
+    };
+}
+
+void CItem::DeleteTreeAsync(CItem* root, CItemDupe* dupes)
+{
+    if (root == nullptr && dupes == nullptr) return;
+    VTRACE(L"Releasing {} items in the background", root != nullptr ? root->GetItemsCount() + 1 : 0);
+    CReleaseQueue::Push([root, dupes]
+    {
+#ifdef _WIN32
+        delete dupes;
+#endif
+        DeleteTree(root);
+    });
+}
+
+#ifdef _WIN32
 bool CItem::DrawSubitem(const int subitem, CDC* pdc, CRect rc, const UINT state, int* width, int* focusLeft) const
 {
     if (subitem == COL_NAME)
@@ -167,7 +307,7 @@ std::wstring CItem::GetText(const int subitem) const
 {
     switch (subitem)
     {
-    case COL_NAME: return m_Name;
+    case COL_NAME: return std::wstring(GetNameView());
     case COL_SIZE_PHYSICAL: return FormatBytes(GetSizePhysical());
     case COL_SIZE_LOGICAL: return FormatBytes(GetSizeLogical());
 
@@ -240,6 +380,12 @@ std::wstring CItem::GetText(const int subitem) const
 
 COLORREF CItem::GetItemTextColor() const
 {
+    // Folders that could not be read are grayed out
+    if (IsType(ITF_NOACCESS))
+    {
+        return GetSysColor(COLOR_GRAYTEXT);
+    }
+
     // Get the file/folder attributes
     const DWORD attr = GetAttributes();
 
@@ -280,7 +426,7 @@ int CItem::CompareSibling(const CTreeListItem* tlib, const int subitem) const
             }
             else
             {
-                return signum(_wcsicmp(m_Name.c_str(),other->m_Name.c_str()));
+                return signum(_wcsicmp(m_Name, other->m_Name));
             }
         }
 
@@ -422,6 +568,7 @@ int CItem::GetSubtreePercentageWidth()
 {
     return 105;
 }
+#endif
 
 CItem* CItem::FindCommonAncestor(const CItem* item1, const CItem* item2)
 {
@@ -494,6 +641,7 @@ void CItem::UpdateStatsFromDisk()
             }
         }
     }
+#ifdef _WIN32
     else if (IsType(IT_DRIVE))
     {
         SmartPointer<HANDLE> handle(CloseHandle, CreateFile(GetPathLong().c_str(), GENERIC_READ, 
@@ -503,11 +651,177 @@ void CItem::UpdateStatsFromDisk()
             GetFileTime(handle, nullptr, nullptr, &m_LastChange);
         }
     }
+#endif
 }
 
-const std::vector<CItem*>& CItem::GetChildren() const
+// Brings the direct children of a finished folder in line with the disk
+// without rescanning its subtree. New folders are returned since their
+// contents still need to be scanned.
+std::vector<CItem*> CItem::UpdateChildrenFromDisk()
 {
-    return m_FolderInfo->m_Children;
+    std::vector<CItem*> added;
+    if (!IsType(IT_DIRECTORY | IT_DRIVE)) return added;
+
+    std::unordered_map<std::wstring, CItem*> previous;
+    for (const auto& child : GetChildren())
+    {
+        if (!child->IsType(IT_FREESPACE | IT_UNKNOWN)) previous.emplace(child->GetNameView(), child);
+    }
+
+    const auto removeChild = [this](CItem* child)
+    {
+#ifdef _WIN32
+        CFileDupeControl::Get()->RemoveItem(child);
+#endif
+        UpwardSubtractSizePhysical(child->GetSizePhysical());
+        UpwardSubtractSizeLogical(child->GetSizeLogical());
+        UpwardSubtractFiles(child->IsType(IT_FILE) ? 1 : child->GetFilesCount());
+        UpwardSubtractFolders(child->IsType(IT_FILE) ? 0 : child->GetFoldersCount() + 1);
+        RemoveChild(child);
+    };
+
+    FileFindEnhanced finder;
+    for (BOOL b = finder.FindFile(GetPath()); b; b = finder.FindNextFile())
+    {
+        if (finder.IsDots())
+        {
+            continue;
+        }
+        if (COptions::SkipHidden && finder.IsHidden() ||
+            COptions::SkipProtected && finder.IsHiddenSystem())
+        {
+            continue;
+        }
+
+        CItem* child = nullptr;
+        if (const auto match = previous.find(finder.GetFileName()); match != previous.end())
+        {
+            child = match->second;
+            previous.erase(match);
+
+            // An entry that changed between file and folder is replaced
+            if (child->IsType(IT_FILE) == finder.IsDirectory())
+            {
+                removeChild(child);
+                child = nullptr;
+            }
+        }
+
+        if (child != nullptr)
+        {
+            child->SetAttributes(finder.GetAttributes());
+            if (child->IsType(IT_FILE) && !child->MatchesFile(finder))
+            {
+#ifdef _WIN32
+                // Cached hashes no longer apply to the new contents
+                CFileDupeControl::Get()->RemoveItem(child);
+#endif
+                child->UpwardSubtractSizePhysical(child->GetSizePhysical());
+                child->UpwardAddSizePhysical(finder.GetFileSizePhysical());
+                child->UpwardSubtractSizeLogical(child->GetSizeLogical());
+                child->UpwardAddSizeLogical(finder.GetFileSizeLogical());
+                child->SetLastChange(finder.GetLastWriteTime());
+            }
+            child->UpwardUpdateLastChange(finder.GetLastWriteTime());
+        }
+        else if (finder.IsDirectory())
+        {
+            child = new (CItemArena::Of(this)) CItem(IT_DIRECTORY, finder.GetFileName());
+            child->SetLastChange(finder.GetLastWriteTime());
+            child->SetAttributes(finder.GetAttributes());
+            AddChild(child);
+            UpwardAddFolders(1);
+
+            if (!finder.IsProtectedReparsePoint() && IsFollowingAllowed(finder))
+            {
+                added.push_back(child);
+            }
+            else child->SetDone();
+        }
+        else
+        {
+            child = new (CItemArena::Of(this)) CItem(IT_FILE, finder.GetFileName());
+            child->SetSizePhysical(finder.GetFileSizePhysical());
+            child->SetSizeLogical(finder.GetFileSizeLogical());
+            child->SetLastChange(finder.GetLastWriteTime());
+            child->SetAttributes(finder.GetAttributes());
+            AddChild(child);
+            UpwardAddFiles(1);
+            child->SetDone();
+        }
+    }
+
+    // Anything not seen again has been deleted or renamed
+    for (const auto& child : previous | std::views::values) removeChild(child);
+    return added;
+}
+
+std::span<CItem* const> CItem::GetChildren() const
+{
+    return { m_FolderInfo->m_Children.begin(), m_FolderInfo->m_Children.size() };
+}
+
+CItem::CHILDLIST::~CHILDLIST()
+{
+    if (m_Capacity == 0) return;
+    CItemArena::Of(this)->AddHeapBytes(-static_cast<ptrdiff_t>(m_Capacity * sizeof(CItem*)));
+    delete[] m_Items;
+}
+
+void CItem::CHILDLIST::Reallocate(const size_t capacity)
+{
+    // A frozen range stays in the arena so readers still iterating it are safe
+    const auto items = capacity > 0 ? new CItem*[capacity] : nullptr;
+    std::copy_n(m_Items, m_Size, items);
+    if (m_Capacity > 0) delete[] m_Items;
+    CItemArena::Of(this)->AddHeapBytes((static_cast<ptrdiff_t>(capacity) - static_cast<ptrdiff_t>(m_Capacity)) *
+        static_cast<ptrdiff_t>(sizeof(CItem*)));
+    m_Items = items;
+    m_Capacity = static_cast<ULONG>(capacity);
+}
+
+void CItem::CHILDLIST::Append(CItem* const* children, const size_t count)
+{
+    if (m_Size + count > m_Capacity)
+    {
+        Reallocate(std::max<size_t>({ 4, m_Size + count, static_cast<size_t>(m_Capacity) * 2 }));
+    }
+    std::copy_n(children, count, m_Items + m_Size);
+    m_Size += static_cast<ULONG>(count);
+}
+
+void CItem::CHILDLIST::Remove(const CItem* child)
+{
+    const auto found = std::ranges::find(*this, child);
+    if (found == end()) return;
+
+    const auto index = found - begin();
+    if (IsFrozen()) Reallocate(m_Size);
+    std::copy(m_Items + index + 1, end(), m_Items + index);
+    m_Size--;
+}
+
+void CItem::CHILDLIST::Clear()
+{
+    m_Size = 0;
+    Reallocate(0);
+}
+
+void CItem::CHILDLIST::ShrinkToFit()
+{
+    if (m_Capacity > m_Size) Reallocate(m_Size);
+}
+
+void CItem::CHILDLIST::Freeze(CItem** block)
+{
+    std::copy_n(m_Items, m_Size, block);
+    if (m_Capacity > 0)
+    {
+        CItemArena::Of(this)->AddHeapBytes(-static_cast<ptrdiff_t>(m_Capacity * sizeof(CItem*)));
+        delete[] m_Items;
+    }
+    m_Items = block;
+    m_Capacity = 0;
 }
 
 CItem* CItem::GetParent() const
@@ -526,49 +840,137 @@ void CItem::AddChild(CItem* child, const bool addOnly)
 
     child->SetParent(this);
 
-    std::lock_guard guard(m_FolderInfo->m_Protect);
-    m_FolderInfo->m_Children.push_back(child);
+    std::lock_guard guard(ChildrenLock(m_FolderInfo));
+    m_FolderInfo->m_Children.Append(&child, 1);
 
+#ifdef _WIN32
     if (IsVisible() && IsExpanded())
     {
         (void)GetImage();
-        CMainFrame::Get()->InvokeInMessageThread([this, child]
-        {
-            CFileTreeControl::Get()->OnChildAdded(this, child);
-        });
+        CMainFrame::Get()->QueueChildAdded(this, child);
     }
+#endif
 }
 
-void CItem::RemoveChild(CItem* child)
+void CItem::AddChildren(const std::vector<CItem*>& children)
 {
-    std::lock_guard guard(m_FolderInfo->m_Protect);
-    std::erase(m_FolderInfo->m_Children, child);
+    if (children.empty()) return;
+
+    // Children must already have their parent set; sizes are left to the caller
+    std::lock_guard guard(ChildrenLock(m_FolderInfo));
+    m_FolderInfo->m_Children.Append(children.data(), children.size());
 
-    if (IsVisible())
+#ifdef _WIN32
+    if (IsVisible() && IsExpanded())
     {
-        CMainFrame::Get()->InvokeInMessageThread([this, child]
+        (void)GetImage();
+        for (const auto& child : children)
         {
-            CFileTreeControl::Get()->OnChildRemoved(this, child);
-        });
+            CMainFrame::Get()->QueueChildAdded(this, child);
+        }
+    }
+#endif
+}
+
+void CItem::RemoveChild(CItem* child)
+{
+    {
+        std::lock_guard guard(ChildrenLock(m_FolderInfo));
+        m_FolderInfo->m_Children.Remove(child);
     }
 
+#ifdef _WIN32
+    // Deleting is left to the message thread since queued
+    // additions may still refer to the child or its descendants
+    if (CMainFrame::Get() != nullptr) CMainFrame::Get()->QueueChildRemoved(this, child);
+    else delete child;
+#else
     delete child;
+#endif
 }
 
 void CItem::RemoveAllChildren()
 {
     if (m_FolderInfo == nullptr) return;
+#ifdef _WIN32
     CMainFrame::Get()->InvokeInMessageThread([this]
     {
         CFileTreeControl::Get()->OnRemovingAllChildren(this);
+        if (CMainFrame::Get()->GetTreeMapView() != nullptr) CMainFrame::Get()->GetTreeMapView()->OnItemRemoved();
     });
+#endif
 
-    std::lock_guard guard(m_FolderInfo->m_Protect);
-    for (const auto& child : m_FolderInfo->m_Children)
+    // The children are no longer reachable once detached, so deleting them
+    // is left to the background instead of holding up the rescan
+    std::vector<CItem*> children;
     {
-        delete child;
+        std::lock_guard guard(ChildrenLock(m_FolderInfo));
+        children.assign(m_FolderInfo->m_Children.begin(), m_FolderInfo->m_Children.end());
+        m_FolderInfo->m_Children.Clear();
+    }
+    if (children.empty()) return;
+
+    CReleaseQueue::Push([children = std::move(children)]
+    {
+        for (const auto& child : children)
+        {
+            delete child;
+        }
+    });
+}
+
+// Prepares a subtree for a rescan that reuses its items: directory totals are
+// cleared so they can be accumulated again while the items themselves are kept
+void CItem::RecurseResetTotals()
+{
+    std::stack<CItem*> queue({ this });
+    while (!queue.empty())
+    {
+        CItem* qitem = queue.top();
+        queue.pop();
+        if (qitem->IsType(IT_FILE)) continue;
+
+        // Free space and unknown items are recreated once the scan completes
+        const auto children = qitem->GetChildren();
+        for (const auto& child : std::vector(children.begin(), children.end()))
+        {
+            if (child->IsType(IT_FREESPACE | IT_UNKNOWN)) qitem->RemoveChild(child);
+            else queue.push(child);
+        }
+
+        qitem->m_SizePhysical = 0;
+        qitem->m_SizeLogical = 0;
+        qitem->m_FolderInfo->m_Files = 0;
+        qitem->m_FolderInfo->m_Subdirs = 0;
+        qitem->SetType(ITF_DONE, false);
+    }
+}
+
+// Compacts the children of a finished subtree; lists changed later on are
+// thawed one by one so only folders touched by a rescan leave the block
+void CItem::RecurseFreeze()
+{
+    // Breadth first so the children of siblings end up next to each other
+    CItemArena* arena = CItemArena::Of(this);
+    std::queue<CItem*> queue({ this });
+    while (!queue.empty())
+    {
+        CItem* qitem = queue.front();
+        queue.pop();
+        if (qitem->m_FolderInfo == nullptr) continue;
+
+        CHILDLIST& children = qitem->m_FolderInfo->m_Children;
+        if (!children.IsFrozen() && !children.empty())
+        {
+            std::lock_guard guard(ChildrenLock(qitem->m_FolderInfo));
+            children.Freeze(static_cast<CItem**>(arena->AllocateBlock(children.size() * sizeof(CItem*))));
+        }
+
+        for (const auto& child : children)
+        {
+            if (child->m_FolderInfo != nullptr) queue.push(child);
+        }
     }
-    m_FolderInfo->m_Children.clear();
 }
 
 void CItem::UpwardAddFolders(const ULONG dirCount)
@@ -683,6 +1085,25 @@ void CItem::UpwardUpdateLastChange(const FILETIME& t)
     }
 }
 
+// Publishes the totals gathered for this directory to it and all of its
+// ancestors in a single walk and then resets them for further accumulation
+void CItem::UpwardAddTotals(SCANTOTALS& totals)
+{
+    if (totals.m_Entries == 0) return;
+    AddChildren(totals.m_Children);
+    for (auto p = this; p != nullptr; p = p->GetParent())
+    {
+        if (totals.m_SizePhysical > 0) p->m_SizePhysical += totals.m_SizePhysical;
+        if (totals.m_SizeLogical > 0) p->m_SizeLogical += totals.m_SizeLogical;
+        if (CompareFileTime(&totals.m_LastChange, &p->m_LastChange) == 1) p->m_LastChange = totals.m_LastChange;
+        if (p->IsType(IT_FILE)) continue;
+        if (totals.m_Files > 0) p->m_FolderInfo->m_Files += totals.m_Files;
+        if (totals.m_Subdirs > 0) p->m_FolderInfo->m_Subdirs += totals.m_Subdirs;
+    }
+
+    totals = {};
+}
+
 void CItem::UpwardRecalcLastChange(const bool withoutItem)
 {
     for (auto p = this; p != nullptr; p = p->GetParent())
@@ -795,6 +1216,7 @@ std::wstring CItem::GetPathLong() const
     return FileFindEnhanced::MakeLongPathCompatible(GetPath());
 }
 
+#ifdef _WIN32
 std::wstring CItem::GetOwner(const bool force) const
 {
     if (!IsVisible() && !force)
@@ -815,6 +1237,7 @@ std::wstring CItem::GetOwner(const bool force) const
     ret = GetNameFromSid(sid);
     return ret;
 }
+#endif
 
 bool CItem::HasUncPath() const
 {
@@ -829,14 +1252,16 @@ std::wstring CItem::GetFolderPath() const
 
     if (IsType(IT_MYCOMPUTER))
     {
+#ifdef _WIN32
         path = GetParseNameOfMyComputer();
+#endif
     }
     else
     {
         path = GetPath();
         if (IsType(IT_FILE))
         {
-            const auto i = path.find_last_of(wds::chrBackslash);
+            const auto i = path.find_last_of(wds::chrPathSeparator);
             ASSERT(i != std::wstring::npos);
             path = path.substr(0, i);
         }
@@ -846,12 +1271,12 @@ std::wstring CItem::GetFolderPath() const
 
 std::wstring CItem::GetName() const
 {
-    return m_Name;
+    return std::wstring(GetNameView());
 }
 
 std::wstring CItem::GetExtension() const
 {
-    return m_Extension;
+    return CExtensionRegistry::GetName(m_Extension);
 }
 
 ULONG CItem::GetFilesCount() const
@@ -892,7 +1317,6 @@ void CItem::SetDone()
         m_FolderInfo->m_Tfinish = static_cast<ULONG>(GetTickCount64() / 1000ull);
     }
 
-    m_Rect = { 0,0,0,0 };
     SetType(ITF_DONE, true);
 }
 
@@ -901,8 +1325,8 @@ void CItem::SortItemsBySizePhysical() const
     if (m_FolderInfo == nullptr) return;
     
     // sort by size for proper treemap rendering
-    std::lock_guard guard(m_FolderInfo->m_Protect);
-    m_FolderInfo->m_Children.shrink_to_fit();
+    std::lock_guard guard(ChildrenLock(m_FolderInfo));
+    m_FolderInfo->m_Children.ShrinkToFit();
     std::ranges::sort(m_FolderInfo->m_Children, [](auto item1, auto item2)
     {
         return item1->GetSizePhysical() > item2->GetSizePhysical(); // biggest first
@@ -935,6 +1359,7 @@ void CItem::ScanItemsFinalize(CItem* item)
         queue.pop();
         qitem->SetDone();
         if (qitem->IsType(IT_FILE)) continue;
+
         for (const auto& child : qitem->GetChildren())
         {
             if (!child->IsDone()) queue.push(child);
@@ -942,64 +1367,291 @@ void CItem::ScanItemsFinalize(CItem* item)
     }
 }
 
-void CItem::ScanItems(BlockingQueue<CItem*> * queue)
+void CItem::ScanItems(BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, SCANTHROTTLE* throttle)
 {
-    while (CItem * item = queue->Pop())
+#ifdef _WIN32
+    if (COptions::AsyncEnumeration && ScanItemsAsync(queue, sizeQueue, throttle)) return;
+#endif
+
+    while (SCANJOB job = queue->Pop())
     {
         // Mark the time we started evaluating this node
+        CItem* item = job.m_Item;
         item->ResetScanStartTime();
 
         if (item->IsType(IT_DRIVE | IT_DIRECTORY))
         {
-            FileFindEnhanced finder;
-            for (BOOL b = finder.FindFile(item->GetPath()); b; b = finder.FindNextFile())
+            // Open relative to the parent handle when available so the full
+            // path is only built if an entry needs it; the parent handle is
+            // released as soon as this directory is open
+            SCANDIRECTORY scan;
+            item->BeginScan(scan, queue, throttle);
+            FileFindEnhanced& finder = scan.m_Finder;
+            BOOL b = job.m_ParentHandle != nullptr && finder.FindFileRelative(job.m_ParentHandle, std::wstring(item->GetNameView()), [item] { return item->GetPath(); });
+            if (!b) b = finder.FindFile(item->GetPath());
+            job.m_ParentHandle.reset();
+            try
             {
-                if (finder.IsDots())
+                for (; b; b = finder.FindNextFile())
                 {
-                    continue;
+                    item->ScanEntry(scan, queue, sizeQueue, throttle);
                 }
-                if (COptions::SkipHidden && finder.IsHidden() ||
-                    COptions::SkipProtected && finder.IsHiddenSystem())
+            }
+            catch (std::exception&)
+            {
+                // Entries found so far must be reachable when cancelled
+                item->UpwardAddTotals(scan.m_Totals);
+                throw;
+            }
+
+            item->EndScan(scan);
+        }
+        else item->ScanOther(queue);
+
+        item->UpwardSubtractReadJobs(1);
+    }
+}
+
+#ifdef _WIN32
+bool CItem::ScanItemsAsync(BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, SCANTHROTTLE* throttle)
+{
+    // Without a port of its own the worker reads one folder at a time
+    SmartPointer<HANDLE> port(CloseHandle, CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1));
+    if (port == nullptr)
+    {
+        VTRACE(L"Cannot create completion port: {}", GetLastError());
+        return false;
+    }
+
+    // Directories this worker has a query in flight for; a new one is only
+    // waited for when nothing is outstanding so latency is spent in parallel
+    constexpr size_t maxOutstanding = 8;
+    constexpr DWORD pollInterval = 100;
+    std::vector<std::unique_ptr<SCANDIRECTORY>> scans;
+
+    const auto finish = [&](const SCANDIRECTORY* scan)
+    {
+        scan->m_Item->UpwardSubtractReadJobs(1);
+        std::erase_if(scans, [scan](const auto& entry) { return entry.get() == scan; });
+    };
+
+    try
+    {
+        for (;;)
+        {
+            // Top up with new directories; everything else is handled right away
+            while (scans.size() < maxOutstanding)
+            {
+                SCANJOB job;
+                if (scans.empty())
                 {
-                    continue;
+                    // Nothing comes back once the queue has been retired
+                    job = queue->Pop();
+                    if (!job) return true;
                 }
+                else if (!queue->TryPop(job)) break;
 
-                if (finder.IsDirectory())
+                CItem* item = job.m_Item;
+                item->ResetScanStartTime();
+                if (!item->IsType(IT_DRIVE | IT_DIRECTORY))
                 {
-                    item->UpwardAddFolders(1);
-                    if (CItem* newitem = item->AddDirectory(finder); newitem->GetReadJobs() > 0)
-                    {
-                        queue->Push(newitem);
-                    }
+                    item->ScanOther(queue);
+                    item->UpwardSubtractReadJobs(1);
+                    continue;
                 }
-                else
+
+                auto& scan = scans.emplace_back(std::make_unique<SCANDIRECTORY>());
+                item->BeginScan(*scan, queue, throttle);
+                if (!scan->m_Finder.FindFileAsync(port, reinterpret_cast<ULONG_PTR>(scan.get()),
+                    job.m_ParentHandle, std::wstring(item->GetNameView()), [item] { return item->GetPath(); }))
                 {
-                    item->UpwardAddFiles(1);
-                    CItem* newitem = item->AddFile(finder);
-                    CFileDupeControl::Get()->ProcessDuplicate(newitem, queue);
-                    queue->WaitIfSuspended();
+                    item->EndScan(*scan);
+                    finish(scan.get());
                 }
+            }
+
+            // Wait for any of the outstanding queries, honoring suspension
+            DWORD bytes;
+            ULONG_PTR key;
+            LPOVERLAPPED overlapped;
+            if (!GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, pollInterval) && overlapped == nullptr)
+            {
+                queue->WaitIfSuspended();
+                continue;
+            }
 
-                // Update pacman position
-                item->UpwardDrivePacman();
+            // Walk the returned entries and ask for more until exhausted
+            const auto scan = reinterpret_cast<SCANDIRECTORY*>(key);
+            if (scan->m_Finder.CompleteQuery()) do
+            {
+                scan->m_Item->ScanEntry(*scan, queue, sizeQueue, throttle);
+            } while (scan->m_Finder.FindNextFile());
+
+            if (!scan->m_Finder.QueryAsync())
+            {
+                scan->m_Item->EndScan(*scan);
+                finish(scan);
             }
         }
-        else if (item->IsType(IT_FILE))
-        {
-            // Only used for refreshes
-            item->UpdateStatsFromDisk();
-            item->SetDone();
-        }
-        else if (item->IsType(IT_MYCOMPUTER))
+    }
+    catch (std::exception&)
+    {
+        // Buffers must outlive their queries so cancel and drain them all;
+        // entries found so far must be reachable when cancelled
+        for (const auto& scan : scans) scan->m_Finder.CancelQuery();
+        for (const auto& scan : scans)
         {
-            for (const auto & child : item->GetChildren())
+            while (scan->m_Finder.IsQueryPending())
             {
-                child->UpwardAddReadJobs(1);
-                queue->Push(child);
+                DWORD bytes;
+                ULONG_PTR key;
+                LPOVERLAPPED overlapped;
+                if (!GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, INFINITE) && overlapped == nullptr) break;
+                reinterpret_cast<SCANDIRECTORY*>(key)->m_Finder.CompleteQuery();
             }
+            scan->m_Item->UpwardAddTotals(scan->m_Totals);
         }
-        item->UpwardSubtractReadJobs(1);
-        item->UpwardDrivePacman();
+        throw;
+    }
+}
+#endif
+
+void CItem::BeginScan(SCANDIRECTORY& scan, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle)
+{
+    scan.m_Item = this;
+    scan.m_LastFlush = GetTickCount64();
+
+    // Every folder enumerated counts against the query budget of the volume
+    queue->Throttle(throttle->m_Queries.Reserve(1.0, COptions::ScanQueryRateLimit));
+
+    // Children are only present here on rescans that reuse items; they
+    // are matched by name so unchanged entries keep their existing items
+    for (const auto& child : GetChildren())
+    {
+        scan.m_Previous.emplace(child->GetNameView(), child);
+    }
+}
+
+void CItem::ScanEntry(SCANDIRECTORY& scan, BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, [[maybe_unused]] SCANTHROTTLE* throttle)
+{
+    // Publish accumulated totals periodically so progress stays live
+    constexpr ULONG flushEntries = 4096;
+    constexpr ULONGLONG flushTicks = 250;
+
+    const FileFindEnhanced& finder = scan.m_Finder;
+    if (finder.IsDots())
+    {
+        return;
+    }
+    if (COptions::SkipHidden && finder.IsHidden() ||
+        COptions::SkipProtected && finder.IsHiddenSystem())
+    {
+        return;
+    }
+
+    CItem* existing = nullptr;
+    if (const auto match = scan.m_Previous.find(finder.GetFileName()); match != scan.m_Previous.end())
+    {
+        existing = match->second;
+        scan.m_Previous.erase(match);
+        if (!existing->IsType(finder.IsDirectory() ? IT_DIRECTORY : IT_FILE))
+        {
+            scan.m_Stale.push_back(existing);
+            existing = nullptr;
+        }
+    }
+
+    if (finder.IsDirectory())
+    {
+        if (CItem* newitem = AddDirectory(finder, scan.m_Totals, existing); newitem->GetReadJobs() > 0)
+        {
+            queue->Push({ newitem, finder.RetainDirectoryHandle() });
+        }
+    }
+    else if (existing != nullptr && existing->MatchesFile(finder))
+    {
+        // Unchanged files keep their item along with any duplicate hashes
+        AddFile(finder, scan.m_Totals, existing);
+    }
+    else
+    {
+        if (existing != nullptr) scan.m_Stale.push_back(existing);
+        CItem* newitem = AddFile(finder, scan.m_Totals);
+#ifdef _WIN32
+        if (!COptions::SkipDupeDetectionCloudLinks || !CReparsePoints::IsCloudLinkTag(finder.GetReparseTag()))
+        {
+            CFileDupeControl::Get()->ProcessDuplicate(newitem, queue, throttle);
+        }
+#endif
+
+        // Keep the folder busy until the missing size has been filled in
+        if (finder.NeedsFileSizePhysicalLookup())
+        {
+            UpwardAddReadJobs(1);
+            sizeQueue->Push(newitem);
+        }
+    }
+
+    // Always publish before pausing so suspended trees are consistent
+    if (scan.m_Totals.m_Entries >= flushEntries || queue->IsSuspended() ||
+        GetTickCount64() - scan.m_LastFlush >= flushTicks)
+    {
+        UpwardAddTotals(scan.m_Totals);
+        scan.m_LastFlush = GetTickCount64();
+    }
+    queue->WaitIfSuspended();
+}
+
+void CItem::EndScan(SCANDIRECTORY& scan)
+{
+    // A folder that could not be opened is flagged instead of passing as empty
+    if (const DWORD error = scan.m_Finder.GetOpenError(); error != 0)
+    {
+        VTRACE(L"Cannot open folder {:#08X}: {}", error, GetPath());
+        SetType(ITF_NOACCESS);
+    }
+    else if (IsType(ITF_NOACCESS)) SetType(ITF_NOACCESS, false);
+
+    // Anything not seen again has been deleted or replaced
+    for (const auto& child : scan.m_Previous | std::views::values) scan.m_Stale.push_back(child);
+    for (const auto& child : scan.m_Stale)
+    {
+#ifdef _WIN32
+        CFileDupeControl::Get()->RemoveItem(child);
+#endif
+        RemoveChild(child);
+    }
+
+    // Totals must be published before the read job is released by the
+    // caller since that may mark this item and its ancestors as done
+    UpwardAddTotals(scan.m_Totals);
+}
+
+void CItem::ScanOther(BlockingQueue<SCANJOB>* queue)
+{
+    if (IsType(IT_FILE))
+    {
+        // Only used for refreshes
+        UpdateStatsFromDisk();
+        SetDone();
+    }
+    else if (IsType(IT_MYCOMPUTER))
+    {
+        for (const auto & child : GetChildren())
+        {
+            child->UpwardAddReadJobs(1);
+            queue->Push(child);
+        }
+    }
+}
+
+void CItem::ScanSizesPhysical(BlockingQueue<CItem*>* queue)
+{
+    while (CItem* item = queue->Pop())
+    {
+        item->UpwardAddSizePhysical(FileFindEnhanced::QueryFileSizePhysical(item->GetPathLong()));
+        item->GetParent()->UpwardSubtractReadJobs(1);
+        queue->WaitIfSuspended();
     }
 }
 
@@ -1046,20 +1698,22 @@ CItem* CItem::FindRecyclerItem() const
     return nullptr;
 }
 
+#ifdef _WIN32
 void CItem::CreateFreeSpaceItem()
 {
     ASSERT(IsType(IT_DRIVE));
 
     UpwardSetUndone();
 
-    auto [total, free] = CDirStatApp::GetFreeDiskSpace(GetPath());
+    auto [total, free] = GetFreeDiskSpace(GetPath());
 
-    const auto freespace = new CItem(IT_FREESPACE, Localization::Lookup(IDS_FREESPACE_ITEM));
+    const auto freespace = new (CItemArena::Of(this)) CItem(IT_FREESPACE, Localization::Lookup(IDS_FREESPACE_ITEM));
     freespace->SetSizePhysical(free);
     freespace->SetDone();
 
     AddChild(freespace);
 }
+#endif
 
 CItem* CItem::FindFreeSpaceItem() const
 {
@@ -1086,7 +1740,7 @@ void CItem::UpdateFreeSpaceItem() const
     // Rebaseline as if freespace was not shown
     freeSpaceItem->UpwardSubtractSizePhysical(freeSpaceItem->GetSizePhysical());
 
-    auto [total, free] = CDirStatApp::GetFreeDiskSpace(GetPath());
+    auto [total, free] = GetFreeDiskSpace(GetPath());
     freeSpaceItem->UpwardAddSizePhysical(free);
 }
 
@@ -1107,7 +1761,7 @@ void CItem::UpdateUnknownItem() const
     const CItem* freeSpaceItem = FindFreeSpaceItem();
     const ULONGLONG tallied = GetSizePhysical() - (freeSpaceItem ? freeSpaceItem->GetSizePhysical() : 0);
 
-    auto [total, free] = CDirStatApp::GetFreeDiskSpace(GetPath());
+    auto [total, free] = GetFreeDiskSpace(GetPath());
     unknown->UpwardAddSizePhysical((tallied > total - free) ? 0 : total - free - tallied);
 }
 
@@ -1123,17 +1777,19 @@ void CItem::RemoveFreeSpaceItem()
     }
 }
 
+#ifdef _WIN32
 void CItem::CreateUnknownItem()
 {
     ASSERT(IsType(IT_DRIVE));
 
     UpwardSetUndone();
 
-    const auto unknown = new CItem(IT_UNKNOWN, Localization::Lookup(IDS_UNKNOWN_ITEM));
+    const auto unknown = new (CItemArena::Of(this)) CItem(IT_UNKNOWN, Localization::Lookup(IDS_UNKNOWN_ITEM));
     unknown->SetDone();
 
     AddChild(unknown);
 }
+#endif
 
 CItem* CItem::FindUnknownItem() const
 {
@@ -1159,6 +1815,7 @@ void CItem::RemoveUnknownItem()
     }
 } 
 
+#ifdef _WIN32
 void CItem::CollectExtensionData(CExtensionData* ed) const
 {
     std::stack<const CItem*> queue({this});
@@ -1168,20 +1825,10 @@ void CItem::CollectExtensionData(CExtensionData* ed) const
         queue.pop();
         if (qitem->IsType(IT_FILE))
         {
-            const std::wstring& ext = qitem->GetExtension();
-            const auto & record = ed->find(ext);
-            if (record != ed->end())
-            {
-                record->second.bytes += qitem->GetSizePhysical();
-                record->second.files++;
-            }
-            else
-            {
-                SExtensionRecord new_record;
-                new_record.bytes = qitem->GetSizePhysical();
-                new_record.files = 1;
-                ed->emplace(ext, new_record);
-            }
+            const EXTENSIONID ext = qitem->m_Extension;
+            if (ext >= ed->size()) ed->resize(CExtensionRegistry::GetCount());
+            (*ed)[ext].bytes += qitem->GetSizePhysical();
+            (*ed)[ext].files++;
         }
         else for (const auto& child : qitem->m_FolderInfo->m_Children)
         {
@@ -1189,6 +1836,7 @@ void CItem::CollectExtensionData(CExtensionData* ed) const
         }
     }
 }
+#endif
 
 ULONGLONG CItem::GetProgressRangeMyComputer() const
 {
@@ -1204,7 +1852,7 @@ ULONGLONG CItem::GetProgressRangeMyComputer() const
 
 ULONGLONG CItem::GetProgressRangeDrive() const
 {
-    auto [total, free] = CDirStatApp::GetFreeDiskSpace(GetPath());
+    auto [total, free] = GetFreeDiskSpace(GetPath());
 
     total -= free;
 
@@ -1212,6 +1860,7 @@ ULONGLONG CItem::GetProgressRangeDrive() const
     return total;
 }
 
+#ifdef _WIN32
 COLORREF CItem::GetGraphColor() const
 {
     if (IsType(IT_UNKNOWN))
@@ -1226,7 +1875,7 @@ COLORREF CItem::GetGraphColor() const
 
     if (IsType(IT_FILE))
     {
-        return CDirStatDoc::GetDocument()->GetCushionColor(GetExtension());
+        return CDirStatDoc::GetDocument()->GetCushionColor(m_Extension);
     }
 
     return RGB(0, 0, 0);
@@ -1257,73 +1906,98 @@ COLORREF CItem::GetPercentageColor() const
         COptions::FileTreeColor7
     } [i] ;
 }
+#endif
 
 std::wstring CItem::UpwardGetPathWithoutBackslash() const
 {
     // allow persistent storage to prevent constant reallocation
-    std::wstring path = L"\\";
+    std::wstring path(1, wds::chrPathSeparator);
 
     for (auto p = this; p != nullptr; p = p->GetParent())
     {
         if (p->IsType(IT_DIRECTORY))
         {
-            path.insert(0, p->m_Name + L"\\");
+            path.insert(0, 1, wds::chrPathSeparator).insert(0, p->GetNameView());
         }
         else if (p->IsType(IT_FILE))
         {
-            path = p->m_Name;
+            path = p->GetNameView();
         }
         else if (p->IsType(IT_DRIVE))
         {
-            path.insert(0, PathFromVolumeName(p->m_Name) + L"\\");
+            path.insert(0, PathFromVolumeName(std::wstring(p->GetNameView())) + wds::chrPathSeparator);
         }
     }
 
-    while (path.back() == L'\\') path.pop_back();
+    while (path.size() > 1 && path.back() == wds::chrPathSeparator) path.pop_back();
     return path;
 }
 
-CItem* CItem::AddDirectory(const FileFindEnhanced& finder)
+CItem* CItem::AddDirectory(const FileFindEnhanced& finder, SCANTOTALS& totals, CItem* existing)
 {
-    const bool follow = !finder.IsProtectedReparsePoint() &&
-        CDirStatApp::Get()->IsFollowingAllowed(finder.GetFilePathLong(), finder.GetAttributes());
+    // The reparse tag from the enumeration decides whether to follow
+    const bool follow = !finder.IsProtectedReparsePoint() && IsFollowingAllowed(finder);
 
-    const auto & child = new CItem(IT_DIRECTORY, finder.GetFileName());
+    // An existing folder is rescanned in place so its unchanged contents survive
+    const auto & child = existing != nullptr ? existing : new (CItemArena::Of(this)) CItem(IT_DIRECTORY, finder.GetFileName());
     child->SetLastChange(finder.GetLastWriteTime());
     child->SetAttributes(finder.GetAttributes());
-    AddChild(child);
+    if (existing == nullptr)
+    {
+        // The parent is needed right away since the folder may be queued
+        // before it is published along with the rest of the totals
+        child->SetParent(this);
+        totals.m_Children.push_back(child);
+    }
+    else if (!follow)
+    {
+#ifdef _WIN32
+        CFileDupeControl::Get()->RemoveItem(child);
+#endif
+        child->RemoveAllChildren();
+    }
     child->UpwardAddReadJobs(follow ? 1 : 0);
+
+    totals.m_Subdirs++;
+    totals.m_Entries++;
+    if (CompareFileTime(&child->m_LastChange, &totals.m_LastChange) == 1) totals.m_LastChange = child->m_LastChange;
     return child;
 }
 
-CItem* CItem::AddFile(const FileFindEnhanced& finder)
+CItem* CItem::AddFile(const FileFindEnhanced& finder, SCANTOTALS& totals, CItem* existing)
 {
-    const auto & child = new CItem(IT_FILE, finder.GetFileName());
-    child->SetSizePhysical(finder.GetFileSizePhysical());
-    child->SetSizeLogical(finder.GetFileSizeLogical());
-    child->SetLastChange(finder.GetLastWriteTime());
+    // An existing file is only passed in if its size and time are unchanged
+    const auto & child = existing != nullptr ? existing : new (CItemArena::Of(this)) CItem(IT_FILE, finder.GetFileName());
     child->SetAttributes(finder.GetAttributes());
-    AddChild(child);
-    child->SetDone();
+    if (existing == nullptr)
+    {
+        // Sizes that need a separate lookup are added later by ScanSizesPhysical()
+        child->SetSizePhysical(finder.NeedsFileSizePhysicalLookup() ? 0 : finder.GetFileSizePhysical());
+        child->SetSizeLogical(finder.GetFileSizeLogical());
+        child->SetLastChange(finder.GetLastWriteTime());
+        child->SetParent(this);
+        totals.m_Children.push_back(child);
+        child->SetDone();
+    }
+
+    totals.m_Files++;
+    totals.m_Entries++;
+    totals.m_SizePhysical += child->m_SizePhysical;
+    totals.m_SizeLogical += child->m_SizeLogical;
+    if (CompareFileTime(&child->m_LastChange, &totals.m_LastChange) == 1) totals.m_LastChange = child->m_LastChange;
     return child;
 }
 
-void CItem::UpwardDrivePacman()
+bool CItem::MatchesFile(const FileFindEnhanced& finder) const
 {
-    if (!COptions::PacmanAnimation)
-    {
-        return;
-    }
-
-    for (auto p = this; p != nullptr; p = p->GetParent())
-    {
-        if (p->IsType(IT_FILE) || !p->IsVisible()) continue;
-        if (p->GetReadJobs() == 0) p->StopPacman();
-        else p->DrivePacman();
-    }
+    const FILETIME lastChange = finder.GetLastWriteTime();
+    return IsType(IT_FILE) && CompareFileTime(&lastChange, &m_LastChange) == 0 &&
+        m_SizeLogical == finder.GetFileSizeLogical() &&
+        (finder.NeedsFileSizePhysicalLookup() || m_SizePhysical == finder.GetFileSizePhysical());
 }
 
-std::wstring CItem::GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<CItem*>* queue)
+#ifdef _WIN32
+std::wstring CItem::GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle)
 {
     // Initialize hash for this thread
     constexpr auto maxBufferSize = 2ull * 1024ull * 1024ull;
@@ -1360,9 +2034,12 @@ std::wstring CItem::GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<CItem*>*
     while ((iReadResult = ReadFile(hFile, FileBuffer.data(), static_cast<DWORD>(FileBuffer.size()),
         &iReadBytes, nullptr)) != 0 && iReadBytes > 0)
     {
-        UpwardDrivePacman();
         iHashResult = BCryptHashData(HashHandle, FileBuffer.data(), iReadBytes, 0);
-        if (iHashResult != 0 || hashSizeLimit > 0) break;
+        if (iHashResult != 0) break;
+
+        // Pay for what was read; the hash rate limit is configured in megabytes
+        queue->Throttle(throttle->m_HashBytes.Reserve(iReadBytes, COptions::HashRateLimit * 1024.0 * 1024.0));
+        if (hashSizeLimit > 0) break;
         queue->WaitIfSuspended();
     }
 
@@ -1381,3 +2058,4 @@ std::wstring CItem::GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<CItem*>*
         sHash.data(), &iHashStringLength);
     return sHash;
 }
+#endif
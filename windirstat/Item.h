@@ -21,13 +21,25 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "TreeListControl.h"
 #include "TreeMap.h"
 #include "DirStatDoc.h" // CExtensionData
+#else
+#include "ItemBasePosix.h"
+#endif
 #include "FileFind.h" // FileFindEnhanced
 #include "BlockingQueue.h"
+#include "ExtensionRegistry.h"
+#include "ItemArena.h"
+#include "ScanJob.h"
+#include "TokenBucket.h"
 
-#include <shared_mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+
+class CItemDupe;
 
 // Columns
 enum ITEMCOLUMNS
@@ -60,15 +72,16 @@ enum ITEMTYPE : unsigned short
     ITF_ROOTITEM  = 1 << 9,  // Indicates root item
     ITF_PARTHASH  = 1 << 10, // Indicates a partial hash
     ITF_FULLHASH  = 1 << 11, // Indicates a full hash
+    ITF_NOACCESS  = 1 << 12, // Indicates a folder that could not be opened
     ITF_FLAGS     = 0xFF00,  // All potential flag items
 };
 
-inline ITEMTYPE operator|(const ITEMTYPE & a, const ITEMTYPE & b)
+constexpr ITEMTYPE operator|(const ITEMTYPE & a, const ITEMTYPE & b)
 {
     return static_cast<ITEMTYPE>(static_cast<unsigned short>(a) | static_cast<unsigned short>(b));
 }
 
-inline ITEMTYPE operator-(const ITEMTYPE& a, const ITEMTYPE& b)
+constexpr ITEMTYPE operator-(const ITEMTYPE& a, const ITEMTYPE& b)
 {
     return static_cast<ITEMTYPE>(static_cast<unsigned short>(a) & ~static_cast<unsigned short>(b));
 }
@@ -115,6 +128,22 @@ public:
         ULONGLONG sizeLogical, DWORD attributes, ULONG files, ULONG subdirs);
     ~CItem() override;
 
+    // Items live in the arena of their tree; plain allocations use the shared one
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, CItemArena* arena);
+    static void operator delete(void* item);
+    static void operator delete(void* item, CItemArena* arena);
+
+    // Frees a tree that has an arena of its own at once; files and names are
+    // dropped together with their slabs instead of being deleted one by one
+    static void DeleteTree(CItem* root);
+
+    // Same as above on a background thread of low priority so the caller is
+    // not held up by a large tree; releases are carried out in the order they
+    // were requested, so a tree goes after children detached from it before
+    static void DeleteTreeAsync(CItem* root, CItemDupe* dupes = nullptr);
+
+#ifdef _WIN32
     // CTreeListItem Interface
     bool DrawSubitem(int subitem, CDC* pdc, CRect rc, UINT state, int* width, int* focusLeft) const override;
     std::wstring GetText(int subitem) const override;
@@ -124,6 +153,7 @@ public:
     CTreeListItem* GetTreeListChild(int i) const override;
     short GetImageToCache() const override;
     void DrawAdditionalState(CDC* pdc, const CRect& rcLabel) const override;
+#endif
 
     // CTreeMap::Item interface
     bool TmiIsLeaf() const override
@@ -131,13 +161,12 @@ public:
         return IsType(IT_FILE | IT_FREESPACE | IT_UNKNOWN);
     }
 
-    CRect TmiGetRectangle() const override;
-    void TmiSetRectangle(const CRect& rc) override;
-
+#ifdef _WIN32
     COLORREF TmiGetGraphColor() const override
     {
         return GetGraphColor();
     }
+#endif
 
     int TmiGetChildCount() const override
     {
@@ -156,17 +185,23 @@ public:
     }
 
     // CItem
+#ifdef _WIN32
     static int GetSubtreePercentageWidth();
+#endif
     static CItem* FindCommonAncestor(const CItem* item1, const CItem* item2);
 
     ULONGLONG GetProgressRange() const;
     ULONGLONG GetProgressPos() const;
     void UpdateStatsFromDisk();
-    const std::vector<CItem*>& GetChildren() const;
+    std::vector<CItem*> UpdateChildrenFromDisk();
+    std::span<CItem* const> GetChildren() const;
     CItem* GetParent() const;
     void AddChild(CItem* child, bool addOnly = false);
+    void AddChildren(const std::vector<CItem*>& children);
     void RemoveChild(CItem* child);
     void RemoveAllChildren();
+    void RecurseResetTotals();
+    void RecurseFreeze();
     void UpwardAddFolders(ULONG dirCount);
     void UpwardSubtractFolders(ULONG dirCount);
     void UpwardAddFiles(ULONG fileCount);
@@ -193,11 +228,15 @@ public:
     bool IsRootItem() const;
     std::wstring GetPath() const;
     std::wstring GetPathLong() const;
+#ifdef _WIN32
     std::wstring GetOwner(bool force = false) const;
+#endif
     bool HasUncPath() const;
     std::wstring GetFolderPath() const;
     std::wstring GetName() const;
+    std::wstring_view GetNameView() const { return CItemArena::NameView(m_Name); }
     std::wstring GetExtension() const;
+    EXTENSIONID GetExtensionId() const { return m_Extension; }
     ULONG GetFilesCount() const;
     ULONG GetFoldersCount() const;
     ULONGLONG GetItemsCount() const;
@@ -205,21 +244,28 @@ public:
     void SortItemsBySizePhysical() const;
     ULONGLONG GetTicksWorked() const;
     void ResetScanStartTime() const;
-    static void ScanItems(BlockingQueue<CItem*> *);
+    static void ScanItems(BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, SCANTHROTTLE* throttle);
+    static void ScanSizesPhysical(BlockingQueue<CItem*>* queue);
     static void ScanItemsFinalize(CItem* item);
     void UpwardSetDone();
     void UpwardSetUndone();
     CItem* FindRecyclerItem() const;
+#ifdef _WIN32
     void CreateFreeSpaceItem();
+#endif
     CItem* FindFreeSpaceItem() const;
     void UpdateFreeSpaceItem() const;
     void RemoveFreeSpaceItem();
+#ifdef _WIN32
     void CreateUnknownItem();
+#endif
     CItem* FindUnknownItem() const;
     void UpdateUnknownItem() const;
     void RemoveUnknownItem();
+#ifdef _WIN32
     void CollectExtensionData(CExtensionData* ed) const;
-    std::wstring GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<CItem*>* queue);
+    std::wstring GetFileHash(ULONGLONG hashSizeLimit, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle);
+#endif
 
     bool IsDone() const
     {
@@ -250,35 +296,111 @@ public:
 private:
     ULONGLONG GetProgressRangeMyComputer() const;
     ULONGLONG GetProgressRangeDrive() const;
+#ifdef _WIN32
     COLORREF GetGraphColor() const;
     bool MustShowReadJobs() const;
     COLORREF GetPercentageColor() const;
+#endif
     std::wstring UpwardGetPathWithoutBackslash() const;
-    CItem* AddDirectory(const FileFindEnhanced& finder);
-    CItem* AddFile(const FileFindEnhanced& finder);
-    void UpwardDrivePacman();
+
+    // Totals and new children gathered while enumerating a single directory
+    // so they can be published in one pass instead of once per entry
+    using SCANTOTALS = struct SCANTOTALS
+    {
+        std::vector<CItem*> m_Children;
+        ULONGLONG m_SizePhysical = 0;
+        ULONGLONG m_SizeLogical = 0;
+        FILETIME m_LastChange = {};
+        ULONG m_Files = 0;
+        ULONG m_Subdirs = 0;
+        ULONG m_Entries = 0;
+    };
+
+    // State of a directory while its entries are being read; children are
+    // only present on rescans that reuse items and are matched by name
+    using SCANDIRECTORY = struct SCANDIRECTORY
+    {
+        FileFindEnhanced m_Finder;
+        SCANTOTALS m_Totals;
+        std::unordered_map<std::wstring_view, CItem*> m_Previous;
+        std::vector<CItem*> m_Stale;
+        ULONGLONG m_LastFlush = 0;
+        CItem* m_Item = nullptr;
+    };
+
+#ifdef _WIN32
+    // Returns false without taking any items if no completion port is available
+    static bool ScanItemsAsync(BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, SCANTHROTTLE* throttle);
+#endif
+    void BeginScan(SCANDIRECTORY& scan, BlockingQueue<SCANJOB>* queue, SCANTHROTTLE* throttle);
+    void ScanEntry(SCANDIRECTORY& scan, BlockingQueue<SCANJOB>* queue, BlockingQueue<CItem*>* sizeQueue, SCANTHROTTLE* throttle);
+    void EndScan(SCANDIRECTORY& scan);
+    void ScanOther(BlockingQueue<SCANJOB>* queue);
+
+    CItem* AddDirectory(const FileFindEnhanced& finder, SCANTOTALS& totals, CItem* existing = nullptr);
+    CItem* AddFile(const FileFindEnhanced& finder, SCANTOTALS& totals, CItem* existing = nullptr);
+    bool MatchesFile(const FileFindEnhanced& finder) const;
+    void UpwardAddTotals(SCANTOTALS& totals);
+
+    // Children of a container. While the container can still change they are
+    // kept in an array of its own; freezing moves them into a block of the
+    // arena shared with the rest of the subtree so only the range is left.
+    // Changing a frozen list thaws it by copying the range back out.
+    class CHILDLIST final
+    {
+    public:
+        CHILDLIST() = default;
+        CHILDLIST(const CHILDLIST&) = delete;
+        CHILDLIST& operator=(const CHILDLIST&) = delete;
+        ~CHILDLIST();
+
+        CItem** begin() const { return m_Items; }
+        CItem** end() const { return m_Items + m_Size; }
+        size_t size() const { return m_Size; }
+        bool empty() const { return m_Size == 0; }
+        CItem* operator[](const size_t i) const { return m_Items[i]; }
+        bool IsFrozen() const { return m_Items != nullptr && m_Capacity == 0; }
+
+        void Append(CItem* const* children, size_t count);
+        void Remove(const CItem* child);
+        void Clear();
+        void ShrinkToFit();
+        void Freeze(CItem** block);
+
+    private:
+        void Reallocate(size_t capacity);
+
+        CItem** m_Items = nullptr;
+        ULONG m_Size = 0;
+        ULONG m_Capacity = 0; // zero while frozen
+    };
 
     // Special structure for container items that is separately allocated to
     // reduce memory usage.  This operates under the assumption that most
-    // containers have files in them.
+    // containers have files in them. Only what a finished folder still needs
+    // is kept here: the parent handle used while scanning travels with the
+    // queue entry (SCANJOB) and changes to the children are serialized by
+    // locks shared between folders.
     using CHILDINFO = struct CHILDINFO
     {
-        std::vector<CItem*> m_Children;
-        std::shared_mutex m_Protect;
+        CHILDLIST m_Children;
         std::atomic<ULONG> m_Tstart = 0;  // initial time this node started enumerating
         std::atomic<ULONG> m_Tfinish = 0; // initial time this node started enumerating
         std::atomic<ULONG> m_Files = 0;   // # Files in subtree
         std::atomic<ULONG> m_Subdirs = 0; // # Folder in subtree
         std::atomic<ULONG> m_Jobs = 0;    // # "read jobs" in subtree.
     };
+    static_assert(sizeof(CHILDINFO) <= 40); // one per folder
 
-    RECT m_Rect;                                // To support TreeMapView
-    std::wstring m_Name;                        // Display name
-    LPCWSTR m_Extension = nullptr;              // Cache of extension (it's used often)
+    LPCWSTR m_Name = nullptr;                   // Display name stored in the arena
     FILETIME m_LastChange = {0, 0};             // Last modification time of self or subtree
     CHILDINFO* m_FolderInfo = nullptr;          // Child information for non-files
     std::atomic<ULONGLONG> m_SizePhysical = 0;  // Total physical size of self or subtree
     std::atomic<ULONGLONG> m_SizeLogical = 0;   // Total local size of self or subtree
     DWORD m_Attributes = 0;                     // Packed file attributes of the item
+    EXTENSIONID m_Extension = CExtensionRegistry::NONE; // Registered extension of files
     ITEMTYPE m_Type;                            // Indicates our type.
 };
+
+// One per file or folder, so growth shows up directly in memory usage
+static_assert(sizeof(CItem) <= 88);
@@ -0,0 +1,260 @@
+// ItemArena.cpp - Implementation of CItemArena
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifdef _WIN32
+#include "stdafx.h"
+#endif
+
+#include "ItemArena.h"
+#include <common/Constants.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <unordered_set>
+
+namespace
+{
+    // Slots are aligned like any other heap allocation
+    constexpr size_t SLOT_ALIGNMENT = alignof(std::max_align_t);
+
+    constexpr size_t AlignUp(const size_t value, const size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+BYTE* CItemArena::SLAB::Begin()
+{
+    return reinterpret_cast<BYTE*>(this) + AlignUp(sizeof(SLAB), SLOT_ALIGNMENT);
+}
+
+size_t CItemArena::SLAB::GetCapacity() const
+{
+    const size_t bytes = m_Size - AlignUp(sizeof(SLAB), SLOT_ALIGNMENT);
+    return m_SlotSize == 0 ? bytes : bytes / m_SlotSize;
+}
+
+CItemArena::CItemArena() : m_Recent(RECENT_NAMES) {}
+
+CItemArena::~CItemArena()
+{
+    for (const auto& pool : m_Pools)
+    {
+        for (const auto slab : pool.m_Slabs)
+        {
+#ifdef _WIN32
+            VirtualFree(slab, 0, MEM_RELEASE);
+#else
+            std::free(slab);
+#endif
+        }
+    }
+}
+
+CItemArena* CItemArena::Create()
+{
+    return new CItemArena();
+}
+
+CItemArena* CItemArena::Default()
+{
+    // Never released since the items allocated here have no common owner
+    static const auto arena = new CItemArena();
+    return arena;
+}
+
+void CItemArena::Release(CItemArena* arena)
+{
+    ASSERT(arena != Default());
+    delete arena;
+}
+
+CItemArena::SLAB* CItemArena::SlabOf(const void* object)
+{
+    return reinterpret_cast<SLAB*>(reinterpret_cast<ULONG_PTR>(object) & ~static_cast<ULONG_PTR>(SLAB_SIZE - 1));
+}
+
+CItemArena* CItemArena::Of(const void* object)
+{
+    return SlabOf(object)->m_Arena;
+}
+
+CItemArena::SLAB* CItemArena::NewSlab(const POOL pool, const size_t slotSize, const size_t size)
+{
+    // Callers hold the lock since the list of slabs is shared
+    const size_t reserve = AlignUp(size, SLAB_SIZE);
+#ifdef _WIN32
+    void* memory = VirtualAlloc(nullptr, reserve, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* memory = std::aligned_alloc(SLAB_SIZE, reserve);
+#endif
+    if (memory == nullptr) throw std::bad_alloc();
+
+    const auto slab = new (memory) SLAB{ this, reserve, slotSize, 0, pool };
+    m_Pools[pool].m_Slabs.push_back(slab);
+    m_Pools[pool].m_Reserved += reserve;
+    m_BytesReserved += reserve;
+    return slab;
+}
+
+void* CItemArena::Allocate(const POOL pool, const size_t size)
+{
+    ASSERT(pool != POOL_NAMES && pool != POOL_BLOCKS);
+    SLABPOOL& slabs = m_Pools[pool];
+    const size_t slotSize = AlignUp(size, SLOT_ALIGNMENT);
+
+    // Slots of freed objects are reused first
+    if (slabs.m_FreeCount.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard lock(m_Mutex);
+        if (!slabs.m_Free.empty())
+        {
+            void* slot = slabs.m_Free.back();
+            slabs.m_Free.pop_back();
+            slabs.m_FreeCount--;
+            slabs.m_Live++;
+            return slot;
+        }
+    }
+
+    for (;;)
+    {
+        // Claim the next slot of the current slab without locking
+        SLAB* slab = slabs.m_Current.load(std::memory_order_acquire);
+        if (slab != nullptr)
+        {
+            ASSERT(slab->m_SlotSize == slotSize);
+            const size_t index = slab->m_Used.fetch_add(1, std::memory_order_relaxed);
+            if (index < slab->GetCapacity())
+            {
+                slabs.m_Live++;
+                return slab->Begin() + index * slab->m_SlotSize;
+            }
+        }
+
+        // Only one thread replaces a full slab; the others retry with its successor
+        std::lock_guard lock(m_Mutex);
+        if (slabs.m_Current.load(std::memory_order_relaxed) == slab)
+        {
+            slabs.m_Current.store(NewSlab(pool, slotSize, SLAB_SIZE), std::memory_order_release);
+        }
+    }
+}
+
+void CItemArena::Free(void* object)
+{
+    if (object == nullptr) return;
+
+    const SLAB* slab = SlabOf(object);
+    CItemArena* arena = slab->m_Arena;
+    SLABPOOL& slabs = arena->m_Pools[slab->m_Pool];
+
+    std::lock_guard lock(arena->m_Mutex);
+    slabs.m_Free.push_back(object);
+    slabs.m_FreeCount++;
+    slabs.m_Live--;
+}
+
+LPCWSTR CItemArena::StoreName(const std::wstring_view name)
+{
+    // Repeated names such as .git or node_modules are usually still in the
+    // table of recent names and are shared instead of being stored again
+    const bool shareable = name.size() <= MAX_SHARED_NAME;
+    std::atomic<LPCWSTR>* recent = nullptr;
+    if (shareable)
+    {
+        recent = &m_Recent[std::hash<std::wstring_view>{}(name) & (RECENT_NAMES - 1)];
+        if (const LPCWSTR match = recent->load(std::memory_order_acquire);
+            match != nullptr && NameView(match) == name)
+        {
+            m_NameBytesShared += (name.size() + 1) * sizeof(WCHAR);
+            return match;
+        }
+    }
+
+    // Names are never freed on their own; they go away with the arena
+    const size_t bytes = AlignUp(sizeof(ULONG) + (name.size() + 1) * sizeof(WCHAR), sizeof(ULONG));
+    m_NameBytes += bytes;
+
+    // The length precedes the characters so a name is a single pointer
+    const auto length = static_cast<ULONG*>(Bump(POOL_NAMES, bytes));
+    *length = static_cast<ULONG>(name.size());
+    const auto text = reinterpret_cast<WCHAR*>(length + 1);
+    std::ranges::copy(name, text);
+    text[name.size()] = wds::chrNull;
+    if (shareable) recent->store(text, std::memory_order_release);
+    return text;
+}
+
+void* CItemArena::AllocateBlock(const size_t size)
+{
+    const size_t bytes = AlignUp(size, sizeof(void*));
+    m_BlockBytes += bytes;
+    return Bump(POOL_BLOCKS, bytes);
+}
+
+void* CItemArena::Bump(const POOL pool, const size_t bytes)
+{
+    SLABPOOL& chunks = m_Pools[pool];
+    for (;;)
+    {
+        SLAB* chunk = chunks.m_Current.load(std::memory_order_acquire);
+        if (chunk != nullptr)
+        {
+            const size_t offset = chunk->m_Used.fetch_add(bytes, std::memory_order_relaxed);
+            if (offset + bytes <= chunk->GetCapacity()) return chunk->Begin() + offset;
+        }
+
+        std::lock_guard lock(m_Mutex);
+
+        // Very long root paths or huge folders do not fit into a chunk and get their own
+        if (bytes > SLAB_SIZE - AlignUp(sizeof(SLAB), SLOT_ALIGNMENT))
+        {
+            SLAB* large = NewSlab(pool, 0, AlignUp(sizeof(SLAB), SLOT_ALIGNMENT) + bytes);
+            large->m_Used = bytes;
+            return large->Begin();
+        }
+
+        if (chunks.m_Current.load(std::memory_order_relaxed) == chunk)
+        {
+            chunks.m_Current.store(NewSlab(pool, 0, SLAB_SIZE), std::memory_order_release);
+        }
+    }
+}
+
+void CItemArena::ForEachLive(const POOL pool, const std::function<void(void*)>& callback)
+{
+    // Only valid while nothing else allocates from or frees into the arena
+    ASSERT(pool != POOL_NAMES && pool != POOL_BLOCKS);
+    SLABPOOL& slabs = m_Pools[pool];
+    const std::unordered_set<void*> free(slabs.m_Free.begin(), slabs.m_Free.end());
+
+    for (const auto slab : slabs.m_Slabs)
+    {
+        const size_t used = std::min(slab->m_Used.load(), slab->GetCapacity());
+        for (size_t i = 0; i < used; i++)
+        {
+            void* slot = slab->Begin() + i * slab->m_SlotSize;
+            if (!free.contains(slot)) callback(slot);
+        }
+    }
+}
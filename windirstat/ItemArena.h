@@ -0,0 +1,147 @@
+// ItemArena.h - Declaration of CItemArena
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include "stdafx.h"
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+//
+// CItemArena. Memory of the items of one tree. Items and folder information
+// are carved from 64 KB slabs of equally sized slots while names and other
+// blocks of varying size are bump allocated from chunks of the same size,
+// so a scan makes one allocation per few hundred items instead of several
+// per item. Names that repeat across a tree are shared while they are still
+// found in a small table of recently stored names, which keeps the table
+// bounded regardless of the tree size.
+//
+// Slabs are aligned to their size so the arena of any object is found by
+// masking its address. Single objects can still be freed and their slots
+// are reused; a whole tree is released by returning its slabs.
+//
+class CItemArena final
+{
+public:
+
+    enum POOL : unsigned char
+    {
+        POOL_ITEMS,
+        POOL_FOLDERS,
+        POOL_NAMES,
+        POOL_BLOCKS,
+        POOL_COUNT
+    };
+
+private:
+
+    // Matches the allocation granularity of VirtualAlloc so slabs are aligned
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    // Longer names are rarely repeated and are never looked up
+    static constexpr size_t RECENT_NAMES = 16 * 1024;
+    static constexpr size_t MAX_SHARED_NAME = 64;
+
+    using SLAB = struct SLAB
+    {
+        CItemArena* m_Arena;
+        size_t m_Size;                 // bytes reserved including this header
+        size_t m_SlotSize;             // zero for chunks of names and blocks
+        std::atomic<size_t> m_Used;    // slots or bytes handed out; may overshoot
+        POOL m_Pool;
+
+        BYTE* Begin();
+        size_t GetCapacity() const;
+    };
+
+    using SLABPOOL = struct SLABPOOL
+    {
+        std::atomic<SLAB*> m_Current = nullptr;
+        std::atomic<size_t> m_FreeCount = 0;
+        std::atomic<size_t> m_Live = 0;
+        std::atomic<size_t> m_Reserved = 0;
+        std::vector<void*> m_Free;
+        std::vector<SLAB*> m_Slabs;
+    };
+
+    std::mutex m_Mutex;
+    SLABPOOL m_Pools[POOL_COUNT];
+    std::atomic<size_t> m_BytesReserved = 0;
+    std::vector<std::atomic<LPCWSTR>> m_Recent;
+    std::atomic<size_t> m_NameBytes = 0;
+    std::atomic<size_t> m_NameBytesShared = 0;
+    std::atomic<size_t> m_BlockBytes = 0;
+    std::atomic<ptrdiff_t> m_HeapBytes = 0;
+
+    SLAB* NewSlab(POOL pool, size_t slotSize, size_t size);
+    void* Bump(POOL pool, size_t bytes);
+    static SLAB* SlabOf(const void* object);
+
+    CItemArena();
+    ~CItemArena();
+
+public:
+
+    CItemArena(const CItemArena&) = delete;
+    CItemArena& operator=(const CItemArena&) = delete;
+
+    // New arena for a new tree and the shared one used by plain allocations
+    static CItemArena* Create();
+    static CItemArena* Default();
+
+    // Frees the arena with everything in it without running any destructors
+    static void Release(CItemArena* arena);
+
+    static CItemArena* Of(const void* object);
+    static void Free(void* object);
+
+    void* Allocate(POOL pool, size_t size);
+
+    // Stores a name or returns an equal one stored before; the result stays
+    // valid as long as the arena and is null terminated
+    LPCWSTR StoreName(std::wstring_view name);
+    static std::wstring_view NameView(LPCWSTR name) { return { name, reinterpret_cast<const ULONG*>(name)[-1] }; }
+
+    // Memory of any size that is only freed together with the arena
+    void* AllocateBlock(size_t size);
+
+    // Heap memory owned by objects of the arena, e.g. child lists that are
+    // still growing; only counted so it can be reported with the arena
+    void AddHeapBytes(const ptrdiff_t bytes) { m_HeapBytes += bytes; }
+
+    // Visits the objects of a pool that have been allocated and not freed
+    void ForEachLive(POOL pool, const std::function<void(void*)>& callback);
+
+    size_t GetBytesReserved() const { return m_BytesReserved; }
+    size_t GetBytesReserved(const POOL pool) const { return m_Pools[pool].m_Reserved; }
+    size_t GetHeapBytes() const { return static_cast<size_t>(m_HeapBytes.load()); }
+    size_t GetNameBytes() const { return m_NameBytes; }
+    size_t GetNameBytesShared() const { return m_NameBytesShared; }
+    size_t GetBlockBytes() const { return m_BlockBytes; }
+    size_t GetLiveCount(const POOL pool) const { return m_Pools[pool].m_Live; }
+};
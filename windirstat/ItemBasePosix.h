@@ -0,0 +1,76 @@
+// ItemBasePosix.h - Base classes of CItem for non-Windows builds
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "PosixCompat.h"
+
+//
+// CTreeListItem and CTreeMap::Item without the views behind them, so the
+// item model and the scan engine build for headless use on other systems.
+// Only what the model uses is kept and the data members are laid out like
+// the originals so an item takes the same memory as on Windows. Items are
+// never shown here, so there is never any VISIBLEINFO.
+//
+class CTreeListItem
+{
+    struct VISIBLEINFO;
+
+public:
+    CTreeListItem() = default;
+    virtual ~CTreeListItem() = default;
+
+    CTreeListItem* GetParent() const { return m_Parent; }
+    void SetParent(CTreeListItem* parent) { m_Parent = parent; }
+    bool IsVisible() const { return false; }
+
+    bool IsAncestorOf(const CTreeListItem* item) const
+    {
+        for (auto p = item; p != nullptr; p = p->GetParent())
+        {
+            if (p == this) return true;
+        }
+        return false;
+    }
+
+protected:
+    mutable VISIBLEINFO* m_VisualInfo = nullptr;
+
+private:
+    CTreeListItem* m_Parent = nullptr;
+};
+
+class CTreeMap final
+{
+public:
+    class Item
+    {
+    public:
+        virtual ~Item() = default;
+        virtual bool TmiIsLeaf() const = 0;
+        virtual int TmiGetChildCount() const = 0;
+        virtual Item* TmiGetChild(int c) const = 0;
+        virtual ULONGLONG TmiGetSize() const = 0;
+    };
+};
+
+#endif
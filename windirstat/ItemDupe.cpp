@@ -112,6 +112,19 @@ const std::vector<CItemDupe*>& CItemDupe::GetChildren() const
     return m_Children;
 }
 
+size_t CItemDupe::GetBytesUsed() const
+{
+    // Nodes are only changed in the message thread which is also the caller
+    size_t bytes = sizeof(CItemDupe) + m_Children.capacity() * sizeof(CItemDupe*) +
+        columnMap.bucket_count() * 2 * sizeof(void*) + columnMap.size() * (2 * sizeof(void*) + sizeof(std::pair<const int, int>));
+    if (m_Hash.capacity() > std::wstring().capacity()) bytes += (m_Hash.capacity() + 1) * sizeof(WCHAR);
+    for (const auto& child : m_Children)
+    {
+        bytes += child->GetBytesUsed();
+    }
+    return bytes;
+}
+
 CItemDupe* CItemDupe::GetParent() const
 {
     return reinterpret_cast<CItemDupe*>(CTreeListItem::GetParent());
@@ -79,4 +79,7 @@ public:
     void AddChild(CItemDupe* child);
     void RemoveChild(CItemDupe* child);
     void RemoveAllChildren();
+
+    // Memory held by this node and all nodes below it
+    size_t GetBytesUsed() const;
 };
@@ -366,6 +366,7 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWndEx)
     ON_UPDATE_COMMAND_UI(ID_VIEW_SHOWFILETYPES, OnUpdateViewShowFileTypes)
     ON_UPDATE_COMMAND_UI(ID_VIEW_SHOWTREEMAP, OnUpdateViewShowtreemap)
     ON_UPDATE_COMMAND_UI(IDS_RAMUSAGEs, OnUpdateEnableControl)
+    ON_UPDATE_COMMAND_UI(IDS_SCANTHREADSs, OnUpdateEnableControl)
     ON_UPDATE_COMMAND_UI(IDS_IDLEMESSAGE, OnUpdateEnableControl)
     ON_WM_CLOSE()
     ON_WM_CREATE()
@@ -378,14 +379,16 @@ END_MESSAGE_MAP()
 
 constexpr auto ID_INDICATOR_IDLEMESSAGE_INDEX = 0;
 constexpr auto ID_INDICATOR_MEMORYUSAGE_INDEX = 1;
-constexpr auto ID_INDICATOR_CAPS_INDEX = 2;
-constexpr auto ID_INDICATOR_NUM_INDEX = 3;
-constexpr auto ID_INDICATOR_SCRL_INDEX = 4;
+constexpr auto ID_INDICATOR_SCANTHREADS_INDEX = 2;
+constexpr auto ID_INDICATOR_CAPS_INDEX = 3;
+constexpr auto ID_INDICATOR_NUM_INDEX = 4;
+constexpr auto ID_INDICATOR_SCRL_INDEX = 5;
 
 constexpr UINT indicators[]
 {
     IDS_IDLEMESSAGE,
     IDS_RAMUSAGEs,
+    IDS_SCANTHREADSs,
     ID_INDICATOR_CAPS,
     ID_INDICATOR_NUM,
     ID_INDICATOR_SCRL,
@@ -589,6 +592,26 @@ void CMainFrame::DestroyProgress()
     m_ProgressVisible = false;
 }
 
+void CMainFrame::SetScanThreadsText(const std::wstring& text)
+{
+    SetStatusPaneText(ID_INDICATOR_SCANTHREADS_INDEX, Localization::Format(IDS_SCANTHREADSs, text));
+}
+
+void CMainFrame::UpdateMemoryUsage()
+{
+    SetStatusPaneText(ID_INDICATOR_MEMORYUSAGE_INDEX, CDirStatApp::GetCurrentProcessMemoryInfo());
+
+    // What the results hold is shown when hovering over the process usage
+    const CMemoryUsage usage = CDirStatDoc::GetDocument()->GetMemoryUsage();
+    const std::wstring tip = Localization::Format(IDS_MEMORYBREAKDOWNssssssssss,
+        FormatBytes(usage.GetTotal()), FormatCount(usage.GetItemCount()), usage.GetTotalPerItem(),
+        FormatBytes(usage.GetBytes(CMemoryUsage::PART_ITEMS)), FormatBytes(usage.GetBytes(CMemoryUsage::PART_FOLDERS)),
+        FormatBytes(usage.GetBytes(CMemoryUsage::PART_NAMES)), FormatBytes(usage.GetBytes(CMemoryUsage::PART_EXTENSIONS)),
+        FormatBytes(usage.GetBytes(CMemoryUsage::PART_VISIBLE)), FormatBytes(usage.GetBytes(CMemoryUsage::PART_TRACKERS)),
+        FormatBytes(usage.GetBytes(CMemoryUsage::PART_DUPES)));
+    m_WndStatusBar.SetTipText(ID_INDICATOR_MEMORYUSAGE_INDEX, tip.c_str());
+}
+
 void CMainFrame::SetStatusPaneText(const int pos, const std::wstring & text)
 {
     // do not process the update if text is the same
@@ -624,6 +647,7 @@ int CMainFrame::OnCreate(LPCREATESTRUCT lpCreateStruct)
     SetStatusPaneText(ID_INDICATOR_NUM_INDEX, Localization::Lookup(IDS_INDICATOR_NUM));
     SetStatusPaneText(ID_INDICATOR_SCRL_INDEX, Localization::Lookup(IDS_INDICATOR_SCRL));
     SetStatusPaneText(ID_INDICATOR_MEMORYUSAGE_INDEX, CDirStatApp::GetCurrentProcessMemoryInfo());
+    SetScanThreadsText(std::to_wstring(COptions::ScanningThreads.Obj()));
 
     m_WndDeadFocus.Create(this);
 
@@ -694,8 +718,62 @@ void CMainFrame::InitialShowWindow()
 
 void CMainFrame::InvokeInMessageThread(std::function<void()> callback) const
 {
-    if (CDirStatApp::Get()->m_nThreadID == GetCurrentThreadId()) callback();
-    else Get()->SendMessage(WM_CALLBACKUI, 0, reinterpret_cast<LPARAM>(&callback));
+    if (!IsMessageThread()) Get()->SendMessage(WM_CALLBACKUI, 0, reinterpret_cast<LPARAM>(&callback));
+    else
+    {
+        // Queued changes always come first so callbacks see the same tree as the caller
+        Get()->ProcessUiEvents();
+        callback();
+    }
+}
+
+bool CMainFrame::IsMessageThread()
+{
+    return CDirStatApp::Get()->m_nThreadID == GetCurrentThreadId();
+}
+
+void CMainFrame::QueueChildAdded(CItem* parent, CItem* child)
+{
+    m_UiEvents.Push({ UIEVENT::CHILD_ADDED, parent, child });
+    if (IsMessageThread()) ProcessUiEvents();
+}
+
+// The child is deleted once the change has been applied
+void CMainFrame::QueueChildRemoved(CItem* parent, CItem* child)
+{
+    m_UiEvents.Push({ UIEVENT::CHILD_REMOVED, parent, child });
+    if (IsMessageThread()) ProcessUiEvents();
+}
+
+void CMainFrame::ProcessUiEvents()
+{
+    // Additions are grouped per parent so each expanded folder is only
+    // sorted once no matter how many children arrived since the last run
+    std::unordered_map<CItem*, std::vector<CTreeListItem*>> added;
+    const auto flushAdded = [&]
+    {
+        for (const auto& [parent, children] : added)
+        {
+            CFileTreeControl::Get()->OnChildrenAdded(parent, children);
+        }
+        added.clear();
+    };
+
+    for (const auto& event : m_UiEvents.PopAll())
+    {
+        if (event.m_Type == UIEVENT::CHILD_ADDED)
+        {
+            added[event.m_Parent].push_back(event.m_Child);
+            continue;
+        }
+
+        // Earlier additions may involve the removed item or its descendants
+        flushAdded();
+        CFileTreeControl::Get()->OnChildRemoved(event.m_Parent, event.m_Child);
+        if (m_TreeMapView != nullptr) m_TreeMapView->OnItemRemoved();
+        delete event.m_Child;
+    }
+    flushAdded();
 }
 
 void CMainFrame::OnClose()
@@ -704,6 +782,7 @@ void CMainFrame::OnClose()
 
     // Suspend the scan and wait for scan to complete
     CDirStatDoc::GetDocument()->StopScanningEngine();
+    ProcessUiEvents();
 
     // Stop the timer so we are not updating elements during shutdown
     KillTimer(ID_WDS_CONTROL);
@@ -824,12 +903,18 @@ void CMainFrame::OnTimer(const UINT_PTR nIDEvent)
     if (updateCounter++ % 15 == 0)
     {
         // Update memory usage
-        SetStatusPaneText(ID_INDICATOR_MEMORYUSAGE_INDEX, CDirStatApp::GetCurrentProcessMemoryInfo());
+        UpdateMemoryUsage();
 
         // Force toolbar updates since they do not appear to always receive onidle commands
         m_WndToolBar.OnUpdateCmdUI(this, FALSE);
+
+        // Apply any settled file system changes to the finished results
+        CDirStatDoc::GetDocument()->ApplyWatchedChanges();
     }
 
+    // Show tree changes reported by the scan threads
+    ProcessUiEvents();
+
     // UI updates that do need to processed frequently
     if (!CDirStatDoc::GetDocument()->IsRootDone() && !IsScanSuspended())
     {
@@ -838,6 +923,7 @@ void CMainFrame::OnTimer(const UINT_PTR nIDEvent)
 
         // By sorting items, items will be redrawn which will
         // also force pacman to update with recent position
+        CFileTreeControl::Get()->DrivePacmen();
         CFileTreeControl::Get()->SortItems();
     }
 
@@ -846,6 +932,7 @@ void CMainFrame::OnTimer(const UINT_PTR nIDEvent)
 
 LRESULT CMainFrame::OnCallbackRequest(WPARAM, const LPARAM lParam)
 {
+    ProcessUiEvents();
     const auto & callback = *static_cast<std::function<void()>*>(reinterpret_cast<LPVOID>(lParam));
     callback();
     return 0;
@@ -24,6 +24,7 @@
 #include "PacMan.h"
 #include "Item.h"
 #include "FileTabbedView.h"
+#include "MpscQueue.h"
 
 #include <functional>
 
@@ -147,8 +148,21 @@ protected:
     ~CMainFrame() override;
     DECLARE_DYNCREATE(CMainFrame)
 
+    // Tree changes reported by scan threads; they are queued without waiting
+    // for the message thread and applied in batches by ProcessUiEvents()
+    using UIEVENT = struct UIEVENT
+    {
+        enum : BYTE { CHILD_ADDED, CHILD_REMOVED } m_Type;
+        CItem* m_Parent;
+        CItem* m_Child;
+    };
+
     void InitialShowWindow();
     void InvokeInMessageThread(std::function<void()> callback) const;
+    void QueueChildAdded(CItem* parent, CItem* child);
+    void QueueChildRemoved(CItem* parent, CItem* child);
+    void ProcessUiEvents();
+    static bool IsMessageThread();
 
     void RestoreTreeMapView();
     void RestoreExtensionView();
@@ -170,6 +184,8 @@ protected:
     void SetProgressComplete();
     void SuspendState(bool suspend);
     bool IsScanSuspended() const;
+    void SetScanThreadsText(const std::wstring& text);
+    void UpdateMemoryUsage();
 
     void UpdateProgress();
     void UpdateDynamicMenuItems(const CMenu* menu) const;
@@ -201,6 +217,7 @@ protected:
     ULONGLONG m_ProgressRange = 0;  // Progress range. A range of 0 means Pacman should be used.
     ULONGLONG m_ProgressPos = 0;    // Progress position (<= progressRange, or an item count in case of m_ProgressRang == 0)
     CItem* m_WorkingItem = nullptr;
+    MpscQueue<UIEVENT> m_UiEvents;  // Tree changes waiting to be shown
 
     CMySplitterWnd m_SubSplitter; // Contains the two upper views
     CMySplitterWnd m_Splitter;    // Contains (a) m_WndSubSplitter and (b) the graph view.
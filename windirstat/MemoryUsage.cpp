@@ -0,0 +1,69 @@
+// MemoryUsage.cpp - Implementation of CMemoryUsage
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifdef _WIN32
+#include "stdafx.h"
+#include "FileDupeControl.h"
+#endif
+
+#include "MemoryUsage.h"
+#include "ExtensionRegistry.h"
+#include "Item.h"
+#include "ItemArena.h"
+
+#include <numeric>
+
+CMemoryUsage CMemoryUsage::Collect(const CItem* root)
+{
+    CMemoryUsage usage;
+    usage.Add(PART_EXTENSIONS, CExtensionRegistry::GetBytesUsed());
+#ifdef _WIN32
+    if (CFileDupeControl* dupes = CFileDupeControl::Get(); dupes != nullptr)
+    {
+        usage.Add(PART_TRACKERS, dupes->GetTrackerBytes());
+    }
+#endif
+
+    // Items of the default arena are not part of any scan
+    if (root == nullptr || CItemArena::Of(root) == CItemArena::Default()) return usage;
+
+    const CItemArena* arena = CItemArena::Of(root);
+    usage.m_Items = arena->GetLiveCount(CItemArena::POOL_ITEMS);
+    usage.Add(PART_ITEMS, arena->GetBytesReserved(CItemArena::POOL_ITEMS));
+    usage.Add(PART_FOLDERS, arena->GetBytesReserved(CItemArena::POOL_FOLDERS) +
+        arena->GetBytesReserved(CItemArena::POOL_BLOCKS) + arena->GetHeapBytes());
+    usage.Add(PART_NAMES, arena->GetBytesReserved(CItemArena::POOL_NAMES));
+    return usage;
+}
+
+LPCWSTR CMemoryUsage::GetPartName(const PART part)
+{
+    static constexpr std::array<LPCWSTR, PART_COUNT> names =
+    {
+        L"Items", L"Folders", L"Names", L"Extensions", L"Visible rows", L"Duplicate trackers", L"Duplicate nodes"
+    };
+    return names[part];
+}
+
+size_t CMemoryUsage::GetTotal() const
+{
+    return std::accumulate(m_Bytes.begin(), m_Bytes.end(), size_t{ 0 });
+}
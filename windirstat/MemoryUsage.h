@@ -0,0 +1,75 @@
+// MemoryUsage.h - Declaration of CMemoryUsage
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#pragma once
+
+#ifdef _WIN32
+#include "stdafx.h"
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <algorithm>
+#include <array>
+
+class CItem;
+
+//
+// CMemoryUsage. Memory held by the results of a scan broken down by the
+// structures holding it. Items, folders and names are counted exactly by
+// the arena of the tree; the rest is estimated from the sizes of the
+// containers involved. Cheap enough to be collected while scanning.
+//
+class CMemoryUsage final
+{
+public:
+
+    enum PART : unsigned char
+    {
+        PART_ITEMS,        // CItem objects
+        PART_FOLDERS,      // CHILDINFO and the child lists
+        PART_NAMES,        // Names stored in the arena
+        PART_EXTENSIONS,   // Registered extensions and their statistics
+        PART_VISIBLE,      // VISIBLEINFO of items shown in the lists
+        PART_TRACKERS,     // Size and hash trackers of the duplicate search
+        PART_DUPES,        // CItemDupe nodes
+        PART_COUNT
+    };
+
+    // Collects what belongs to the tree and to the process; parts owned by
+    // the views are added by the document
+    static CMemoryUsage Collect(const CItem* root);
+
+    // Untranslated name of the part for traces and console output
+    static LPCWSTR GetPartName(PART part);
+
+    void Add(const PART part, const size_t bytes) { m_Bytes[part] += bytes; }
+    size_t GetBytes(const PART part) const { return m_Bytes[part]; }
+    size_t GetBytesPerItem(const PART part) const { return m_Bytes[part] / std::max<size_t>(m_Items, 1); }
+    size_t GetTotal() const;
+    size_t GetTotalPerItem() const { return GetTotal() / std::max<size_t>(m_Items, 1); }
+    size_t GetItemCount() const { return m_Items; }
+
+private:
+
+    std::array<size_t, PART_COUNT> m_Bytes = {};
+    size_t m_Items = 0;
+};
@@ -0,0 +1,500 @@
+// MftReader.cpp - Implementation of MftReader
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifdef _WIN32
+#include "stdafx.h"
+#include "Item.h"
+#include "Options.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MftReader.h"
+#include "FileFind.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <stack>
+#include <unordered_map>
+
+namespace
+{
+    constexpr ULONGLONG FIRST_USER_RECORD = 16;  // records below this are metadata files
+    constexpr ULONG FIXUP_STRIDE = 512;          // update sequence entries cover 512 byte blocks
+    constexpr ULONGLONG REFERENCE_MASK = 0x0000FFFFFFFFFFFFull;  // record number; the upper 16 bits are its sequence
+    constexpr size_t READ_CHUNK = 1024 * 1024;
+    constexpr size_t READ_ALIGNMENT = 4096;      // largest sector size, so a multiple of any of them
+
+    constexpr ULONG ATTRIBUTE_STANDARD_INFORMATION = 0x10;
+    constexpr ULONG ATTRIBUTE_FILE_NAME = 0x30;
+    constexpr ULONG ATTRIBUTE_DATA = 0x80;
+    constexpr ULONG ATTRIBUTE_END = 0xFFFFFFFF;
+
+    constexpr WORD RECORD_IN_USE = 0x0001;
+    constexpr WORD RECORD_DIRECTORY = 0x0002;
+    constexpr WORD DATA_COMPRESSED_OR_SPARSE = 0x8001;
+    constexpr BYTE NAMESPACE_DOS = 2;
+
+    template <typename T> T Get(const BYTE* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    WORD SequenceOf(const ULONGLONG reference)
+    {
+        return static_cast<WORD>(reference >> 48);
+    }
+
+    // Invokes the callback for each well formed attribute in a record
+    template <typename Callback> void ForEachAttribute(const BYTE* record, const ULONG recordSize, Callback&& callback)
+    {
+        const ULONG used = std::min(Get<ULONG>(record + 0x18), recordSize);
+        for (ULONG offset = Get<WORD>(record + 0x14); offset + 0x10 <= used;)
+        {
+            const BYTE* attribute = record + offset;
+            const ULONG length = Get<ULONG>(attribute + 0x04);
+            if (Get<ULONG>(attribute) == ATTRIBUTE_END || length < 0x10 || offset + length > used) break;
+            callback(attribute, length);
+            offset += length;
+        }
+    }
+}
+
+MftReader::~MftReader()
+{
+#ifdef _WIN32
+    if (m_Handle != INVALID_HANDLE_VALUE) CloseHandle(m_Handle);
+#else
+    if (m_Descriptor != -1) close(m_Descriptor);
+#endif
+}
+
+bool MftReader::Open(const std::wstring& path)
+{
+#ifdef _WIN32
+    m_Handle = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_Handle == INVALID_HANDLE_VALUE) return false;
+#else
+    m_Descriptor = open(FileFindPosix::ToNativePath(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_Descriptor == -1) return false;
+#endif
+    return LocateVolume();
+}
+
+size_t MftReader::ReadBlocks(const ULONGLONG offset, void* buffer, const size_t size) const
+{
+#ifdef _WIN32
+    OVERLAPPED position = {};
+    position.Offset = static_cast<DWORD>(offset);
+    position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD read = 0;
+    return ReadFile(m_Handle, buffer, static_cast<DWORD>(size), &read, &position) ? read : 0;
+#else
+    const ssize_t read = pread(m_Descriptor, buffer, size, static_cast<off_t>(offset));
+    return read > 0 ? static_cast<size_t>(read) : 0;
+#endif
+}
+
+bool MftReader::ReadAt(const ULONGLONG offset, void* buffer, const size_t size) const
+{
+    const ULONGLONG first = offset & ~static_cast<ULONGLONG>(READ_ALIGNMENT - 1);
+    const ULONGLONG last = (offset + size + READ_ALIGNMENT - 1) & ~static_cast<ULONGLONG>(READ_ALIGNMENT - 1);
+    if (first == offset && last == offset + size) return ReadBlocks(offset, buffer, size) == size;
+
+    // Volumes only accept whole sectors, so the covering blocks are read and
+    // sliced; an image file may end within the last block
+    std::vector<BYTE> blocks(static_cast<size_t>(last - first));
+    if (ReadBlocks(first, blocks.data(), blocks.size()) < offset + size - first) return false;
+    std::memcpy(buffer, blocks.data() + (offset - first), size);
+    return true;
+}
+
+bool MftReader::IsNtfsBootSector(const ULONGLONG offset)
+{
+    // Read a full 4K so the request is aligned for any sector size
+    std::vector<BYTE> boot(4096);
+    if (!ReadAt(offset, boot.data(), boot.size()) || std::memcmp(&boot[0x03], "NTFS    ", 8) != 0)
+    {
+        return false;
+    }
+
+    // Larger cluster sizes are stored as a negative power of two
+    const ULONG bytesPerSector = Get<WORD>(&boot[0x0B]);
+    const BYTE sectorsPerCluster = boot[0x0D];
+    const ULONG clusterSectors = sectorsPerCluster > 0x80 ? 1u << (256 - sectorsPerCluster) : sectorsPerCluster;
+    if (bytesPerSector < 256 || bytesPerSector > 4096 || clusterSectors == 0) return false;
+
+    const ULONG bytesPerCluster = bytesPerSector * clusterSectors;
+    const auto clustersPerRecord = static_cast<signed char>(boot[0x40]);
+    const ULONG bytesPerRecord = clustersPerRecord > 0 ?
+        clustersPerRecord * bytesPerCluster : 1u << -clustersPerRecord;
+    if (bytesPerRecord < FIXUP_STRIDE || bytesPerRecord > 65536) return false;
+
+    m_VolumeOffset = offset;
+    m_BytesPerCluster = bytesPerCluster;
+    m_BytesPerRecord = bytesPerRecord;
+    m_MftOffset = offset + Get<ULONGLONG>(&boot[0x30]) * bytesPerCluster;
+    return true;
+}
+
+bool MftReader::LocateVolume()
+{
+    // A volume or volume image starts with its boot sector
+    if (IsNtfsBootSector(0)) return true;
+
+    // Otherwise look for an NTFS partition in a whole disk image
+    std::array<BYTE, 512> mbr;
+    if (!ReadAt(0, mbr.data(), mbr.size()) || Get<WORD>(&mbr[510]) != 0xAA55) return false;
+
+    std::vector<ULONGLONG> partitions;
+    for (int i = 0; i < 4; i++)
+    {
+        const BYTE* entry = &mbr[0x1BE + i * 16];
+        if (entry[4] == 0) continue;
+        if (entry[4] != 0xEE)
+        {
+            partitions.push_back(Get<ULONG>(entry + 8) * 512ull);
+            continue;
+        }
+
+        // A protective entry means the partitions are listed in the GPT
+        std::array<BYTE, 512> header;
+        if (!ReadAt(512, header.data(), header.size()) || std::memcmp(header.data(), "EFI PART", 8) != 0) continue;
+        const ULONG count = std::min(Get<ULONG>(&header[0x50]), 128u);
+        const ULONG size = Get<ULONG>(&header[0x54]);
+        if (size < 0x30 || size > 4096) continue;
+
+        std::vector<BYTE> table(static_cast<size_t>(count) * size);
+        if (!ReadAt(Get<ULONGLONG>(&header[0x48]) * 512, table.data(), table.size())) continue;
+        for (ULONG e = 0; e < count; e++)
+        {
+            if (const auto first = Get<ULONGLONG>(&table[e * size + 0x20]); first != 0) partitions.push_back(first * 512);
+        }
+    }
+
+    return std::ranges::any_of(partitions, [this](const ULONGLONG offset) { return IsNtfsBootSector(offset); });
+}
+
+bool MftReader::ApplyFixups(BYTE* record) const
+{
+    if (std::memcmp(record, "FILE", 4) != 0) return false;
+
+    // The last two bytes of every block were replaced by the update sequence
+    // number on write; a mismatch means the record was torn
+    const WORD offset = Get<WORD>(record + 0x04);
+    const WORD count = Get<WORD>(record + 0x06);
+    if (count == 0 || offset + count * 2u > m_BytesPerRecord || (count - 1u) * FIXUP_STRIDE > m_BytesPerRecord) return false;
+
+    const WORD sequence = Get<WORD>(record + offset);
+    for (WORD i = 1; i < count; i++)
+    {
+        BYTE* end = record + i * FIXUP_STRIDE - 2;
+        if (Get<WORD>(end) != sequence) return false;
+        std::memcpy(end, record + offset + i * 2, 2);
+    }
+    return true;
+}
+
+std::vector<MftReader::RUN> MftReader::DecodeRuns(const BYTE* data, const size_t length)
+{
+    std::vector<RUN> runs;
+    LONGLONG lcn = 0;
+    for (size_t pos = 0; pos < length && data[pos] != 0;)
+    {
+        // The header holds the byte counts of the run length and cluster offset
+        const int lengthSize = data[pos] & 0x0F;
+        const int offsetSize = data[pos] >> 4;
+        pos++;
+        if (lengthSize == 0 || lengthSize > 8 || offsetSize > 8 || pos + lengthSize + offsetSize > length) break;
+
+        ULONGLONG clusters = 0;
+        for (int i = 0; i < lengthSize; i++) clusters |= static_cast<ULONGLONG>(data[pos + i]) << (8 * i);
+        pos += lengthSize;
+
+        // Offsets are signed and relative to the previous run; none means sparse
+        if (offsetSize == 0)
+        {
+            runs.push_back({ ~0ull, clusters });
+            continue;
+        }
+
+        ULONGLONG delta = 0;
+        for (int i = 0; i < offsetSize; i++) delta |= static_cast<ULONGLONG>(data[pos + i]) << (8 * i);
+        if (offsetSize < 8 && (data[pos + offsetSize - 1] & 0x80) != 0) delta |= ~0ull << (8 * offsetSize);
+        pos += offsetSize;
+
+        lcn += static_cast<LONGLONG>(delta);
+        runs.push_back({ static_cast<ULONGLONG>(lcn), clusters });
+    }
+    return runs;
+}
+
+void MftReader::ParseRecord(BYTE* record, const ULONGLONG index, std::vector<RECORDINFO>& records,
+    std::vector<EXTENSION>& extensions) const
+{
+    if (!ApplyFixups(record)) return;
+    const WORD flags = Get<WORD>(record + 0x16);
+    if ((flags & RECORD_IN_USE) == 0) return;
+
+    // Extension records hold overflow attributes of their base record
+    if (const ULONGLONG base = Get<ULONGLONG>(record + 0x20); (base & REFERENCE_MASK) != 0)
+    {
+        extensions.push_back({ base, {} });
+        ParseAttributes(record, extensions.back().m_Info);
+        return;
+    }
+
+    auto& info = records[index];
+    info.m_InUse = true;
+    info.m_Directory = (flags & RECORD_DIRECTORY) != 0;
+    info.m_Sequence = Get<WORD>(record + 0x10);
+    ParseAttributes(record, info);
+}
+
+void MftReader::ParseAttributes(const BYTE* record, RECORDINFO& info) const
+{
+    ForEachAttribute(record, m_BytesPerRecord, [&info](const BYTE* attribute, const ULONG length)
+    {
+        const ULONG type = Get<ULONG>(attribute);
+        const bool nonResident = attribute[0x08] != 0;
+        const bool named = attribute[0x09] != 0;
+
+        if (nonResident)
+        {
+            // Only the first extent of the unnamed stream carries its sizes
+            if (type != ATTRIBUTE_DATA || named || length < 0x40 || Get<ULONGLONG>(attribute + 0x10) != 0) return;
+            const bool compressed = (Get<WORD>(attribute + 0x0C) & DATA_COMPRESSED_OR_SPARSE) != 0 && length >= 0x48;
+            info.m_SizeLogical = Get<ULONGLONG>(attribute + 0x30);
+            info.m_SizePhysical = Get<ULONGLONG>(attribute + (compressed ? 0x40 : 0x28));
+            info.m_HasData = true;
+            return;
+        }
+
+        const ULONG valueLength = Get<ULONG>(attribute + 0x10);
+        const WORD valueOffset = Get<WORD>(attribute + 0x14);
+        if (valueOffset + valueLength > length) return;
+        const BYTE* value = attribute + valueOffset;
+
+        if (type == ATTRIBUTE_STANDARD_INFORMATION && valueLength >= 0x24)
+        {
+            const auto modified = Get<ULONGLONG>(value + 0x08);
+            info.m_LastChange = { static_cast<DWORD>(modified), static_cast<DWORD>(modified >> 32) };
+            info.m_Attributes = Get<ULONG>(value + 0x20);
+        }
+        else if (type == ATTRIBUTE_FILE_NAME && valueLength >= 0x42)
+        {
+            // Short names are only aliases of the long name of the same link
+            const BYTE characters = value[0x40];
+            if (value[0x41] == NAMESPACE_DOS || 0x42u + characters * 2u > valueLength) return;
+
+            std::wstring name(characters, L'\0');
+            for (BYTE i = 0; i < characters; i++) name[i] = static_cast<WCHAR>(Get<WORD>(value + 0x42 + i * 2));
+            info.m_Names.emplace_back(Get<ULONGLONG>(value), std::move(name));
+        }
+        else if (type == ATTRIBUTE_DATA && !named)
+        {
+            // Resident data lives inside the record and takes no clusters
+            info.m_SizeLogical = valueLength;
+            info.m_SizePhysical = 0;
+            info.m_HasData = true;
+        }
+    });
+}
+
+bool MftReader::Read(std::vector<MFTENTRY>& entries)
+{
+    // The MFT describes its own location in its first record
+    std::vector<BYTE> first(m_BytesPerRecord);
+    if (!ReadAt(m_MftOffset, first.data(), first.size()) || !ApplyFixups(first.data())) return false;
+
+    std::vector<RUN> runs;
+    ULONGLONG mftSize = 0;
+    ForEachAttribute(first.data(), m_BytesPerRecord, [&](const BYTE* attribute, const ULONG length)
+    {
+        if (Get<ULONG>(attribute) != ATTRIBUTE_DATA || attribute[0x08] == 0 ||
+            attribute[0x09] != 0 || length < 0x40 || Get<ULONGLONG>(attribute + 0x10) != 0) return;
+        const WORD runOffset = Get<WORD>(attribute + 0x20);
+        if (runOffset >= length) return;
+        runs = DecodeRuns(attribute + runOffset, length - runOffset);
+        mftSize = Get<ULONGLONG>(attribute + 0x30);
+    });
+    if (runs.empty()) return false;
+
+    // Stream the table run by run; records may straddle chunk boundaries
+    const ULONGLONG count = mftSize / m_BytesPerRecord;
+    std::vector<RECORDINFO> records(count);
+    std::vector<EXTENSION> extensions;
+    std::vector<BYTE> pending;
+    std::vector<BYTE> chunk;
+    ULONGLONG index = 0;
+    const ULONGLONG chunkClusters = std::max<ULONGLONG>(1, READ_CHUNK / m_BytesPerCluster);
+    for (const auto& run : runs)
+    {
+        for (ULONGLONG done = 0; done < run.m_Length && index < count;)
+        {
+            const ULONGLONG clusters = std::min(run.m_Length - done, chunkClusters);
+            chunk.assign(static_cast<size_t>(clusters * m_BytesPerCluster), 0);
+            if (run.m_Lcn != ~0ull && !ReadAt(m_VolumeOffset + (run.m_Lcn + done) * m_BytesPerCluster,
+                chunk.data(), chunk.size())) return false;
+            done += clusters;
+
+            pending.insert(pending.end(), chunk.begin(), chunk.end());
+            size_t pos = 0;
+            for (; pending.size() - pos >= m_BytesPerRecord && index < count; pos += m_BytesPerRecord)
+            {
+                ParseRecord(&pending[pos], index++, records, extensions);
+            }
+            pending.erase(pending.begin(), pending.begin() + static_cast<ptrdiff_t>(pos));
+        }
+    }
+
+    // A reference only points to the record it was made for while the
+    // sequence numbers match; otherwise the record was freed and reused
+    const auto isCurrent = [&records](const ULONGLONG reference)
+    {
+        const ULONGLONG record = reference & REFERENCE_MASK;
+        return record < records.size() && records[record].m_InUse && records[record].m_Sequence == SequenceOf(reference);
+    };
+
+    for (auto& [base, extension] : extensions)
+    {
+        if (!isCurrent(base)) continue;
+        auto& info = records[base & REFERENCE_MASK];
+        std::ranges::move(extension.m_Names, std::back_inserter(info.m_Names));
+        if (extension.m_HasData)
+        {
+            info.m_SizeLogical = extension.m_SizeLogical;
+            info.m_SizePhysical = extension.m_SizePhysical;
+        }
+    }
+
+    // Emit one entry per link; metadata files other than the root are hidden
+    // from directory listings so they are left out here as well
+    for (ULONGLONG record = FIRST_USER_RECORD; record < records.size(); record++)
+    {
+        const auto& info = records[record];
+        if (!info.m_InUse) continue;
+
+        DWORD attributes = info.m_Attributes;
+        if (info.m_Directory) attributes |= FILE_ATTRIBUTE_DIRECTORY;
+        else if (attributes == 0) attributes = FILE_ATTRIBUTE_NORMAL;
+
+        for (const auto& [parent, name] : info.m_Names)
+        {
+            // Links into a folder that has since been deleted are orphans
+            if (!isCurrent(parent) || !records[parent & REFERENCE_MASK].m_Directory) continue;
+            entries.push_back({ name, record, parent & REFERENCE_MASK,
+                info.m_Directory ? 0 : info.m_SizeLogical,
+                info.m_Directory ? 0 : info.m_SizePhysical,
+                info.m_LastChange, attributes });
+        }
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+std::wstring GetVolumeDevicePath(const std::wstring& drive)
+{
+    // The trailing backslash would open the root folder instead of the volume
+    std::wstring volume = drive;
+    if (volume.ends_with(L'\\')) volume.pop_back();
+    return L"\\\\.\\" + volume;
+}
+
+bool LoadFromMft(CItem* root, const std::wstring& source)
+{
+    if (!root->GetChildren().empty()) return false;
+
+    MftReader reader;
+    std::vector<MftReader::MFTENTRY> entries;
+    if (!reader.Open(source) || !reader.Read(entries)) return false;
+
+    // Group entries by folder so the tree can be built from the root down;
+    // this also leaves out orphaned records that are not reachable from it
+    std::unordered_map<ULONGLONG, std::vector<const MftReader::MFTENTRY*>> folders;
+    for (const auto& entry : entries)
+    {
+        folders[entry.m_Parent].push_back(&entry);
+    }
+
+    std::stack<std::pair<ULONGLONG, CItem*>> queue({ { MftReader::ROOT_RECORD, root } });
+    while (!queue.empty())
+    {
+        const auto [record, parent] = queue.top();
+        queue.pop();
+
+        // Each folder is only expanded once even if the table is inconsistent
+        const auto folder = folders.find(record);
+        if (folder == folders.end()) continue;
+        const auto children = std::move(folder->second);
+        folders.erase(folder);
+
+        for (const auto& entry : children)
+        {
+            constexpr DWORD hiddenSystem = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM;
+            if (COptions::SkipHidden && (entry->m_Attributes & FILE_ATTRIBUTE_HIDDEN) != 0 ||
+                COptions::SkipProtected && (entry->m_Attributes & hiddenSystem) == hiddenSystem)
+            {
+                continue;
+            }
+
+            const bool directory = (entry->m_Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            const auto child = new (CItemArena::Of(parent)) CItem(directory ? IT_DIRECTORY : IT_FILE, entry->m_Name, entry->m_LastChange,
+                entry->m_SizePhysical, entry->m_SizeLogical, entry->m_Attributes, 0, 0);
+            parent->AddChild(child);
+
+            if (!directory)
+            {
+                parent->UpwardAddFiles(1);
+                continue;
+            }
+
+            // The MFT only knows the reparse point itself, not what it points to
+            parent->UpwardAddFolders(1);
+            if ((entry->m_Attributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+            {
+                queue.emplace(entry->m_Record, child);
+            }
+        }
+    }
+    return true;
+}
+
+CItem* LoadMftImage(const std::wstring& path)
+{
+    const auto root = new (CItemArena::Create()) CItem(IT_DIRECTORY | ITF_ROOTITEM, path);
+    if (LoadFromMft(root, path))
+    {
+        root->RecurseFreeze();
+        return root;
+    }
+
+    CItem::DeleteTree(root);
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,132 @@
+// MftReader.h - Declaration of MftReader
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include <stdafx.h>
+#else
+#include "PosixCompat.h"
+#endif
+
+#include <string>
+#include <vector>
+
+//
+// MftReader. Reads the master file table of an NTFS volume in one sequential
+// pass instead of querying every directory. The source can be a live volume
+// (\\.\C:) or an image file holding either a bare NTFS volume or a whole disk
+// with an MBR or GPT partition table (raw .img or fixed .vhd).
+//
+// Every name of a file becomes its own entry so hard links show up in each
+// folder that contains them, just as they do when enumerating directories.
+// Sizes are taken from the unnamed $DATA stream; physical sizes use the
+// compressed size for compressed and sparse streams.
+//
+class MftReader final
+{
+public:
+
+    static constexpr ULONGLONG ROOT_RECORD = 5;
+
+    using MFTENTRY = struct MFTENTRY
+    {
+        std::wstring m_Name;
+        ULONGLONG m_Record = 0;
+        ULONGLONG m_Parent = 0;
+        ULONGLONG m_SizeLogical = 0;
+        ULONGLONG m_SizePhysical = 0;
+        FILETIME m_LastChange = {};
+        DWORD m_Attributes = 0;
+    };
+
+private:
+
+    using RUN = struct RUN
+    {
+        ULONGLONG m_Lcn;     // first cluster on the volume, ~0 if sparse
+        ULONGLONG m_Length;  // number of clusters
+    };
+
+    // Per record state gathered from the base record and its extensions
+    using RECORDINFO = struct RECORDINFO
+    {
+        std::vector<std::pair<ULONGLONG, std::wstring>> m_Names; // parent reference, name
+        ULONGLONG m_SizeLogical = 0;
+        ULONGLONG m_SizePhysical = 0;
+        FILETIME m_LastChange = {};
+        DWORD m_Attributes = 0;
+        WORD m_Sequence = 0;
+        bool m_InUse = false;
+        bool m_Directory = false;
+        bool m_HasData = false;
+    };
+
+    // Extension records are merged once the sequence number of their base is known
+    using EXTENSION = struct EXTENSION
+    {
+        ULONGLONG m_Base;  // file reference of the base record
+        RECORDINFO m_Info;
+    };
+
+#ifdef _WIN32
+    HANDLE m_Handle = INVALID_HANDLE_VALUE;
+#else
+    int m_Descriptor = -1;
+#endif
+    ULONGLONG m_VolumeOffset = 0;
+    ULONG m_BytesPerCluster = 0;
+    ULONG m_BytesPerRecord = 0;
+    ULONGLONG m_MftOffset = 0;
+
+    size_t ReadBlocks(ULONGLONG offset, void* buffer, size_t size) const;
+    bool ReadAt(ULONGLONG offset, void* buffer, size_t size) const;
+    bool IsNtfsBootSector(ULONGLONG offset);
+    bool LocateVolume();
+    bool ApplyFixups(BYTE* record) const;
+    void ParseRecord(BYTE* record, ULONGLONG index, std::vector<RECORDINFO>& records, std::vector<EXTENSION>& extensions) const;
+    void ParseAttributes(const BYTE* record, RECORDINFO& info) const;
+    static std::vector<RUN> DecodeRuns(const BYTE* data, size_t length);
+
+public:
+
+    MftReader() = default;
+    MftReader(const MftReader&) = delete;
+    MftReader& operator=(const MftReader&) = delete;
+    ~MftReader();
+
+    bool Open(const std::wstring& path);
+    bool Read(std::vector<MFTENTRY>& entries);
+};
+
+#ifdef _WIN32
+
+class CItem;
+
+// Device path of the volume of a drive like C:\ that can be passed to LoadFromMft
+std::wstring GetVolumeDevicePath(const std::wstring& drive);
+
+// Populates an empty drive or folder item from the MFT of the given volume or image
+bool LoadFromMft(CItem* root, const std::wstring& source);
+
+// Creates a new root item holding the contents of a disk image
+CItem* LoadMftImage(const std::wstring& path);
+
+#endif
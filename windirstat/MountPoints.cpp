@@ -28,13 +28,13 @@
 
 #include <algorithm>
 
-bool CReparsePoints::IsReparseType(const std::wstring & longpath, const std::unordered_set<DWORD>& tagTypes, const bool mask)
+DWORD CReparsePoints::GetReparseTag(const std::wstring& longpath)
 {
     SmartPointer<HANDLE> handle(CloseHandle, CreateFile(longpath.c_str(), GENERIC_READ, FILE_SHARE_READ,
         nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr));
     if (handle == INVALID_HANDLE_VALUE)
     {
-        return false;
+        return 0;
     }
 
     std::vector<BYTE> buf(MAXIMUM_REPARSE_DATA_BUFFER_SIZE);
@@ -42,11 +42,17 @@ bool CReparsePoints::IsReparseType(const std::wstring & longpath, const std::uno
     if (DeviceIoControl(handle, FSCTL_GET_REPARSE_POINT,
         nullptr, 0, buf.data(), MAXIMUM_REPARSE_DATA_BUFFER_SIZE, &dwRet, nullptr) == FALSE)
     {
-        return false;
+        return 0;
     }
 
+    return reinterpret_cast<PREPARSE_GUID_DATA_BUFFER>(buf.data())->ReparseTag;
+}
+
+bool CReparsePoints::IsReparseType(const std::wstring & longpath, const std::unordered_set<DWORD>& tagTypes, const bool mask)
+{
     // Test if the tag matches the types or mask that was passed
-    const DWORD tag = reinterpret_cast<PREPARSE_GUID_DATA_BUFFER>(buf.data())->ReparseTag;
+    const DWORD tag = GetReparseTag(longpath);
+    if (tag == 0) return false;
     return std::ranges::any_of(tagTypes, [tag, mask](const DWORD& tagType) {
         return (mask && (tag & tagType) == tag) || (!mask && tag == tagType); });
 }
@@ -138,5 +144,11 @@ bool CReparsePoints::IsCloudLink(const std::wstring& longpath, DWORD attr) const
 {
     if (attr == INVALID_FILE_ATTRIBUTES) attr = ::GetFileAttributes(longpath.c_str());
     if (!IsReparsePoint(attr)) return false;
-    return IsReparseType(longpath, { IO_REPARSE_TAG_CLOUD_MASK }, true);
+    return IsCloudLinkTag(GetReparseTag(longpath));
+}
+
+// Cloud tags differ only in the bits covered by the cloud mask
+bool CReparsePoints::IsCloudLinkTag(const DWORD tag)
+{
+    return (tag & ~IO_REPARSE_TAG_CLOUD_MASK) == IO_REPARSE_TAG_CLOUD;
 }
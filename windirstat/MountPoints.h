@@ -38,4 +38,6 @@ public:
     bool IsCloudLink(const std::wstring& longpath, DWORD attr = INVALID_FILE_ATTRIBUTES) const;
     static bool IsReparseType(const std::wstring& longpath, const std::unordered_set<DWORD>& tagTypes, bool mask = false);
     static bool IsReparsePoint(DWORD attr);
+    static bool IsCloudLinkTag(DWORD tag);
+    static DWORD GetReparseTag(const std::wstring& longpath);
 };
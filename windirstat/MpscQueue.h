@@ -0,0 +1,82 @@
+// MpscQueue.h - Declaration of MpscQueue
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+//
+// MpscQueue. Lock-free multiple producer, single consumer queue. Producers
+// push onto an intrusive stack with a single compare-and-swap; the consumer
+// detaches the whole stack at once and reverses it so that items are handed
+// out in the order they were pushed. Producers never wait on the consumer.
+//
+template <typename T>
+class MpscQueue final
+{
+    struct Node
+    {
+        T m_Value;
+        Node* m_Next = nullptr;
+    };
+
+    std::atomic<Node*> m_Head = nullptr;
+
+public:
+
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        (void)PopAll();
+    }
+
+    void Push(T value)
+    {
+        const auto node = new Node{ std::move(value) };
+        node->m_Next = m_Head.load(std::memory_order_relaxed);
+        while (!m_Head.compare_exchange_weak(node->m_Next, node,
+            std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    bool IsEmpty() const
+    {
+        return m_Head.load(std::memory_order_relaxed) == nullptr;
+    }
+
+    // Takes everything pushed so far in first-in, first-out order; must only
+    // be called from the consuming thread
+    std::vector<T> PopAll()
+    {
+        std::vector<T> values;
+        for (Node* node = m_Head.exchange(nullptr, std::memory_order_acquire); node != nullptr;)
+        {
+            values.emplace_back(std::move(node->m_Value));
+            delete std::exchange(node, node->m_Next);
+        }
+        std::ranges::reverse(values);
+        return values;
+    }
+};
@@ -35,6 +35,11 @@ LPCWSTR COptions::OptionsDupeTree = L"DupeView";
 LPCWSTR COptions::OptionsExtView = L"ExtView";
 LPCWSTR COptions::OptionsDriveSelect = L"DriveSelect";
 
+Setting<bool> COptions::AdaptiveScanningThreads(OptionsGeneral, L"AdaptiveScanningThreads", false);
+Setting<bool> COptions::ReuseItemsOnRescan(OptionsGeneral, L"ReuseItemsOnRescan", false);
+Setting<bool> COptions::WatchForChanges(OptionsGeneral, L"WatchForChanges", false);
+Setting<bool> COptions::UseMftScanning(OptionsGeneral, L"UseMftScanning", false);
+Setting<bool> COptions::AsyncEnumeration(OptionsGeneral, L"AsyncEnumeration", false);
 Setting<bool> COptions::ExcludeJunctions(OptionsGeneral, L"ExcludeJunctions", true);
 Setting<bool> COptions::ExcludeSymbolicLinks(OptionsGeneral, L"ExcludeSymbolicLinks", true);
 Setting<bool> COptions::ExcludeVolumeMountPoints(OptionsGeneral, L"ExcludeVolumeMountPoints", true);
@@ -82,6 +87,8 @@ Setting<double> COptions::SubSplitterPos(OptionsGeneral, L"SubSplitterPos", -1.0
 Setting<int> COptions::ConfigPage(OptionsGeneral, L"ConfigPage", true);
 Setting<int> COptions::LanguageId(OptionsGeneral, L"LanguageId", 0);
 Setting<int> COptions::ScanningThreads(OptionsGeneral, L"ScanningThreads", 4, 1, 16);
+Setting<int> COptions::ScanQueryRateLimit(OptionsGeneral, L"ScanQueryRateLimit", 0, 0, 1000000);
+Setting<int> COptions::HashRateLimit(OptionsGeneral, L"HashRateLimit", 0, 0, 100000);
 Setting<int> COptions::SelectDrivesRadio(OptionsDriveSelect, L"SelectDrivesRadio", 0, 0, 2);
 Setting<int> COptions::FileTreeColorCount(OptionsFileTree, L"FileTreeColorCount", 8);
 Setting<int> COptions::TreeMapAmbientLightPercent(OptionsTreeMap, L"TreeMapAmbientLightPercent", CTreeMap::GetDefaults().GetAmbientLightPercent(), 0, 100);
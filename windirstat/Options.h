@@ -21,7 +21,11 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "TreeMap.h"
+#else
+#include "PosixCompat.h"
+#endif
 #include "Property.h"
 
 class COptions;
@@ -105,6 +109,11 @@ class COptions
 
 public:
 
+    static Setting<bool> AdaptiveScanningThreads;
+    static Setting<bool> ReuseItemsOnRescan;
+    static Setting<bool> WatchForChanges;
+    static Setting<bool> UseMftScanning;
+    static Setting<bool> AsyncEnumeration;
     static Setting<bool> ExcludeJunctions;
     static Setting<bool> ExcludeSymbolicLinks;
     static Setting<bool> ExcludeVolumeMountPoints;
@@ -153,6 +162,8 @@ public:
     static Setting<int> FollowReparsePointMask;
     static Setting<int> LanguageId;
     static Setting<int> ScanningThreads;
+    static Setting<int> ScanQueryRateLimit;
+    static Setting<int> HashRateLimit;
     static Setting<int> SelectDrivesRadio;
     static Setting<int> FileTreeColorCount;
     static Setting<int> TreeMapAmbientLightPercent;
@@ -162,8 +173,10 @@ public:
     static Setting<int> TreeMapLightSourceY;
     static Setting<int> TreeMapScaleFactor;
     static Setting<int> TreeMapStyle;
+#ifdef _WIN32
     static Setting<RECT> AboutWindowRect;
     static Setting<RECT> DriveSelectWindowRect;
+#endif
     static Setting<std::vector<int>> DriveListColumnOrder;
     static Setting<std::vector<int>> DriveListColumnWidths;
     static Setting<std::vector<int>> DupeViewColumnOrder;
@@ -174,11 +187,14 @@ public:
     static Setting<std::vector<int>> ExtViewColumnWidth;
     static Setting<std::vector<std::wstring>> SelectDrivesDrives;
     static Setting<std::wstring> SelectDrivesFolder;
+#ifdef _WIN32
     static Setting<WINDOWPLACEMENT> MainWindowPlacement;
 
     static CTreeMap::Options TreeMapOptions;
+#endif
     static std::vector<USERDEFINEDCLEANUP> UserDefinedCleanups;
 
+#ifdef _WIN32
     static void SanitizeRect(RECT& rect);
     static void LoadAppSettings();
     static void PreProcessPersistedSettings();
@@ -187,4 +203,5 @@ public:
 
     static LANGID GetFallbackLanguage();
     static LANGID GetEffectiveLangId();
+#endif
 };
@@ -0,0 +1,55 @@
+// OptionsPosix.cpp - Settings used by headless scans on non-Windows builds
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef _WIN32
+
+#include "Options.h"
+#include "Property.h"
+
+// Only the settings read by the scan engine and the headless scan exist
+// here, with the same defaults as in Options.cpp. Nothing is persisted;
+// settings keep their defaults unless changed from the command line.
+
+std::vector<PersistedSetting*>& PersistedSetting::GetPropertySet()
+{
+    static std::vector<PersistedSetting*> _properties;
+    return _properties;
+}
+
+template <> void Setting<int>::ReadPersistedProperty() {}
+template <> void Setting<int>::WritePersistedProperty() {}
+template <> void Setting<bool>::ReadPersistedProperty() {}
+template <> void Setting<bool>::WritePersistedProperty() {}
+
+LPCWSTR COptions::OptionsGeneral = L"Options";
+LPCWSTR COptions::OptionsFileTree = L"FileTreeView";
+LPCWSTR COptions::OptionsDupeTree = L"DupeView";
+
+Setting<bool> COptions::AdaptiveScanningThreads(OptionsGeneral, L"AdaptiveScanningThreads", false);
+Setting<bool> COptions::ExcludeSymbolicLinks(OptionsGeneral, L"ExcludeSymbolicLinks", true);
+Setting<bool> COptions::ScanForDuplicates(OptionsDupeTree, L"ScanForDuplicates", false);
+Setting<bool> COptions::ShowColumnOwner(OptionsFileTree, L"ShowColumnOwner", false);
+Setting<bool> COptions::SkipHidden(OptionsGeneral, L"SkipHidden", false);
+Setting<bool> COptions::SkipProtected(OptionsGeneral, L"SkipProtected", false);
+Setting<int> COptions::ScanningThreads(OptionsGeneral, L"ScanningThreads", 4, 1, 16);
+Setting<int> COptions::ScanQueryRateLimit(OptionsGeneral, L"ScanQueryRateLimit", 0, 0, 1000000);
+Setting<int> COptions::HashRateLimit(OptionsGeneral, L"HashRateLimit", 0, 0, 100000);
+
+#endif
@@ -48,6 +48,13 @@ void CPageAdvanced::DoDataExchange(CDataExchange* pDX)
     DDX_Check(pDX, IDC_SKIPPROTECTED, m_SkipProtected);
     DDX_Check(pDX, IDC_BACKUP_RESTORE, m_UseBackupRestore);
     DDX_CBIndex(pDX, IDC_COMBO_THREADS, m_ScanningThreads);
+    DDX_Check(pDX, IDC_ADAPTIVE_THREADS, m_AdaptiveScanningThreads);
+    DDX_Check(pDX, IDC_REUSE_ITEMS, m_ReuseItemsOnRescan);
+    DDX_Check(pDX, IDC_WATCH_CHANGES, m_WatchForChanges);
+    DDX_Check(pDX, IDC_MFT_SCANNING, m_UseMftScanning);
+    DDX_Check(pDX, IDC_ASYNC_ENUMERATION, m_AsyncEnumeration);
+    DDX_Text(pDX, IDC_QUERY_RATE_LIMIT, m_ScanQueryRateLimit);
+    DDX_Text(pDX, IDC_HASH_RATE_LIMIT, m_HashRateLimit);
 }
 
 BEGIN_MESSAGE_MAP(CPageAdvanced, CPropertyPage)
@@ -55,6 +62,13 @@ BEGIN_MESSAGE_MAP(CPageAdvanced, CPropertyPage)
     ON_BN_CLICKED(IDC_SKIPHIDDEN, OnSettingChanged)
     ON_BN_CLICKED(IDC_SKIPPROTECTED, OnSettingChanged)
     ON_CBN_SELENDOK(IDC_COMBO_THREADS, OnSettingChanged)
+    ON_BN_CLICKED(IDC_ADAPTIVE_THREADS, OnSettingChanged)
+    ON_BN_CLICKED(IDC_REUSE_ITEMS, OnSettingChanged)
+    ON_BN_CLICKED(IDC_WATCH_CHANGES, OnSettingChanged)
+    ON_BN_CLICKED(IDC_MFT_SCANNING, OnSettingChanged)
+    ON_BN_CLICKED(IDC_ASYNC_ENUMERATION, OnSettingChanged)
+    ON_EN_CHANGE(IDC_QUERY_RATE_LIMIT, OnSettingChanged)
+    ON_EN_CHANGE(IDC_HASH_RATE_LIMIT, OnSettingChanged)
     ON_BN_CLICKED(IDC_EXCLUDE_VOLUME_MOUNT_POINTS, OnSettingChanged)
     ON_BN_CLICKED(IDC_EXCLUDE_JUNCTIONS, OnSettingChanged)
     ON_BN_CLICKED(IDC_EXCLUDE_SYMLINKS, OnSettingChanged)
@@ -75,6 +89,13 @@ BOOL CPageAdvanced::OnInitDialog()
     m_SkipProtected = COptions::SkipProtected;
     m_UseBackupRestore = COptions::UseBackupRestore;
     m_ScanningThreads = COptions::ScanningThreads - 1;
+    m_AdaptiveScanningThreads = COptions::AdaptiveScanningThreads;
+    m_ReuseItemsOnRescan = COptions::ReuseItemsOnRescan;
+    m_WatchForChanges = COptions::WatchForChanges;
+    m_UseMftScanning = COptions::UseMftScanning;
+    m_AsyncEnumeration = COptions::AsyncEnumeration;
+    m_ScanQueryRateLimit = COptions::ScanQueryRateLimit;
+    m_HashRateLimit = COptions::HashRateLimit;
 
     UpdateData(FALSE);
     return TRUE;
@@ -99,6 +120,15 @@ void CPageAdvanced::OnOK()
     COptions::SkipProtected = (FALSE != m_SkipProtected);
     COptions::UseBackupRestore = (FALSE != m_UseBackupRestore);
     COptions::ScanningThreads = m_ScanningThreads + 1;
+    COptions::AdaptiveScanningThreads = (FALSE != m_AdaptiveScanningThreads);
+    COptions::ReuseItemsOnRescan = (FALSE != m_ReuseItemsOnRescan);
+    COptions::WatchForChanges = (FALSE != m_WatchForChanges);
+    COptions::UseMftScanning = (FALSE != m_UseMftScanning);
+    COptions::AsyncEnumeration = (FALSE != m_AsyncEnumeration);
+
+    // Running scans pick up new rate limits with their next request
+    COptions::ScanQueryRateLimit = m_ScanQueryRateLimit;
+    COptions::HashRateLimit = m_HashRateLimit;
 
     if (refreshAll)
     {
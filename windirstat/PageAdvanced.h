@@ -49,7 +49,14 @@ protected:
     BOOL m_SkipHidden = FALSE;
     BOOL m_SkipProtected = FALSE;
     BOOL m_UseBackupRestore = FALSE;
+    BOOL m_AdaptiveScanningThreads = FALSE;
+    BOOL m_ReuseItemsOnRescan = FALSE;
+    BOOL m_WatchForChanges = FALSE;
+    BOOL m_UseMftScanning = FALSE;
+    BOOL m_AsyncEnumeration = FALSE;
     int m_ScanningThreads = 0;
+    int m_ScanQueryRateLimit = 0;
+    int m_HashRateLimit = 0;
 
     DECLARE_MESSAGE_MAP()
     afx_msg void OnSettingChanged();
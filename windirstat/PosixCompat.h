@@ -0,0 +1,88 @@
+// PosixCompat.h - Minimal Win32 type and function definitions for non-Windows builds
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cwchar>
+
+using BYTE = std::uint8_t;
+using WORD = std::uint16_t;
+using DWORD = std::uint32_t;
+using UINT = unsigned int;
+using ULONG = std::uint32_t;
+using ULONGLONG = std::uint64_t;
+using LONGLONG = std::int64_t;
+using ULONG_PTR = std::uintptr_t;
+using BOOL = int;
+using CHAR = char;
+using WCHAR = wchar_t;
+using LPWSTR = wchar_t*;
+using LPCWSTR = const wchar_t*;
+using LPVOID = void*;
+using COLORREF = DWORD;
+
+#define FALSE 0
+#define TRUE 1
+#define ASSERT(f) assert(f)
+
+struct FILETIME
+{
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+};
+
+constexpr DWORD FILE_ATTRIBUTE_READONLY = 0x00000001;
+constexpr DWORD FILE_ATTRIBUTE_HIDDEN = 0x00000002;
+constexpr DWORD FILE_ATTRIBUTE_SYSTEM = 0x00000004;
+constexpr DWORD FILE_ATTRIBUTE_DIRECTORY = 0x00000010;
+constexpr DWORD FILE_ATTRIBUTE_ARCHIVE = 0x00000020;
+constexpr DWORD FILE_ATTRIBUTE_DEVICE = 0x00000040;
+constexpr DWORD FILE_ATTRIBUTE_NORMAL = 0x00000080;
+constexpr DWORD FILE_ATTRIBUTE_SPARSE_FILE = 0x00000200;
+constexpr DWORD FILE_ATTRIBUTE_REPARSE_POINT = 0x00000400;
+constexpr DWORD FILE_ATTRIBUTE_COMPRESSED = 0x00000800;
+constexpr DWORD FILE_ATTRIBUTE_ENCRYPTED = 0x00004000;
+constexpr DWORD INVALID_FILE_ATTRIBUTES = 0xFFFFFFFF;
+constexpr DWORD IO_REPARSE_TAG_SYMLINK = 0xA000000C;
+
+inline ULONGLONG GetTickCount64()
+{
+    return static_cast<ULONGLONG>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline long CompareFileTime(const FILETIME* t1, const FILETIME* t2)
+{
+    const auto v1 = static_cast<ULONGLONG>(t1->dwHighDateTime) << 32 | t1->dwLowDateTime;
+    const auto v2 = static_cast<ULONGLONG>(t2->dwHighDateTime) << 32 | t2->dwLowDateTime;
+    return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+inline int _wcsicmp(const wchar_t* s1, const wchar_t* s2)
+{
+    return wcscasecmp(s1, s2);
+}
+
+#endif
@@ -116,8 +116,8 @@ public:
     }
 
     // Default constructor (used by non-persisted properties)
-    Setting<T>() = default;
-    ~Setting<T>() override = default;
+    Setting() = default;
+    ~Setting() override = default;
 
     // Move constructor to allow for use in dynamic containers
     Setting(Setting&& other) noexcept : Setting(other.m_Section, other.m_Entry, other.m_Value, other.m_Min, other.m_Max) {}
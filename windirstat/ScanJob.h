@@ -0,0 +1,42 @@
+// ScanJob.h - Declaration of SCANJOB
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include "FileFind.h"
+
+class CItem;
+
+//
+// SCANJOB. A folder waiting in a scan queue along with the open handle of
+// its parent, so it can be opened relative to it. The handle is only needed
+// until the folder has been opened and is released with the queue entry
+// instead of being carried by every folder of the tree.
+//
+using SCANJOB = struct SCANJOB
+{
+    CItem* m_Item = nullptr;
+    FileFindEnhanced::DirectoryHandle m_ParentHandle;
+
+    SCANJOB(CItem* item = nullptr, FileFindEnhanced::DirectoryHandle parentHandle = {}) :
+        m_Item(item), m_ParentHandle(std::move(parentHandle)) {}
+
+    explicit operator bool() const { return m_Item != nullptr; }
+};
@@ -0,0 +1,96 @@
+// ScanScheduler.h - Declaration of CScanScheduler
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+//
+// CScanScheduler. Splits a global budget of active workers between the
+// volume queues of a scan so that scanning many drives at once does not
+// oversubscribe the machine.
+//
+// Every volume with outstanding work is guaranteed one worker; the rest of
+// the budget is handed out one worker at a time to the volume with the
+// highest amount of outstanding work per worker it already has (weighted
+// fair sharing). Volumes that run out of work drop to zero so that their
+// share moves to the volumes that are still busy.
+//
+class CScanScheduler final
+{
+    unsigned int m_Budget;
+
+public:
+
+    using DEMAND = struct DEMAND
+    {
+        ULONGLONG m_Weight = 0;     // outstanding work, zero once finished
+        unsigned int m_Maximum = 1; // most workers the volume may use
+    };
+
+    explicit CScanScheduler(const unsigned int budget) : m_Budget(std::max(1u, budget)) {}
+
+    // Twice the number of processors since scanning mostly waits on I/O,
+    // but never less than what a single volume is configured to use
+    static unsigned int DefaultBudget(const unsigned int perVolume)
+    {
+        return std::max(perVolume, 2 * std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    unsigned int GetBudget() const
+    {
+        return m_Budget;
+    }
+
+    std::vector<unsigned int> Distribute(const std::vector<DEMAND>& demands) const
+    {
+        std::vector<unsigned int> shares(demands.size(), 0);
+        unsigned int remaining = m_Budget;
+        for (size_t i = 0; i < demands.size(); i++)
+        {
+            if (demands[i].m_Weight == 0) continue;
+            shares[i] = 1;
+            remaining -= std::min(remaining, 1u);
+        }
+
+        for (; remaining > 0; remaining--)
+        {
+            // Pick the volume with the most work per worker that can still grow
+            size_t best = demands.size();
+            double bestRatio = 0.0;
+            for (size_t i = 0; i < demands.size(); i++)
+            {
+                if (demands[i].m_Weight == 0 || shares[i] >= demands[i].m_Maximum) continue;
+                const double ratio = static_cast<double>(demands[i].m_Weight) / (shares[i] + 1);
+                if (ratio > bestRatio)
+                {
+                    best = i;
+                    bestRatio = ratio;
+                }
+            }
+            if (best == demands.size()) break;
+            shares[best]++;
+        }
+
+        return shares;
+    }
+};
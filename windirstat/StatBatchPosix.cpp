@@ -0,0 +1,451 @@
+// StatBatchPosix.cpp - Implementation of StatBatchPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef _WIN32
+
+#include "StatBatchPosix.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    // Requests kept in flight per ring; enough to hide network latency
+    // without letting a single directory monopolize the server
+    constexpr unsigned RING_DEPTH = 64;
+
+    // Threads shared by all batches that cannot use io_uring
+    constexpr unsigned POOL_THREADS = 16;
+
+    unsigned LoadAcquire(const unsigned* value)
+    {
+        return std::atomic_ref(*const_cast<unsigned*>(value)).load(std::memory_order_acquire);
+    }
+
+    void StoreRelease(unsigned* value, const unsigned data)
+    {
+        std::atomic_ref(*value).store(data, std::memory_order_release);
+    }
+}
+
+//
+// Ring. A minimal io_uring driven through the raw system calls so there is
+// no dependency on liburing. Each thread owns at most one; a batch claims it
+// for its lifetime and any other batch on the same thread uses the pool.
+//
+class StatBatchPosix::Ring final
+{
+    int m_Descriptor = -1;
+    void* m_SubmitMap = MAP_FAILED;
+    void* m_CompleteMap = MAP_FAILED;
+    void* m_EntriesMap = MAP_FAILED;
+    size_t m_SubmitSize = 0;
+    size_t m_CompleteSize = 0;
+    size_t m_EntriesSize = 0;
+
+    unsigned* m_SubmitTail = nullptr;
+    unsigned* m_SubmitMask = nullptr;
+    unsigned* m_SubmitArray = nullptr;
+    io_uring_sqe* m_Entries = nullptr;
+    unsigned* m_CompleteHead = nullptr;
+    const unsigned* m_CompleteTail = nullptr;
+    const unsigned* m_CompleteMask = nullptr;
+    const io_uring_cqe* m_Completions = nullptr;
+    unsigned m_Unsubmitted = 0;
+    unsigned m_Slots = 0;
+    bool m_Failed = false;
+
+    // Each request in flight occupies one slot holding its result buffer
+    std::array<struct statx, RING_DEPTH> m_Buffers = {};
+    std::array<const char*, RING_DEPTH> m_Names = {};
+    std::vector<unsigned> m_FreeSlots;
+
+    bool Initialize()
+    {
+        io_uring_params params = {};
+        m_Descriptor = static_cast<int>(syscall(__NR_io_uring_setup, RING_DEPTH, &params));
+        if (m_Descriptor < 0) return false;
+
+        // Statx is only available as an operation since Linux 5.6
+        std::vector<BYTE> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        const auto probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+        if (syscall(__NR_io_uring_register, m_Descriptor, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+            probe->last_op < IORING_OP_STATX || (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) == 0)
+        {
+            return false;
+        }
+
+        m_SubmitSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_CompleteSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_EntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+        {
+            m_SubmitSize = m_CompleteSize = std::max(m_SubmitSize, m_CompleteSize);
+        }
+
+        m_SubmitMap = mmap(nullptr, m_SubmitSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Descriptor, IORING_OFF_SQ_RING);
+        if (m_SubmitMap == MAP_FAILED) return false;
+        m_CompleteMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0 ? m_SubmitMap :
+            mmap(nullptr, m_CompleteSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Descriptor, IORING_OFF_CQ_RING);
+        if (m_CompleteMap == MAP_FAILED) return false;
+        m_EntriesMap = mmap(nullptr, m_EntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Descriptor, IORING_OFF_SQES);
+        if (m_EntriesMap == MAP_FAILED) return false;
+
+        const auto submit = static_cast<BYTE*>(m_SubmitMap);
+        const auto complete = static_cast<BYTE*>(m_CompleteMap);
+        m_SubmitTail = reinterpret_cast<unsigned*>(submit + params.sq_off.tail);
+        m_SubmitMask = reinterpret_cast<unsigned*>(submit + params.sq_off.ring_mask);
+        m_SubmitArray = reinterpret_cast<unsigned*>(submit + params.sq_off.array);
+        m_Entries = static_cast<io_uring_sqe*>(m_EntriesMap);
+        m_CompleteHead = reinterpret_cast<unsigned*>(complete + params.cq_off.head);
+        m_CompleteTail = reinterpret_cast<const unsigned*>(complete + params.cq_off.tail);
+        m_CompleteMask = reinterpret_cast<const unsigned*>(complete + params.cq_off.ring_mask);
+        m_Completions = reinterpret_cast<const io_uring_cqe*>(complete + params.cq_off.cqes);
+
+        m_Slots = std::min(params.sq_entries, RING_DEPTH);
+        for (unsigned slot = m_Slots; slot > 0; slot--)
+        {
+            m_FreeSlots.push_back(slot - 1);
+        }
+        return true;
+    }
+
+    // Hands queued requests to the kernel and optionally waits for results;
+    // false once the ring cannot be entered anymore
+    bool Enter(const unsigned wait)
+    {
+        const long entered = syscall(__NR_io_uring_enter, m_Descriptor, m_Unsubmitted, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (entered >= 0) m_Unsubmitted -= std::min(m_Unsubmitted, static_cast<unsigned>(entered));
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) m_Failed = true;
+        return !m_Failed;
+    }
+
+    void Reap(STATINFO& info)
+    {
+        const unsigned head = *m_CompleteHead;
+        const io_uring_cqe& completion = m_Completions[head & *m_CompleteMask];
+        const auto slot = static_cast<unsigned>(completion.user_data);
+        const struct statx& result = m_Buffers[slot];
+        info = { .m_Name = m_Names[slot], .m_Error = completion.res < 0 ? -completion.res : 0 };
+        if (info.m_Error == 0)
+        {
+            info.m_Mode = result.stx_mode;
+            info.m_Size = result.stx_size;
+            info.m_Blocks = result.stx_blocks;
+            info.m_LastWrite = { static_cast<time_t>(result.stx_mtime.tv_sec), static_cast<long>(result.stx_mtime.tv_nsec) };
+        }
+
+        StoreRelease(m_CompleteHead, head + 1);
+        m_FreeSlots.push_back(slot);
+    }
+
+    bool HasCompletion() const
+    {
+        return *m_CompleteHead != LoadAcquire(m_CompleteTail);
+    }
+
+public:
+
+    StatBatchPosix* m_Owner = nullptr;
+
+    Ring()
+    {
+        if (!Initialize())
+        {
+            if (m_Descriptor >= 0) close(m_Descriptor);
+            m_Descriptor = -1;
+        }
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    ~Ring()
+    {
+        if (m_EntriesMap != MAP_FAILED) munmap(m_EntriesMap, m_EntriesSize);
+        if (m_CompleteMap != MAP_FAILED && m_CompleteMap != m_SubmitMap) munmap(m_CompleteMap, m_CompleteSize);
+        if (m_SubmitMap != MAP_FAILED) munmap(m_SubmitMap, m_SubmitSize);
+        if (m_Descriptor >= 0) close(m_Descriptor);
+    }
+
+    static Ring& Get()
+    {
+        thread_local Ring ring;
+        return ring;
+    }
+
+    // A ring that failed once is not used again by this thread
+    bool IsAvailable() const
+    {
+        return m_Descriptor >= 0 && !m_Failed;
+    }
+
+    // Queues a statx request; false if all slots are in flight
+    bool Prepare(const int descriptor, const char* name)
+    {
+        if (m_FreeSlots.empty()) return false;
+        const unsigned slot = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+        m_Names[slot] = name;
+
+        // The submission ring is only ever written by this thread
+        const unsigned tail = *m_SubmitTail;
+        const unsigned index = tail & *m_SubmitMask;
+        io_uring_sqe& entry = m_Entries[index];
+        entry = {};
+        entry.opcode = IORING_OP_STATX;
+        entry.fd = descriptor;
+        entry.addr = reinterpret_cast<ULONGLONG>(name);
+        entry.len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS | STATX_MTIME;
+        entry.off = reinterpret_cast<ULONGLONG>(&m_Buffers[slot]);
+        entry.statx_flags = AT_SYMLINK_NOFOLLOW;
+        entry.user_data = slot;
+        m_SubmitArray[index] = index;
+        StoreRelease(m_SubmitTail, tail + 1);
+        m_Unsubmitted++;
+        return true;
+    }
+
+    // Hands queued requests to the kernel and waits for at least one result
+    bool Wait(STATINFO& info)
+    {
+        while (!HasCompletion())
+        {
+            if (!Enter(1)) return false;
+        }
+
+        Reap(info);
+        return true;
+    }
+
+    // Takes back the requests that were queued but never handed to the
+    // kernel and returns their names
+    std::vector<const char*> Abandon()
+    {
+        // The kernel only reads the submission ring when it is entered
+        std::vector<const char*> names;
+        const unsigned tail = *m_SubmitTail;
+        for (unsigned i = m_Unsubmitted; i > 0; i--)
+        {
+            const auto slot = static_cast<unsigned>(m_Entries[(tail - i) & *m_SubmitMask].user_data);
+            names.push_back(m_Names[slot]);
+            m_FreeSlots.push_back(slot);
+        }
+        StoreRelease(m_SubmitTail, tail - m_Unsubmitted);
+        m_Unsubmitted = 0;
+        return names;
+    }
+
+    // Waits for a request the kernel has already started; these complete
+    // even if the ring cannot be entered anymore. False if none are left.
+    bool Collect(STATINFO& info)
+    {
+        if (m_Slots - m_FreeSlots.size() - m_Unsubmitted == 0) return false;
+        while (!HasCompletion())
+        {
+            if (m_Failed || !Enter(1)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        Reap(info);
+        return true;
+    }
+};
+
+//
+// Pool. Threads calling fstatat on behalf of batches that have no ring.
+// The threads live until the process exits and only ever wait for work.
+//
+class StatBatchPosix::Pool final
+{
+    std::mutex m_Mutex;
+    std::condition_variable m_Pushed;
+    std::deque<std::pair<StatBatchPosix*, const char*>> m_Requests;
+
+    [[noreturn]] void Work()
+    {
+        while (true)
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Pushed.wait(lock, [this] { return !m_Requests.empty(); });
+            const auto [batch, name] = m_Requests.front();
+            m_Requests.pop_front();
+            lock.unlock();
+
+            STATINFO info{ .m_Name = name };
+            if (struct stat st; fstatat(batch->m_Descriptor, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                info.m_Mode = st.st_mode;
+                info.m_Size = static_cast<ULONGLONG>(st.st_size);
+                info.m_Blocks = static_cast<ULONGLONG>(st.st_blocks);
+                info.m_LastWrite = st.st_mtim;
+            }
+            else info.m_Error = errno;
+            batch->Complete(std::move(info));
+        }
+    }
+
+public:
+
+    static Pool& Get()
+    {
+        // Intentionally never destroyed so exiting does not wait for the threads
+        static const auto pool = new Pool();
+        return *pool;
+    }
+
+    Pool()
+    {
+        for (unsigned i = 0; i < POOL_THREADS; i++)
+        {
+            std::thread([this] { Work(); }).detach();
+        }
+    }
+
+    void Push(StatBatchPosix* batch, const std::vector<const char*>& names)
+    {
+        {
+            std::lock_guard lock(m_Mutex);
+            for (const auto name : names) m_Requests.emplace_back(batch, name);
+        }
+        m_Pushed.notify_all();
+    }
+
+    // Removes the requests of the batch that have not started yet
+    size_t Remove(const StatBatchPosix* batch)
+    {
+        std::lock_guard lock(m_Mutex);
+        return std::erase_if(m_Requests, [batch](const auto& request) { return request.first == batch; });
+    }
+};
+
+StatBatchPosix::~StatBatchPosix()
+{
+    Reset();
+}
+
+void StatBatchPosix::Submit(const int descriptor, std::vector<const char*> names)
+{
+    Reset();
+    m_Descriptor = descriptor;
+    m_Names = std::move(names);
+
+    if (Ring& ring = Ring::Get(); ring.IsAvailable() && ring.m_Owner == nullptr)
+    {
+        ring.m_Owner = this;
+        m_UsesRing = true;
+        return;
+    }
+
+    std::lock_guard lock(m_Mutex);
+    m_Outstanding = m_Names.size();
+    m_Submitted = m_Names.size();
+    Pool::Get().Push(this, m_Names);
+}
+
+bool StatBatchPosix::Next(STATINFO& info)
+{
+    if (m_Collected >= m_Names.size()) return false;
+
+    if (m_UsesRing)
+    {
+        // Top up the ring before waiting so that it never runs dry
+        Ring& ring = Ring::Get();
+        for (; m_Submitted < m_Names.size() && ring.Prepare(m_Descriptor, m_Names[m_Submitted]); m_Submitted++) {}
+        if (ring.Wait(info))
+        {
+            m_Collected++;
+            return true;
+        }
+
+        // The ring cannot be entered anymore; whatever it has not started
+        // is handed to the pool while the rest is waited for as usual
+        FallBackToPool(ring);
+    }
+
+    std::unique_lock lock(m_Mutex);
+    m_Finished.wait(lock, [this] { return !m_Results.empty(); });
+    info = std::move(m_Results.front());
+    m_Results.pop_front();
+    m_Collected++;
+    return true;
+}
+
+void StatBatchPosix::FallBackToPool(Ring& ring)
+{
+    std::vector<const char*> pending = ring.Abandon();
+    pending.insert(pending.end(), m_Names.begin() + static_cast<ptrdiff_t>(m_Submitted), m_Names.end());
+
+    std::vector<STATINFO> started;
+    for (STATINFO info; ring.Collect(info);) started.push_back(info);
+    ring.m_Owner = nullptr;
+    m_UsesRing = false;
+
+    std::lock_guard lock(m_Mutex);
+    m_Results.insert(m_Results.end(), started.begin(), started.end());
+    m_Outstanding = pending.size();
+    m_Submitted = m_Names.size();
+    Pool::Get().Push(this, pending);
+}
+
+void StatBatchPosix::Reset()
+{
+    if (m_UsesRing)
+    {
+        // Requests the kernel has not seen are dropped, but names and result
+        // buffers must stay valid until everything it has started has landed
+        Ring& ring = Ring::Get();
+        ring.Abandon();
+        for (STATINFO info; ring.Collect(info);) {}
+        ring.m_Owner = nullptr;
+        m_UsesRing = false;
+    }
+    else if (m_Submitted > 0)
+    {
+        const size_t removed = Pool::Get().Remove(this);
+        std::unique_lock lock(m_Mutex);
+        m_Outstanding -= removed;
+        m_Finished.wait(lock, [this] { return m_Outstanding == 0; });
+        m_Results.clear();
+    }
+
+    m_Names.clear();
+    m_Submitted = m_Collected = 0;
+}
+
+void StatBatchPosix::Complete(STATINFO&& info)
+{
+    // Notify while locked; the batch may be gone as soon as the lock is released
+    std::lock_guard lock(m_Mutex);
+    m_Results.emplace_back(std::move(info));
+    m_Outstanding--;
+    m_Finished.notify_all();
+}
+
+#endif
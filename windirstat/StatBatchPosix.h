@@ -0,0 +1,99 @@
+// StatBatchPosix.h - Declaration of StatBatchPosix
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "PosixCompat.h"
+
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+//
+// StatBatchPosix. Retrieves the metadata of all entries of a directory
+// buffer at once instead of one fstatat round trip after another, which
+// dominates scan time on network file systems.
+//
+// Requests are submitted as statx operations through an io_uring owned by
+// the calling thread. Where io_uring or its statx operation is unavailable,
+// or the ring stops working, the requests are spread over a shared pool of
+// threads calling fstatat.
+// Either way results are handed out in the order they complete. A batch is
+// used only by the thread that submitted it, like the finder that owns it.
+//
+class StatBatchPosix final
+{
+public:
+
+    using STATINFO = struct STATINFO
+    {
+        const char* m_Name = nullptr;
+        int m_Error = 0;        // errno of a failed request
+        mode_t m_Mode = 0;
+        ULONGLONG m_Size = 0;
+        ULONGLONG m_Blocks = 0; // 512 byte blocks allocated
+        timespec m_LastWrite = {};
+    };
+
+private:
+
+    class Ring;
+
+    int m_Descriptor = -1;
+    std::vector<const char*> m_Names;
+    size_t m_Submitted = 0;
+    size_t m_Collected = 0;
+    bool m_UsesRing = false;
+
+    // Used by the thread pool fallback
+    class Pool;
+    std::mutex m_Mutex;
+    std::condition_variable m_Finished;
+    std::deque<STATINFO> m_Results;
+    size_t m_Outstanding = 0;
+
+    void Complete(STATINFO&& info);
+    void FallBackToPool(Ring& ring);
+
+public:
+
+    StatBatchPosix() = default;
+    StatBatchPosix(const StatBatchPosix&) = delete;
+    StatBatchPosix& operator=(const StatBatchPosix&) = delete;
+    ~StatBatchPosix();
+
+    // Starts retrieving the metadata of the names relative to the directory
+    // without following symbolic links; names must stay valid until all
+    // results have been taken or the batch is reset
+    void Submit(int descriptor, std::vector<const char*> names);
+
+    // Waits for the next finished request; false once all have been taken
+    bool Next(STATINFO& info);
+
+    // Abandons the remaining requests; waits for those already running
+    void Reset();
+};
+
+#endif
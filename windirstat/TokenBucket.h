@@ -0,0 +1,79 @@
+// TokenBucket.h - Declaration of CTokenBucket
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2004-2024 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+//
+// CTokenBucket. Thread safe rate limiter that refills at a fixed number of
+// tokens per second and holds at most one second worth of tokens, so short
+// bursts are allowed while the long term rate never exceeds the limit.
+//
+// Callers reserve tokens up front and are told how long to wait before they
+// may use them; the bucket goes into debt so that concurrent callers queue
+// up behind each other instead of all waking at the same moment. The rate
+// is passed along with every reservation so that it can be changed while
+// workers are running; a new rate starts over with a full bucket.
+//
+class CTokenBucket final
+{
+    std::mutex m_Mutex;
+    double m_Rate = 0.0;
+    double m_Tokens = 0.0;
+    std::chrono::steady_clock::time_point m_Refilled;
+
+public:
+
+    // Takes tokens at the given rate per second (zero for unlimited) and
+    // returns how long the caller has to wait before it may proceed
+    std::chrono::steady_clock::duration Reserve(const double tokens, const double rate)
+    {
+        if (rate <= 0.0) return {};
+
+        std::lock_guard lock(m_Mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (rate != m_Rate)
+        {
+            m_Rate = rate;
+            m_Tokens = rate;
+        }
+        else
+        {
+            const double elapsed = std::chrono::duration<double>(now - m_Refilled).count();
+            m_Tokens = std::min(m_Rate, m_Tokens + elapsed * m_Rate);
+        }
+        m_Refilled = now;
+
+        m_Tokens -= tokens;
+        if (m_Tokens >= 0.0) return {};
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(-m_Tokens / m_Rate));
+    }
+};
+
+// I/O budget of a single volume shared by all workers scanning it
+using SCANTHROTTLE = struct SCANTHROTTLE
+{
+    CTokenBucket m_Queries;   // folders enumerated
+    CTokenBucket m_HashBytes; // bytes read for duplicate detection
+};
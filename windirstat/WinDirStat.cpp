@@ -31,6 +31,7 @@
 #include "DirStatDoc.h"
 #include "TreeMapView.h"
 #include "GlobalHelpers.h"
+#include "HeadlessScan.h"
 #include "Localization.h"
 #include "SmartPointer.h"
 
@@ -123,6 +124,24 @@ bool CDirStatApp::IsFollowingAllowed(const std::wstring& longpath, const DWORD a
         !COptions::ExcludeSymbolicLinks && m_ReparsePoints.IsSymbolicLink(longpath, attr);
 }
 
+bool CDirStatApp::IsFollowingAllowed(const FileFindEnhanced& finder) const
+{
+    // Same rules as above using the tag reported by the enumeration; only
+    // mount points need their path to tell volumes apart from junctions
+    const DWORD attr = finder.GetAttributes();
+    if (!CReparsePoints::IsReparsePoint(attr)) return true;
+    switch (finder.GetReparseTag())
+    {
+    case IO_REPARSE_TAG_SYMLINK:
+        return !COptions::ExcludeSymbolicLinks;
+    case IO_REPARSE_TAG_MOUNT_POINT:
+        return m_ReparsePoints.IsVolumeMountPoint(finder.GetFilePathLong(), attr) ?
+            !COptions::ExcludeVolumeMountPoints : !COptions::ExcludeJunctions;
+    default:
+        return true;
+    }
+}
+
 // Get the alternative colors for compressed and encrypted files/folders.
 // This function uses either the value defined in the Explorer configuration
 // or the default color values.
@@ -250,6 +269,14 @@ BOOL CDirStatApp::InitInstance()
     SetPortableMode(true, true);
 
     COptions::LoadAppSettings();
+
+    // Scans requested on the command line run without creating any windows
+    if (const std::vector<std::wstring> args(__wargv + 1, __wargv + __argc); CHeadlessScan::IsRequested(args))
+    {
+        m_HeadlessResult = CHeadlessScan().Run(args);
+        return FALSE;
+    }
+
     LoadStdProfileSettings(4);
 
     m_PDocTemplate = new CSingleDocTemplate(
@@ -315,6 +342,12 @@ BOOL CDirStatApp::InitInstance()
     return TRUE;
 }
 
+int CDirStatApp::ExitInstance()
+{
+    const int result = CWinAppEx::ExitInstance();
+    return m_HeadlessResult.value_or(result);
+}
+
 void CDirStatApp::OnAppAbout()
 {
     StartAboutDialog();
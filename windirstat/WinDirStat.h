@@ -27,9 +27,12 @@
 #include "Langs.h"
 #include "IconImageList.h"
 #include "MountPoints.h"
+#include "FileFind.h"
 #include <common/Constants.h>
 #include <common/Tracer.h>
 
+#include <optional>
+
 class CMainFrame;
 class CDirStatApp;
 
@@ -46,6 +49,7 @@ public:
 
     CDirStatApp();
     BOOL InitInstance() override;
+    int ExitInstance() override;
     BOOL LoadState(LPCTSTR, CFrameImpl*) override { return TRUE; }
 
     bool InPortableMode() const;
@@ -53,6 +57,7 @@ public:
 
     void ReReadMountPoints();
     bool IsFollowingAllowed(const std::wstring& longpath, DWORD attr = 1) const;
+    bool IsFollowingAllowed(const FileFindEnhanced& finder) const;
     CReparsePoints* GetReparseInfo() { return &m_ReparsePoints; }
 
     COLORREF AltColor() const;           // Coloring of compressed items
@@ -79,6 +84,7 @@ protected:
     COLORREF m_AltColor;              // Coloring of compressed items
     COLORREF m_AltEncryptionColor;    // Coloring of encrypted items
     static CDirStatApp _singleton;    // Singleton application instance
+    std::optional<int> m_HeadlessResult; // Exit code of a command line scan
 #ifdef VTRACE_TO_CONSOLE
     CAutoPtr<CWDSTracerConsole> m_VtraceConsole;
 #endif // VTRACE_TO_CONSOLE
@@ -234,6 +234,9 @@
 #define IDS_GENERIC_OK                  20230
 #define IDS_GENERIC_CANCEL              20231
 #define IDS_POPUP_TREE_COMPRESS_NONE    20232
+#define IDS_SCANTHREADSs                20233
+#define IDS_DISK_IMAGE_FILES            20234
+#define IDS_MEMORYBREAKDOWNssssssssss   20235
 
 // Next default values for new objects
 // 
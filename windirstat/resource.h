@@ -116,6 +116,13 @@
 #define IDC_BROWSE_FOLDER               1232
 #define IDC_FILENAMES                   1233
 #define IDC_SCAN_DUPLICATES             1234
+#define IDC_ADAPTIVE_THREADS            1235
+#define IDC_REUSE_ITEMS                 1236
+#define IDC_WATCH_CHANGES               1237
+#define IDC_MFT_SCANNING                1238
+#define IDC_QUERY_RATE_LIMIT            1239
+#define IDC_HASH_RATE_LIMIT             1240
+#define IDC_ASYNC_ENUMERATION           1241
 #define ID_WDS_CONTROL                  4711
 #define ID_CLEANUP_EXPLORER_SELECT      32774
 #define ID_TREEMAP_ZOOMIN               32783
@@ -175,7 +182,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        954
 #define _APS_NEXT_COMMAND_VALUE         33052
-#define _APS_NEXT_CONTROL_VALUE         1235
+#define _APS_NEXT_CONTROL_VALUE         1242
 #define _APS_NEXT_SYMED_VALUE           109
 #endif
 #endif